@@ -22,6 +22,9 @@ using lucene::core::index::IndexFileNames;
 /**
  *  IndexFileNames
  */
+const std::string IndexFileNames::SEGMENTS("segments");
+const std::string IndexFileNames::PENDING_SEGMENTS("pending_segments");
+const std::string IndexFileNames::OLD_SEGMENTS_GEN("segments.gen");
 
 std::string IndexFileNames::FileNameFromGeneration(const std::string& base,
                                                    const std::string& ext,
@@ -57,18 +60,31 @@ std::string IndexFileNames::SegmentFileName(const std::string& segment_name,
 
 bool IndexFileNames::MatchesExtension(const std::string& file_name,
                                       const std::string& ext) {
-  // TODO(0ctopus13prime): Implement this
-  return true;
+  return (file_name.length() > ext.length() &&
+          file_name[file_name.length() - ext.length() - 1] == '.' &&
+          file_name.compare(file_name.length() - ext.length(),
+                            ext.length(),
+                            ext) == 0);
 }
 
 uint32_t IndexFileNames::IndexOfSegmentName(const std::string& filename) {
-  // TODO(0ctopus13prime): Implement this
-  return 0;
+  // If it is a .del file, there's an '_' after the first character
+  size_t idx = filename.find('_', 1);
+  if (idx == std::string::npos) {
+    // If it's not, strip everything that's before the '.'
+    idx = filename.find('.');
+  }
+
+  return static_cast<uint32_t>(idx);
 }
 
 std::string IndexFileNames::StripSegmentName(const std::string& filename) {
-  // TODO(0ctopus13prime): Implement this
-  return "";
+  const uint32_t idx = IndexOfSegmentName(filename);
+  if (idx != static_cast<uint32_t>(std::string::npos)) {
+    return filename.substr(idx);
+  }
+
+  return filename;
 }
 
 uint64_t IndexFileNames::ParseGeneration(const std::string& filename) {
@@ -77,16 +93,28 @@ uint64_t IndexFileNames::ParseGeneration(const std::string& filename) {
 }
 
 std::string IndexFileNames::ParseSegmentName(const std::string& filename) {
-  // TODO(0ctopus13prime): Implement this
-  return "";
+  const uint32_t idx = IndexOfSegmentName(filename);
+  if (idx != static_cast<uint32_t>(std::string::npos)) {
+    return filename.substr(0, idx);
+  }
+
+  return filename;
 }
 
 std::string IndexFileNames::StripExtension(const std::string& filename) {
-  // TODO(0ctopus13prime): Implement this
-  return "";
+  const size_t idx = filename.find('.');
+  if (idx == std::string::npos) {
+    return filename;
+  }
+
+  return filename.substr(0, idx);
 }
 
 std::string IndexFileNames::GetExtension(const std::string& filename) {
-  // TODO(0ctopus13prime): Implement this
-  return "";
+  const size_t idx = filename.rfind('.');
+  if (idx == std::string::npos) {
+    return "";
+  }
+
+  return filename.substr(idx + 1);
 }
@@ -45,6 +45,7 @@ class IndexFileNames {
   static bool MatchesExtension(const std::string& file_name,
                                const std::string& ext);
 
+  // Casted std::string::npos if there is no segment name
   static uint32_t IndexOfSegmentName(const std::string& filename);
 
   static std::string StripSegmentName(const std::string& filename);
@@ -0,0 +1,320 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <Store/BlockCache.h>
+#include <Store/Exception.h>
+#include <Util/Exception.h>
+#include <Util/File.h>
+#include <algorithm>
+#include <cstring>
+
+using lucene::core::store::AlreadyClosedException;
+using lucene::core::store::BlockCache;
+using lucene::core::store::IndexInput;
+using lucene::core::store::PReadIndexInput;
+using lucene::core::util::EOFException;
+using lucene::core::util::FileUtil;
+using lucene::core::util::IllegalArgumentException;
+
+namespace {
+
+uint32_t RoundUpToPowerOfTwo(const uint32_t value) {
+  uint32_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+
+  return result;
+}
+
+uint32_t Log2(uint32_t power_of_two) {
+  uint32_t shift = 0;
+  while (power_of_two > 1) {
+    power_of_two >>= 1;
+    ++shift;
+  }
+
+  return shift;
+}
+
+}  // namespace
+
+/**
+ *  BlockCache
+ */
+const uint32_t BlockCache::DEFAULT_BLOCK_SIZE;
+const uint32_t BlockCache::DEFAULT_NUM_SHARDS;
+
+BlockCache::BlockCache(const uint64_t max_bytes,
+                       const uint32_t block_size,
+                       const uint32_t num_shards)
+  : block_size(RoundUpToPowerOfTwo(std::max(block_size, 1U))),
+    block_shift(Log2(this->block_size)),
+    max_bytes(max_bytes),
+    shards(),
+    next_file_id(1),
+    bypasses(0) {
+  const uint32_t shard_count = RoundUpToPowerOfTwo(std::max(num_shards, 1U));
+  const uint64_t blocks_per_shard =
+  std::max<uint64_t>(1, max_bytes / this->block_size / shard_count);
+  shards.reserve(shard_count);
+  for (uint32_t i = 0 ; i < shard_count ; ++i) {
+    shards.push_back(
+      std::make_unique<Shard>(static_cast<uint32_t>(blocks_per_shard)));
+  }
+}
+
+bool BlockCache::Lookup(const Key& key,
+                        char* dst,
+                        const uint32_t block_offset,
+                        const uint32_t length) {
+  Shard& shard = GetShard(key);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    shard.misses++;
+    return false;
+  }
+
+  Slot& slot = shard.slots[it->second];
+  slot.referenced = true;
+  std::memcpy(dst, slot.data.get() + block_offset, length);
+  shard.hits++;
+  return true;
+}
+
+void BlockCache::Insert(const Key& key,
+                        const char* data,
+                        const uint32_t length) {
+  Shard& shard = GetShard(key);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  if (shard.index.find(key) != shard.index.end()) {
+    // Another reader loaded it meanwhile
+    return;
+  }
+
+  const uint32_t capacity = static_cast<uint32_t>(shard.slots.size());
+  uint32_t victim;
+  if (shard.num_used < capacity) {
+    victim = shard.num_used++;
+  } else {
+    // Second chance, a referenced block survives one more sweep
+    while (true) {
+      Slot& slot = shard.slots[shard.clock_hand];
+      if (!slot.referenced) {
+        break;
+      }
+      slot.referenced = false;
+      shard.clock_hand = (shard.clock_hand + 1) % capacity;
+    }
+
+    victim = shard.clock_hand;
+    shard.clock_hand = (shard.clock_hand + 1) % capacity;
+  }
+
+  Slot& slot = shard.slots[victim];
+  if (slot.used) {
+    shard.index.erase(slot.key);
+    shard.cached_bytes -= slot.length;
+    shard.evictions++;
+  } else {
+    slot.data = std::make_unique<char[]>(block_size);
+    slot.used = true;
+  }
+
+  std::memcpy(slot.data.get(), data, length);
+  slot.key = key;
+  slot.length = length;
+  slot.referenced = false;
+  shard.cached_bytes += length;
+  shard.index.emplace(key, victim);
+}
+
+void BlockCache::Read(const uint64_t file_id,
+                      const uint64_t file_length,
+                      const uint64_t pos,
+                      char* dst,
+                      const uint32_t length,
+                      const Loader& loader) {
+  if (pos + length > file_length) {
+    throw EOFException("Read past EOF");
+  }
+
+  std::unique_ptr<char[]> load_buffer;
+  uint64_t cur = pos;
+  uint32_t left = length;
+  while (left > 0) {
+    const Key key{file_id, cur >> block_shift};
+    const uint64_t block_start = (key.block << block_shift);
+    const uint32_t block_offset = static_cast<uint32_t>(cur - block_start);
+    const uint32_t to_copy = std::min(left, block_size - block_offset);
+
+    if (!Lookup(key, dst, block_offset, to_copy)) {
+      const uint32_t block_length = static_cast<uint32_t>(
+        std::min<uint64_t>(block_size, file_length - block_start));
+      if (!load_buffer) {
+        load_buffer = std::make_unique<char[]>(block_size);
+      }
+
+      loader(load_buffer.get(), block_length, block_start);
+      Insert(key, load_buffer.get(), block_length);
+      std::memcpy(dst, load_buffer.get() + block_offset, to_copy);
+    }
+
+    cur += to_copy;
+    dst += to_copy;
+    left -= to_copy;
+  }
+}
+
+BlockCache::Stats BlockCache::GetStats() {
+  Stats stats;
+  for (std::unique_ptr<Shard>& shard : shards) {
+    std::lock_guard<std::mutex> guard(shard->mutex);
+    stats.hits += shard->hits;
+    stats.misses += shard->misses;
+    stats.evictions += shard->evictions;
+    stats.cached_bytes += shard->cached_bytes;
+  }
+
+  stats.bypasses = bypasses.load(std::memory_order_relaxed);
+  return stats;
+}
+
+/**
+ *  PReadIndexInput
+ */
+PReadIndexInput::FileHandle::~FileHandle() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+PReadIndexInput::PReadIndexInput(const std::string& resource_desc,
+                                 const std::shared_ptr<FileHandle>& handle,
+                                 const uint64_t length,
+                                 const std::shared_ptr<BlockCache>& cache,
+                                 const IOContext& context)
+  : PReadIndexInput(resource_desc,
+                    handle,
+                    length,
+                    cache,
+                    (cache ? cache->NewFileId() : 0),
+                    context) {
+}
+
+PReadIndexInput::PReadIndexInput(const std::string& resource_desc,
+                                 const std::shared_ptr<FileHandle>& handle,
+                                 const uint64_t length,
+                                 const std::shared_ptr<BlockCache>& cache,
+                                 const uint64_t file_id,
+                                 const IOContext& context)
+  : BufferedIndexInput(resource_desc, context),
+    handle(handle),
+    cache(cache),
+    file_id(file_id),
+    file_length(length),
+    start_offset(0),
+    length(length),
+    use_cache(cache && cache->Admit(context)) {
+}
+
+PReadIndexInput::PReadIndexInput(const std::string& resource_desc,
+                                 const PReadIndexInput& parent,
+                                 const uint64_t start_offset,
+                                 const uint64_t length)
+  : BufferedIndexInput(resource_desc, parent.GetBufferSize()),
+    handle(parent.handle),
+    cache(parent.cache),
+    file_id(parent.file_id),
+    file_length(parent.file_length),
+    start_offset(start_offset),
+    length(length),
+    use_cache(parent.use_cache) {
+}
+
+std::unique_ptr<PReadIndexInput> PReadIndexInput::Clone() {
+  std::unique_ptr<PReadIndexInput> clone(
+    new PReadIndexInput(resource_desc, *this, start_offset, length));
+  clone->Seek(GetFilePointer());
+  return clone;
+}
+
+std::unique_ptr<IndexInput>
+PReadIndexInput::Slice(const std::string& slice_desc,
+                       const uint64_t offset,
+                       const uint64_t slice_length) {
+  if (offset + slice_length > length) {
+    throw IllegalArgumentException("Slice out of bounds: offset=" +
+                                   std::to_string(offset) + ", length=" +
+                                   std::to_string(slice_length) + ": " +
+                                   resource_desc);
+  }
+
+  return std::unique_ptr<IndexInput>(
+    new PReadIndexInput(resource_desc + " [slice=" + slice_desc + ']',
+                        *this,
+                        start_offset + offset,
+                        slice_length));
+}
+
+void PReadIndexInput::ReadInternal(char bytes[],
+                                   const uint32_t offset,
+                                   const uint32_t len) {
+  if (!handle) {
+    throw AlreadyClosedException("Already closed: " + resource_desc);
+  }
+
+  // Positional read, file offset is never shared
+  const uint64_t pos = GetFilePointer();
+  if (pos + len > length) {
+    throw EOFException("Read past EOF: " + resource_desc);
+  }
+
+  const int fd = handle->fd;
+  if (use_cache) {
+    cache->Read(file_id,
+                file_length,
+                start_offset + pos,
+                bytes + offset,
+                len,
+                [fd](char* buf, const uint32_t n, const uint64_t at){
+                  FileUtil::PReadFully(fd, buf, n, at);
+                });
+  } else {
+    if (cache) {
+      cache->RecordBypass();
+    }
+    FileUtil::PReadFully(fd, bytes + offset, len, start_offset + pos);
+  }
+}
+
+void PReadIndexInput::Prefetch(const uint64_t offset,
+                               const uint64_t prefetch_length) {
+  if (handle && offset < length && prefetch_length > 0) {
+    posix_fadvise(handle->fd,
+                  start_offset + offset,
+                  std::min(prefetch_length, length - offset),
+                  POSIX_FADV_WILLNEED);
+  }
+}
+
+void PReadIndexInput::Close() {
+  handle.reset();
+}
@@ -0,0 +1,303 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_BLOCKCACHE_H_
+#define SRC_STORE_BLOCKCACHE_H_
+
+#include <Store/Context.h>
+#include <Store/DataInput.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * Cache of fixed size file blocks shared by every input of a process.
+ * Blocks are spread over shards by their key, each shard has its own lock
+ * and evicts with CLOCK (second chance), so a hit only costs one
+ * uncontended lock and a memcpy.
+ * A file is identified by an id taken from NewFileId when it is opened.
+ * Ids are never reused, so blocks of a closed file can never be served
+ * again and just age out.
+ */
+class BlockCache {
+ public:
+  static const uint32_t DEFAULT_BLOCK_SIZE = 16384;
+  static const uint32_t DEFAULT_NUM_SHARDS = 16;
+
+  class Stats {
+   public:
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    // Reads that were not admitted, e.g. merges
+    uint64_t bypasses;
+    uint64_t cached_bytes;
+
+    Stats()
+      : hits(0),
+        misses(0),
+        evictions(0),
+        bypasses(0),
+        cached_bytes(0) {
+    }
+  };
+
+  // Loads `length` bytes at `offset` of the file into the buffer
+  using Loader = std::function<void(char* buf,
+                                    const uint32_t length,
+                                    const uint64_t offset)>;
+
+ private:
+  class Key {
+   public:
+    uint64_t file_id;
+    uint64_t block;
+
+    bool operator==(const Key& other) const noexcept {
+      return (file_id == other.file_id && block == other.block);
+    }
+  };
+
+  class KeyHash {
+   public:
+    size_t operator()(const Key& key) const noexcept {
+      // Block numbers of a file are dense, mix them before masking
+      uint64_t h = key.file_id * 0x9E3779B97F4A7C15ULL ^ key.block;
+      h ^= (h >> 33);
+      h *= 0xFF51AFD7ED558CCDULL;
+      h ^= (h >> 33);
+      return static_cast<size_t>(h);
+    }
+  };
+
+  class Slot {
+   public:
+    Key key;
+    std::unique_ptr<char[]> data;
+    uint32_t length;
+    bool used;
+    bool referenced;
+
+    Slot()
+      : key(),
+        data(),
+        length(0),
+        used(false),
+        referenced(false) {
+    }
+  };
+
+  class Shard {
+   public:
+    std::mutex mutex;
+    std::unordered_map<Key, uint32_t, KeyHash> index;
+    std::vector<Slot> slots;
+    uint32_t clock_hand;
+    uint32_t num_used;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t cached_bytes;
+
+    explicit Shard(const uint32_t capacity)
+      : mutex(),
+        index(),
+        slots(capacity),
+        clock_hand(0),
+        num_used(0),
+        hits(0),
+        misses(0),
+        evictions(0),
+        cached_bytes(0) {
+      index.reserve(capacity);
+    }
+  };
+
+ private:
+  const uint32_t block_size;
+  const uint32_t block_shift;
+  const uint64_t max_bytes;
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<uint64_t> next_file_id;
+  std::atomic<uint64_t> bypasses;
+
+ private:
+  Shard& GetShard(const Key& key) {
+    return *shards[KeyHash()(key) & (shards.size() - 1)];
+  }
+
+  // Copies the block out if it is cached
+  bool Lookup(const Key& key,
+              char* dst,
+              const uint32_t block_offset,
+              const uint32_t length);
+
+  void Insert(const Key& key, const char* data, const uint32_t length);
+
+ public:
+  /**
+   * `block_size` and `num_shards` are rounded up to a power of two.
+   * Every shard holds at least one block whatever `max_bytes` is.
+   */
+  explicit BlockCache(const uint64_t max_bytes,
+                      const uint32_t block_size = DEFAULT_BLOCK_SIZE,
+                      const uint32_t num_shards = DEFAULT_NUM_SHARDS);
+
+  BlockCache(const BlockCache& other) = delete;
+
+  BlockCache& operator=(const BlockCache& other) = delete;
+
+  uint64_t NewFileId() noexcept {
+    return next_file_id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint32_t GetBlockSize() const noexcept {
+    return block_size;
+  }
+
+  uint64_t GetMaxBytes() const noexcept {
+    return max_bytes;
+  }
+
+  // Merges and read once inputs would only push hot blocks out
+  bool Admit(const IOContext& context) const noexcept {
+    return (context.context != IOContext::Context::MERGE &&
+            !context.read_once);
+  }
+
+  void RecordBypass() noexcept {
+    bypasses.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Reads `length` bytes at `pos` of a file of `file_length` bytes.
+   * Missing blocks are loaded whole with `loader` and cached.
+   */
+  void Read(const uint64_t file_id,
+            const uint64_t file_length,
+            const uint64_t pos,
+            char* dst,
+            const uint32_t length,
+            const Loader& loader);
+
+  Stats GetStats();
+};
+
+/**
+ * Reads a file with pread, optionally through a BlockCache.
+ * It never maps the file, so it fits environments where address space or
+ * memory cgroup makes mmap a bad fit.
+ * Every read is positional on a shared descriptor, so clones and slices
+ * keep their own file pointer and many threads can read one file without
+ * any lock.
+ */
+class PReadIndexInput: public BufferedIndexInput {
+ public:
+  // Owns the descriptor, closed when the last input using it is gone
+  class FileHandle {
+   public:
+    const int fd;
+
+    explicit FileHandle(const int fd)
+      : fd(fd) {
+    }
+
+    FileHandle(const FileHandle& other) = delete;
+
+    FileHandle& operator=(const FileHandle& other) = delete;
+
+    ~FileHandle();
+  };
+
+ private:
+  std::shared_ptr<FileHandle> handle;
+  std::shared_ptr<BlockCache> cache;
+  uint64_t file_id;
+  uint64_t file_length;
+  // Where this input (a slice possibly) starts in the file
+  uint64_t start_offset;
+  uint64_t length;
+  bool use_cache;
+
+ private:
+  PReadIndexInput(const std::string& resource_desc,
+                  const PReadIndexInput& parent,
+                  const uint64_t start_offset,
+                  const uint64_t length);
+
+ protected:
+  void SeekInternal(const uint64_t pos) { }
+
+  void ReadInternal(char bytes[], const uint32_t offset, const uint32_t len);
+
+ public:
+  // `cache` can be null. File gets a fresh id, nothing is shared with
+  // other inputs of the file
+  PReadIndexInput(const std::string& resource_desc,
+                  const std::shared_ptr<FileHandle>& handle,
+                  const uint64_t length,
+                  const std::shared_ptr<BlockCache>& cache,
+                  const IOContext& context);
+
+  /**
+   * Inputs given a same `file_id` share their cached blocks. Caller must
+   * make sure the id stands for one immutable file content.
+   */
+  PReadIndexInput(const std::string& resource_desc,
+                  const std::shared_ptr<FileHandle>& handle,
+                  const uint64_t length,
+                  const std::shared_ptr<BlockCache>& cache,
+                  const uint64_t file_id,
+                  const IOContext& context);
+
+  bool IsCached() const noexcept {
+    return use_cache;
+  }
+
+  uint64_t GetFileId() const noexcept {
+    return file_id;
+  }
+
+  // Clone shares the descriptor and starts at the same file pointer
+  std::unique_ptr<PReadIndexInput> Clone();
+
+  std::unique_ptr<IndexInput> Slice(const std::string& slice_desc,
+                                    const uint64_t offset,
+                                    const uint64_t slice_length);
+
+  void Prefetch(const uint64_t offset, const uint64_t prefetch_length);
+
+  uint64_t Length() {
+    return length;
+  }
+
+  void Close();
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_BLOCKCACHE_H_
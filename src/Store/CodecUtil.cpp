@@ -0,0 +1,89 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <Store/CodecUtil.h>
+#include <Util/Exception.h>
+
+using lucene::core::store::ChecksumIndexInput;
+using lucene::core::store::CodecUtil;
+using lucene::core::store::DataInput;
+using lucene::core::store::IndexOutput;
+using lucene::core::util::IOException;
+
+/**
+ *  CodecUtil
+ */
+const int32_t CodecUtil::CODEC_MAGIC;
+const int32_t CodecUtil::FOOTER_MAGIC;
+const uint32_t CodecUtil::FOOTER_LENGTH;
+
+void CodecUtil::WriteHeader(IndexOutput& out,
+                            const std::string& codec,
+                            const int32_t version) {
+  out.WriteInt32(CODEC_MAGIC);
+  out.WriteString(codec);
+  out.WriteInt32(version);
+}
+
+void CodecUtil::CheckHeader(DataInput& in,
+                            const std::string& codec,
+                            const int32_t version) {
+  if (in.ReadInt32() != CODEC_MAGIC) {
+    throw IOException("Codec header mismatch: " + codec);
+  }
+
+  if (in.ReadString() != codec) {
+    throw IOException("Codec mismatch, expected " + codec);
+  }
+
+  const int32_t actual_version = in.ReadInt32();
+  if (actual_version != version) {
+    throw IOException("Unsupported version " +
+                      std::to_string(actual_version) + " of " + codec);
+  }
+}
+
+void CodecUtil::WriteFooter(IndexOutput& out) {
+  out.WriteInt32(FOOTER_MAGIC);
+  out.WriteInt32(0);
+  // Covers everything up to here, including the two ints above
+  out.WriteInt64(static_cast<int64_t>(out.GetChecksum()));
+}
+
+void CodecUtil::CheckFooterHead(DataInput& in) {
+  if (in.ReadInt32() != FOOTER_MAGIC) {
+    throw IOException("Codec footer mismatch");
+  }
+
+  if (in.ReadInt32() != 0) {
+    throw IOException("Unknown checksum algorithm");
+  }
+}
+
+void CodecUtil::CheckFooter(ChecksumIndexInput& in) {
+  CheckFooterHead(in);
+  const int64_t actual = in.GetChecksum();
+  CheckChecksum(actual, in.ReadInt64());
+}
+
+void CodecUtil::CheckChecksum(const int64_t actual, const int64_t expected) {
+  if (actual != expected) {
+    throw IOException("Checksum failed, expected=" +
+                      std::to_string(expected) +
+                      ", actual=" + std::to_string(actual));
+  }
+}
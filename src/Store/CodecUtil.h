@@ -0,0 +1,70 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_CODECUTIL_H_
+#define SRC_STORE_CODECUTIL_H_
+
+#include <Store/DataInput.h>
+#include <Store/DataOutput.h>
+#include <string>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * Header and footer shared by every file format written in Store.
+ *
+ * Header: Magic(Int32), Codec(String), Version(Int32)
+ * Footer: ~Magic(Int32), Algorithm(Int32, 0 = Crc32), Checksum(Int64)
+ *   Checksum covers the whole file up to itself, the footer's two ints
+ *   included.
+ */
+class CodecUtil {
+ public:
+  static const int32_t CODEC_MAGIC = 0x3FD76C17;
+  static const int32_t FOOTER_MAGIC = ~CODEC_MAGIC;
+  static const uint32_t FOOTER_LENGTH = 16;
+
+ private:
+  CodecUtil() = default;
+
+ public:
+  static void WriteHeader(IndexOutput& out,
+                          const std::string& codec,
+                          const int32_t version);
+
+  static void CheckHeader(DataInput& in,
+                          const std::string& codec,
+                          const int32_t version);
+
+  static void WriteFooter(IndexOutput& out);
+
+  // Reads the footer magic and algorithm id, leaving the checksum unread
+  static void CheckFooterHead(DataInput& in);
+
+  // Reads the whole footer and checks it against what `in` has read so far
+  static void CheckFooter(ChecksumIndexInput& in);
+
+  static void CheckChecksum(const int64_t actual, const int64_t expected);
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_CODECUTIL_H_
@@ -0,0 +1,272 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <Index/File.h>
+#include <Store/CodecUtil.h>
+#include <Store/CompoundFile.h>
+#include <Store/Exception.h>
+#include <Util/Exception.h>
+#include <algorithm>
+
+using lucene::core::index::IndexFileNames;
+using lucene::core::store::AlreadyClosedException;
+using lucene::core::store::ChecksumIndexInput;
+using lucene::core::store::CodecUtil;
+using lucene::core::store::CompoundFileDirectory;
+using lucene::core::store::CompoundFileFormat;
+using lucene::core::store::IndexInput;
+using lucene::core::store::IndexOutput;
+using lucene::core::store::Lock;
+using lucene::core::util::IllegalArgumentException;
+using lucene::core::util::IOException;
+using lucene::core::util::NoSuchFileException;
+using lucene::core::util::UnsupportedOperationException;
+
+/**
+ *  CompoundFileFormat
+ */
+const int32_t CompoundFileFormat::VERSION;
+const uint32_t CompoundFileFormat::FOOTER_LENGTH;
+const uint32_t CompoundFileFormat::DATA_ALIGNMENT;
+const std::string CompoundFileFormat::DATA_EXTENSION("cfs");
+const std::string CompoundFileFormat::ENTRIES_EXTENSION("cfe");
+const std::string CompoundFileFormat::DATA_CODEC("CompoundFileData");
+const std::string CompoundFileFormat::ENTRIES_CODEC("CompoundFileEntries");
+
+void CompoundFileFormat::Write(Directory& dir,
+                               const std::string& segment_name,
+                               const std::vector<std::string>& files,
+                               const IOContext& context) {
+  std::vector<std::string> sorted_files(files);
+  std::sort(sorted_files.begin(), sorted_files.end());
+  for (const std::string& file : sorted_files) {
+    if (IndexFileNames::ParseSegmentName(file) != segment_name) {
+      throw IllegalArgumentException("File " + file +
+                                     " does not belong to segment " +
+                                     segment_name);
+    }
+  }
+
+  std::unique_ptr<IndexOutput> data = dir.CreateOutput(
+    IndexFileNames::SegmentFileName(segment_name, "", DATA_EXTENSION),
+    context);
+  std::unique_ptr<IndexOutput> entries = dir.CreateOutput(
+    IndexFileNames::SegmentFileName(segment_name, "", ENTRIES_EXTENSION),
+    context);
+
+  CodecUtil::WriteHeader(*data, DATA_CODEC, VERSION);
+  CodecUtil::WriteHeader(*entries, ENTRIES_CODEC, VERSION);
+  entries->WriteVInt32(static_cast<int32_t>(sorted_files.size()));
+
+  const char padding[DATA_ALIGNMENT] = {0};
+  for (const std::string& file : sorted_files) {
+    // Aligned start lets readers load primitives without crossing words
+    const uint64_t misaligned = (data->GetFilePointer() % DATA_ALIGNMENT);
+    if (misaligned != 0) {
+      data->WriteBytes(padding, 0, DATA_ALIGNMENT - misaligned);
+    }
+
+    const uint64_t offset = data->GetFilePointer();
+    const uint64_t length = dir.FileLength(file);
+    if (length > 0) {
+      // Some directories can not map an empty file
+      std::unique_ptr<IndexInput> in = dir.OpenInput(file, context);
+      data->CopyBytes(*in, length);
+      in->Close();
+    }
+
+    entries->WriteString(IndexFileNames::StripSegmentName(file));
+    entries->WriteInt64(static_cast<int64_t>(offset));
+    entries->WriteInt64(static_cast<int64_t>(length));
+  }
+
+  CodecUtil::WriteFooter(*data);
+  CodecUtil::WriteFooter(*entries);
+  data->Close();
+  entries->Close();
+}
+
+/**
+ *  CompoundFileDirectory
+ */
+CompoundFileDirectory::CompoundFileDirectory(Directory& directory,
+                                             const std::string& segment_name,
+                                             const IOContext& context)
+  : Directory(),
+    directory(directory),
+    segment_name(segment_name),
+    data_file_name(IndexFileNames::SegmentFileName(
+                   segment_name,
+                   "",
+                   CompoundFileFormat::DATA_EXTENSION)),
+    entries(),
+    handle(),
+    is_open(true) {
+  ReadEntries(context);
+
+  handle = directory.OpenInput(data_file_name, context);
+  CodecUtil::CheckHeader(*handle,
+                         CompoundFileFormat::DATA_CODEC,
+                         CompoundFileFormat::VERSION);
+  const uint64_t length = handle->Length();
+  if (length < handle->GetFilePointer() + CompoundFileFormat::FOOTER_LENGTH) {
+    throw IOException("Compound file is truncated: " + data_file_name);
+  }
+
+  // Cheap structural check, CheckIntegrity verifies the whole checksum
+  handle->Seek(length - CompoundFileFormat::FOOTER_LENGTH);
+  CodecUtil::CheckFooterHead(*handle);
+  const uint64_t data_end = length - CompoundFileFormat::FOOTER_LENGTH;
+  for (const auto& pair : entries) {
+    if (pair.second.offset + pair.second.length > data_end) {
+      throw IOException("Entry " + pair.first + " is out of bounds in " +
+                        data_file_name);
+    }
+  }
+}
+
+CompoundFileDirectory::~CompoundFileDirectory() {
+  try {
+    Close();
+  } catch(...) {
+    // Ignore
+  }
+}
+
+void CompoundFileDirectory::ReadEntries(const IOContext& context) {
+  std::unique_ptr<ChecksumIndexInput> in = directory.OpenChecksumInput(
+    IndexFileNames::SegmentFileName(segment_name,
+                                    "",
+                                    CompoundFileFormat::ENTRIES_EXTENSION),
+    context);
+
+  CodecUtil::CheckHeader(*in,
+                         CompoundFileFormat::ENTRIES_CODEC,
+                         CompoundFileFormat::VERSION);
+  const int32_t num_files = in->ReadVInt32();
+  for (int32_t i = 0 ; i < num_files ; ++i) {
+    const std::string id = in->ReadString();
+    FileEntry entry;
+    entry.offset = static_cast<uint64_t>(in->ReadInt64());
+    entry.length = static_cast<uint64_t>(in->ReadInt64());
+    if (!entries.emplace(id, entry).second) {
+      throw IOException("Duplicate compound file entry: " + id);
+    }
+  }
+
+  CodecUtil::CheckFooter(*in);
+  in->Close();
+}
+
+const CompoundFileDirectory::FileEntry&
+CompoundFileDirectory::GetEntry(const std::string& name) {
+  auto it = entries.find(IndexFileNames::StripSegmentName(name));
+  if (it == entries.end()) {
+    throw NoSuchFileException("No sub-file " + name + " in " + data_file_name);
+  }
+
+  return it->second;
+}
+
+void CompoundFileDirectory::EnsureOpen() {
+  if (!is_open) {
+    throw AlreadyClosedException("CompoundFileDirectory is closed: " +
+                                 data_file_name);
+  }
+}
+
+void CompoundFileDirectory::CheckIntegrity() {
+  EnsureOpen();
+  const uint64_t checked_length =
+  directory.FileLength(data_file_name) - sizeof(int64_t);
+  const int64_t actual = directory.ComputeChecksum(data_file_name,
+                                                   checked_length,
+                                                   IOContext::READONCE);
+  std::unique_ptr<IndexInput> in =
+  directory.OpenInput(data_file_name, IOContext::READONCE);
+  in->Seek(checked_length);
+  CodecUtil::CheckChecksum(actual, in->ReadInt64());
+  in->Close();
+}
+
+std::vector<std::string> CompoundFileDirectory::ListAll() {
+  EnsureOpen();
+  std::vector<std::string> names;
+  names.reserve(entries.size());
+  for (const auto& pair : entries) {
+    names.push_back(segment_name + pair.first);
+  }
+
+  return names;
+}
+
+uint64_t CompoundFileDirectory::FileLength(const std::string& name) {
+  EnsureOpen();
+  return GetEntry(name).length;
+}
+
+std::unique_ptr<IndexInput>
+CompoundFileDirectory::OpenInput(const std::string& name,
+                                 const IOContext& context) {
+  EnsureOpen();
+  const FileEntry& entry = GetEntry(name);
+  return handle->Slice(name, entry.offset, entry.length);
+}
+
+void CompoundFileDirectory::Close() {
+  if (is_open) {
+    is_open = false;
+    if (handle) {
+      handle->Close();
+    }
+  }
+}
+
+void CompoundFileDirectory::DeleteFile(const std::string& name) {
+  throw UnsupportedOperationException();
+}
+
+std::unique_ptr<IndexOutput>
+CompoundFileDirectory::CreateOutput(const std::string& name,
+                                    const IOContext& context) {
+  throw UnsupportedOperationException();
+}
+
+std::unique_ptr<IndexOutput>
+CompoundFileDirectory::CreateTempOutput(const std::string& prefix,
+                                        const std::string& suffix,
+                                        const IOContext& context) {
+  throw UnsupportedOperationException();
+}
+
+void CompoundFileDirectory::Sync(const std::vector<std::string>& names) {
+  throw UnsupportedOperationException();
+}
+
+void CompoundFileDirectory::Rename(const std::string& source,
+                                   const std::string& dest) {
+  throw UnsupportedOperationException();
+}
+
+void CompoundFileDirectory::SyncMetaData() {
+  throw UnsupportedOperationException();
+}
+
+std::unique_ptr<Lock>
+CompoundFileDirectory::ObtainLock(const std::string& name) {
+  throw UnsupportedOperationException();
+}
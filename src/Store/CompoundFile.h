@@ -0,0 +1,141 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_COMPOUNDFILE_H_
+#define SRC_STORE_COMPOUNDFILE_H_
+
+#include <Store/CodecUtil.h>
+#include <Store/Directory.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * Compound file packs every file of a segment into one data file
+ * (`<segment>.cfs`) with an entry table next to it (`<segment>.cfe`).
+ * A reader then needs one file descriptor and one mapping per segment,
+ * whatever the number of files the segment has.
+ *
+ * Data file: Header, file data..., Footer
+ *   Each file starts at an 8 bytes aligned offset.
+ * Entry file: Header, NumFiles(VInt32), {FileId(String), Offset(Int64),
+ *             Length(Int64)} * NumFiles, Footer
+ *   FileId is the file name with the segment name stripped.
+ * Header and Footer are the ones of CodecUtil.
+ */
+class CompoundFileFormat {
+ public:
+  static const int32_t VERSION = 0;
+  static const uint32_t FOOTER_LENGTH = CodecUtil::FOOTER_LENGTH;
+  static const uint32_t DATA_ALIGNMENT = 8;
+  static const std::string DATA_EXTENSION;
+  static const std::string ENTRIES_EXTENSION;
+  static const std::string DATA_CODEC;
+  static const std::string ENTRIES_CODEC;
+
+ private:
+  CompoundFileFormat() = default;
+
+ public:
+  /**
+   * Writes given files of `segment_name` in `dir` into a compound file.
+   * Source files are left as they are, caller deletes them once the
+   * compound file is synced.
+   */
+  static void Write(Directory& dir,
+                    const std::string& segment_name,
+                    const std::vector<std::string>& files,
+                    const IOContext& context);
+};
+
+/**
+ * Read only view of a compound file. Every input it opens is a slice of
+ * one shared input over the data file.
+ */
+class CompoundFileDirectory: public Directory {
+ private:
+  class FileEntry {
+   public:
+    uint64_t offset;
+    uint64_t length;
+  };
+
+ private:
+  Directory& directory;
+  const std::string segment_name;
+  const std::string data_file_name;
+  std::map<std::string, FileEntry> entries;
+  std::unique_ptr<IndexInput> handle;
+  bool is_open;
+
+ private:
+  void ReadEntries(const IOContext& context);
+
+  const FileEntry& GetEntry(const std::string& name);
+
+ protected:
+  void EnsureOpen();
+
+ public:
+  CompoundFileDirectory(Directory& directory,
+                        const std::string& segment_name,
+                        const IOContext& context);
+
+  ~CompoundFileDirectory();
+
+  // Reads whole data file and compares it with the checksum in its footer
+  void CheckIntegrity();
+
+  std::vector<std::string> ListAll();
+
+  uint64_t FileLength(const std::string& name);
+
+  std::unique_ptr<IndexInput> OpenInput(const std::string& name,
+                                        const IOContext& context);
+
+  void Close();
+
+  // Compound file is read only, below all throw
+  // UnsupportedOperationException
+  void DeleteFile(const std::string& name);
+
+  std::unique_ptr<IndexOutput>
+  CreateOutput(const std::string& name, const IOContext& context);
+
+  std::unique_ptr<IndexOutput> CreateTempOutput(const std::string& prefix,
+                                                const std::string& suffix,
+                                                const IOContext& context);
+
+  void Sync(const std::vector<std::string>& names);
+
+  void Rename(const std::string& source, const std::string& dest);
+
+  void SyncMetaData();
+
+  std::unique_ptr<Lock> ObtainLock(const std::string& name);
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_COMPOUNDFILE_H_
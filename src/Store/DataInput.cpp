@@ -19,8 +19,10 @@
 using lucene::core::store::DataInput;
 using lucene::core::store::IndexInput;
 using lucene::core::store::BufferedIndexInput;
+using lucene::core::store::BufferedChecksumIndexInput;
 
 const uint32_t DataInput::SKIP_BUFFER_SIZE = 1024;
+const uint32_t BufferedChecksumIndexInput::CHUNK_SIZE;
 
 std::unique_ptr<BufferedIndexInput>
 BufferedIndexInput::Wrap(const std::string& slice_desc,
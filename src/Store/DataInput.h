@@ -19,17 +19,19 @@
 #define SRC_STORE_DATAINPUT_H_
 
 #include <Util/Bits.h>
+#include <Util/Bytes.h>
 #include <Util/Exception.h>
 #include <Util/Numeric.h>
 #include <Store/Context.h>
 #include <Store/Exception.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <memory>
 #include <set>
 #include <string>
-#include <thread>
 #include <utility>
 
 namespace lucene {
@@ -47,6 +49,31 @@ class RandomAccessInput {
   virtual int32_t ReadInt32(const uint64_t pos) = 0;
 
   virtual int64_t ReadInt64(const uint64_t pos) = 0;
+
+  // `n` values in a row starting at `pos`
+  virtual void ReadInt16s(const uint64_t pos,
+                          int16_t dst[],
+                          const uint32_t n) {
+    for (uint32_t i = 0 ; i < n ; ++i) {
+      dst[i] = ReadInt16(pos + i * sizeof(int16_t));
+    }
+  }
+
+  virtual void ReadInt32s(const uint64_t pos,
+                          int32_t dst[],
+                          const uint32_t n) {
+    for (uint32_t i = 0 ; i < n ; ++i) {
+      dst[i] = ReadInt32(pos + i * sizeof(int32_t));
+    }
+  }
+
+  virtual void ReadInt64s(const uint64_t pos,
+                          int64_t dst[],
+                          const uint32_t n) {
+    for (uint32_t i = 0 ; i < n ; ++i) {
+      dst[i] = ReadInt64(pos + i * sizeof(int64_t));
+    }
+  }
 };
 
 class DataInput {
@@ -63,6 +90,19 @@ class DataInput {
     }
   }
 
+  // ReadBytes takes 32 bits offset and length, `n * width` may fit neither,
+  // so `dst` itself is advanced
+  void ReadFixedWidth(char dst[], const uint32_t n, const uint32_t width) {
+    const uint32_t max_values = (1U << 30) / width;
+    uint32_t remaining = n;
+    while (remaining > 0) {
+      const uint32_t num_values = std::min(max_values, remaining);
+      ReadBytes(dst, 0, num_values * width);
+      dst += static_cast<uint64_t>(num_values) * width;
+      remaining -= num_values;
+    }
+  }
+
   int64_t ReadVInt64(const bool allow_negative) {
     char b = ReadByte();
     if (b >= 0) return b;
@@ -123,33 +163,15 @@ class DataInput {
   }
 
   virtual int16_t ReadInt16() {
-    lucene::core::util::numeric::Int16AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[1] = ReadByte();
-    iab.bytes[0] = ReadByte();
-#else
-    iab.bytes[0] = ReadByte();
-    iab.bytes[1] = ReadByte();
-#endif
-
-    return iab.int16;
+    char buf[sizeof(int16_t)];
+    ReadBytes(buf, 0, sizeof(buf));
+    return lucene::core::util::EndianUtil::ReadInt16(buf);
   }
 
   virtual int32_t ReadInt32() {
-    lucene::core::util::numeric::Int32AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[3] = ReadByte();
-    iab.bytes[2] = ReadByte();
-    iab.bytes[1] = ReadByte();
-    iab.bytes[0] = ReadByte();
-#else
-    iab.bytes[0] = ReadByte();
-    iab.bytes[1] = ReadByte();
-    iab.bytes[2] = ReadByte();
-    iab.bytes[3] = ReadByte();
-#endif
-
-    return iab.int32;
+    char buf[sizeof(int32_t)];
+    ReadBytes(buf, 0, sizeof(buf));
+    return lucene::core::util::EndianUtil::ReadInt32(buf);
   }
 
   virtual int32_t ReadVInt32() {
@@ -176,9 +198,43 @@ class DataInput {
     return lucene::core::util::BitUtil::ZigZagDecode(ReadVInt32());
   }
 
+  /**
+   * Reads `n` VInt32 values in a row. Inputs having bytes in memory
+   * override this to decode a whole block per call.
+   */
+  virtual void ReadVInt32s(int32_t dst[], const uint32_t n) {
+    for (uint32_t i = 0 ; i < n ; ++i) {
+      dst[i] = ReadVInt32();
+    }
+  }
+
   virtual int64_t ReadInt64() {
-    return ((static_cast<int64_t>(ReadInt32()) << 32) |
-            (ReadInt32() & 0xFFFFFFFFL));
+    char buf[sizeof(int64_t)];
+    ReadBytes(buf, 0, sizeof(buf));
+    return lucene::core::util::EndianUtil::ReadInt64(buf);
+  }
+
+  /**
+   * Reads `n` fixed width values in a row. Default reads raw bytes straight
+   * into `dst` and swaps them in place, inputs having bytes in memory
+   * override this to decode from there.
+   */
+  virtual void ReadInt16s(int16_t dst[], const uint32_t n) {
+    ReadFixedWidth(reinterpret_cast<char*>(dst), n, sizeof(int16_t));
+    lucene::core::util::EndianUtil::ReadInt16s(
+      reinterpret_cast<const char*>(dst), dst, n);
+  }
+
+  virtual void ReadInt32s(int32_t dst[], const uint32_t n) {
+    ReadFixedWidth(reinterpret_cast<char*>(dst), n, sizeof(int32_t));
+    lucene::core::util::EndianUtil::ReadInt32s(
+      reinterpret_cast<const char*>(dst), dst, n);
+  }
+
+  virtual void ReadInt64s(int64_t dst[], const uint32_t n) {
+    ReadFixedWidth(reinterpret_cast<char*>(dst), n, sizeof(int64_t));
+    lucene::core::util::EndianUtil::ReadInt64s(
+      reinterpret_cast<const char*>(dst), dst, n);
   }
 
   virtual int64_t ReadVInt64() {
@@ -290,6 +346,25 @@ class IndexInput: public DataInput {
 
   virtual uint64_t Length() = 0;
 
+  /**
+   * Hints that [offset, offset + length) of this input will be read soon,
+   * so the storage layer can start fetching it in the background.
+   * Never blocks on the read itself and never moves the file pointer.
+   * Inputs that can not make use of it ignore the hint.
+   */
+  virtual void Prefetch(const uint64_t offset, const uint64_t length) { }
+
+  /**
+   * Reads next `len` bytes into a BytesRef. Memory backed inputs return a
+   * view into their own memory instead of a copy, which stays valid as long
+   * as this input, or any of its clones or slices, is open.
+   */
+  virtual lucene::core::util::BytesRef ReadBytesRef(const uint32_t len) {
+    lucene::core::util::BytesRef ref(len);
+    ReadBytes(ref.bytes.get(), 0, len);
+    return ref;
+  }
+
   virtual std::unique_ptr<IndexInput>
   Slice(const std::string& slice_description,
         const uint64_t offset,
@@ -341,32 +416,142 @@ class ChecksumIndexInput: public IndexInput {
   }
 };
 
+/**
+ * Pulls `main` a chunk at a time and runs CRC over each chunk in place,
+ * in one call, once it is consumed or the checksum is asked for. There is
+ * no per byte checksum work. Memory backed inputs (e.g. mmap) hand out
+ * views of their own bytes from ReadBytesRef, so those are not even
+ * copied.
+ * Since `main` is read ahead, its own file pointer runs ahead of this
+ * input.
+ */
 class BufferedChecksumIndexInput: public ChecksumIndexInput {
+ public:
+  static const uint32_t CHUNK_SIZE = 8192;
+
  private:
   std::unique_ptr<IndexInput> main;
-  std::unique_ptr<lucene::core::util::Checksum> digest;
+  lucene::core::util::BytesRef chunk_ref;
+  const char* chunk;
+  uint32_t chunk_pos;
+  uint32_t chunk_limit;
+  // Bytes of the chunk before this are already in `crc`
+  uint32_t crc_upto;
+  uint32_t crc;
+
+ private:
+  void UpdateCrc() {
+    crc = lucene::core::util::Crc32Util::Update(crc,
+                                                chunk + crc_upto,
+                                                chunk_pos - crc_upto);
+    crc_upto = chunk_pos;
+  }
+
+  void Refill() {
+    UpdateCrc();
+    const uint64_t remaining = main->Length() - main->GetFilePointer();
+    if (remaining == 0) {
+      throw lucene::core::util::EOFException("Read past EOF: " +
+                                             resource_desc);
+    }
+
+    const uint32_t len =
+    static_cast<uint32_t>(std::min<uint64_t>(remaining, CHUNK_SIZE));
+    chunk_ref = main->ReadBytesRef(len);
+    chunk = chunk_ref.bytes.get() + chunk_ref.offset;
+    chunk_pos = crc_upto = 0;
+    chunk_limit = len;
+  }
+
+  const char* Take(const uint32_t len) {
+    if (chunk_limit - chunk_pos < len) {
+      return nullptr;
+    }
+
+    const char* bytes = chunk + chunk_pos;
+    chunk_pos += len;
+    return bytes;
+  }
 
  public:
   explicit BufferedChecksumIndexInput(std::unique_ptr<IndexInput>&& main)
     : ChecksumIndexInput(std::string("BufferedChecksumIndexInput")),
       main(std::forward<std::unique_ptr<IndexInput>>(main)),
-      digest(std::make_unique<BufferedChecksum>(
-               std::make_unique<lucene::core::util::Crc32>())) {
+      chunk_ref(),
+      chunk(nullptr),
+      chunk_pos(0),
+      chunk_limit(0),
+      crc_upto(0),
+      crc(0) {
   }
 
   char ReadByte() {
-    const char b = main->ReadByte();
-    digest->Update(b);
-    return b;
+    if (chunk_pos == chunk_limit) {
+      Refill();
+    }
+
+    return chunk[chunk_pos++];
   }
 
   void ReadBytes(char bytes[], const uint32_t offset, const uint32_t len) {
-    main->ReadBytes(bytes, offset, len);
-    digest->Update(bytes, offset, len);
+    const uint32_t available = chunk_limit - chunk_pos;
+    if (len <= available) {
+      std::memcpy(bytes + offset, chunk + chunk_pos, len);
+      chunk_pos += len;
+      return;
+    }
+
+    if (available > 0) {
+      std::memcpy(bytes + offset, chunk + chunk_pos, available);
+      chunk_pos = chunk_limit;
+    }
+
+    const uint32_t rest = len - available;
+    if (rest >= CHUNK_SIZE) {
+      // Large read goes straight into the caller's buffer
+      UpdateCrc();
+      main->ReadBytes(bytes, offset + available, rest);
+      crc = lucene::core::util::Crc32Util::Update(crc,
+                                                  bytes + offset + available,
+                                                  rest);
+    } else {
+      Refill();
+      if (chunk_limit < rest) {
+        throw lucene::core::util::EOFException("Read past EOF: " +
+                                               resource_desc);
+      }
+      std::memcpy(bytes + offset + available, chunk, rest);
+      chunk_pos = rest;
+    }
+  }
+
+  int16_t ReadInt16() {
+    if (const char* b = Take(sizeof(int16_t))) {
+      return lucene::core::util::EndianUtil::ReadInt16(b);
+    }
+
+    return ChecksumIndexInput::ReadInt16();
+  }
+
+  int32_t ReadInt32() {
+    if (const char* b = Take(sizeof(int32_t))) {
+      return lucene::core::util::EndianUtil::ReadInt32(b);
+    }
+
+    return ChecksumIndexInput::ReadInt32();
+  }
+
+  int64_t ReadInt64() {
+    if (const char* b = Take(sizeof(int64_t))) {
+      return lucene::core::util::EndianUtil::ReadInt64(b);
+    }
+
+    return ChecksumIndexInput::ReadInt64();
   }
 
   int64_t GetChecksum() {
-    return digest->GetValue();
+    UpdateCrc();
+    return static_cast<int64_t>(crc) & 0xFFFFFFFFL;
   }
 
   void Close() {
@@ -374,7 +559,7 @@ class BufferedChecksumIndexInput: public ChecksumIndexInput {
   }
 
   uint64_t GetFilePointer() {
-    return main->GetFilePointer();
+    return main->GetFilePointer() - (chunk_limit - chunk_pos);
   }
 
   uint64_t Length() {
@@ -436,6 +621,24 @@ class BufferedIndexInput: public IndexInput, RandomAccessInput {
     buffer_position = 0;
   }
 
+  // `len` bytes at absolute `pos`, refilling the buffer from there if needed
+  const char* BufferAt(const uint64_t pos, const uint32_t len) {
+    const int64_t index = pos - buffer_start;
+    if (index < 0 || index + len > buffer_length) {
+      buffer_start = pos;
+      buffer_position = 0;
+      buffer_length = 0;  // trigger refill() on read()
+      SeekInternal(pos);
+      Refill();
+      if (buffer_length < len) {
+        throw lucene::core::util::EOFException();
+      }
+      return buffer.get();
+    }
+
+    return buffer.get() + index;
+  }
+
  public:
   static uint32_t BufferSize(const IOContext& context) {
     switch (context.context) {
@@ -509,10 +712,10 @@ class BufferedIndexInput: public IndexInput, RandomAccessInput {
       if (use_buffer && len_cp < buffer_size) {
         Refill();
         if (buffer_length < len_cp) {
-          std::memcpy(bytes + offset, buffer.get(), buffer_length);
+          std::memcpy(bytes + offset_cp, buffer.get(), buffer_length);
           throw lucene::core::util::EOFException();
         } else {
-          std::memcpy(bytes + offset, buffer.get(), len_cp);
+          std::memcpy(bytes + offset_cp, buffer.get(), len_cp);
           buffer_position = len_cp;
         }
       } else {
@@ -521,7 +724,7 @@ class BufferedIndexInput: public IndexInput, RandomAccessInput {
           throw lucene::core::util::EOFException();
         }
 
-        ReadInternal(bytes, offset, len_cp);
+        ReadInternal(bytes, offset_cp, len_cp);
         buffer_start = after;
         buffer_position = 0;
         buffer_length = 0;
@@ -530,70 +733,36 @@ class BufferedIndexInput: public IndexInput, RandomAccessInput {
   }
 
   int16_t ReadInt16() {
-    if (2 <= (buffer_length - buffer_position)) {
-      lucene::core::util::numeric::Int16AndBytes iab;
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-      iab.bytes[1] = buffer[buffer_position++];
-      iab.bytes[0] = buffer[buffer_position++];
-#else
-      iab.bytes[0] = buffer[buffer_position++];
-      iab.bytes[1] = buffer[buffer_position++];
-#endif
-
-      return iab.int16;
+    if (sizeof(int16_t) <= (buffer_length - buffer_position)) {
+      const int16_t v =
+      lucene::core::util::EndianUtil::ReadInt16(buffer.get() +
+                                                  buffer_position);
+      buffer_position += sizeof(int16_t);
+      return v;
     } else {
       return IndexInput::ReadInt16();
     }
   }
 
   int32_t ReadInt32() {
-    if (4 <= (buffer_length - buffer_position)) {
-      lucene::core::util::numeric::Int32AndBytes iab;
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-      iab.bytes[3] = buffer[buffer_position++];
-      iab.bytes[2] = buffer[buffer_position++];
-      iab.bytes[1] = buffer[buffer_position++];
-      iab.bytes[0] = buffer[buffer_position++];
-#else
-      iab.bytes[0] = buffer[buffer_position++];
-      iab.bytes[1] = buffer[buffer_position++];
-      iab.bytes[2] = buffer[buffer_position++];
-      iab.bytes[3] = buffer[buffer_position++];
-#endif
-
-      return iab.int32;
+    if (sizeof(int32_t) <= (buffer_length - buffer_position)) {
+      const int32_t v =
+      lucene::core::util::EndianUtil::ReadInt32(buffer.get() +
+                                                  buffer_position);
+      buffer_position += sizeof(int32_t);
+      return v;
     } else {
       return IndexInput::ReadInt32();
     }
   }
 
   int64_t ReadInt64() {
-    if (8 <= (buffer_length - buffer_position)) {
-      lucene::core::util::numeric::Int64AndBytes iab;
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-      iab.bytes[7] = buffer[buffer_position++];
-      iab.bytes[6] = buffer[buffer_position++];
-      iab.bytes[5] = buffer[buffer_position++];
-      iab.bytes[4] = buffer[buffer_position++];
-      iab.bytes[3] = buffer[buffer_position++];
-      iab.bytes[2] = buffer[buffer_position++];
-      iab.bytes[1] = buffer[buffer_position++];
-      iab.bytes[0] = buffer[buffer_position++];
-#else
-      iab.bytes[0] = buffer[buffer_position++];
-      iab.bytes[1] = buffer[buffer_position++];
-      iab.bytes[2] = buffer[buffer_position++];
-      iab.bytes[3] = buffer[buffer_position++];
-      iab.bytes[4] = buffer[buffer_position++];
-      iab.bytes[5] = buffer[buffer_position++];
-      iab.bytes[6] = buffer[buffer_position++];
-      iab.bytes[7] = buffer[buffer_position++];
-#endif
-
-      return iab.int64;
+    if (sizeof(int64_t) <= (buffer_length - buffer_position)) {
+      const int64_t v =
+      lucene::core::util::EndianUtil::ReadInt64(buffer.get() +
+                                                  buffer_position);
+      buffer_position += sizeof(int64_t);
+      return v;
     } else {
       return IndexInput::ReadInt64();
     }
@@ -623,6 +792,26 @@ class BufferedIndexInput: public IndexInput, RandomAccessInput {
     }
   }
 
+  void ReadVInt32s(int32_t dst[], const uint32_t n) {
+    uint32_t done = 0;
+    while (done < n) {
+      uint32_t decoded = 0;
+      buffer_position +=
+      lucene::core::util::VIntUtil::DecodeVInt32s(
+        buffer.get() + buffer_position,
+        buffer_length - buffer_position,
+        dst + done,
+        n - done,
+        &decoded);
+      done += decoded;
+
+      if (done < n) {
+        // Next value is cut by the buffer end, this refills the buffer
+        dst[done++] = ReadVInt32();
+      }
+    }
+  }
+
   int64_t ReadVInt64() {
     if (9 <= buffer_length-buffer_position) {
       char b = buffer[buffer_position++];
@@ -675,96 +864,27 @@ class BufferedIndexInput: public IndexInput, RandomAccessInput {
   }
 
   int16_t ReadInt16(const uint64_t pos) {
-    lucene::core::util::numeric::Int16AndBytes iab;
-    const int64_t tmp_index = pos - buffer_start;
-    int32_t idx = static_cast<int32_t>(tmp_index);
-
-    if (tmp_index < 0 || tmp_index >= buffer_length - 1) {
-      buffer_start = pos;
-      buffer_position = 0;
-      buffer_length = 0;  // trigger refill() on read()
-      SeekInternal(pos);
-      Refill();
-      idx = 0;
-    }
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[1] = buffer[idx++];
-    iab.bytes[0] = buffer[idx++];
-#else
-    iab.bytes[0] = buffer[idx++];
-    iab.bytes[1] = buffer[idx++];
-#endif
-
-    return iab.int16;
+    return lucene::core::util::EndianUtil::ReadInt16(
+           BufferAt(pos, sizeof(int16_t)));
   }
 
   int32_t ReadInt32(const uint64_t pos) {
-    lucene::core::util::numeric::Int32AndBytes iab;
-    int64_t tmp_index = pos - buffer_start;
-    int32_t idx = static_cast<int32_t>(tmp_index);
-
-    if (tmp_index < 0 || tmp_index >= buffer_length - 3) {
-      buffer_start = pos;
-      buffer_position = 0;
-      buffer_length = 0;  // trigger refill() on read()
-      SeekInternal(pos);
-      Refill();
-      idx = 0;
-    }
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN_
-    iab.bytes[3] = buffer[idx++];
-    iab.bytes[2] = buffer[idx++];
-    iab.bytes[1] = buffer[idx++];
-    iab.bytes[0] = buffer[idx++];
-#else
-    iab.bytes[0] = buffer[idx++];
-    iab.bytes[1] = buffer[idx++];
-    iab.bytes[2] = buffer[idx++];
-    iab.bytes[3] = buffer[idx++];
-#endif
-
-    return iab.int32;
+    return lucene::core::util::EndianUtil::ReadInt32(
+           BufferAt(pos, sizeof(int32_t)));
   }
 
   int64_t ReadInt64(const uint64_t pos) {
-    lucene::core::util::numeric::Int64AndBytes iab;
-    int64_t tmp_index = pos - buffer_start;
-    int32_t idx = static_cast<int32_t>(tmp_index);
-
-    if (tmp_index < 0 || tmp_index >= buffer_length - 7) {
-      buffer_start = pos;
-      buffer_position = 0;
-      buffer_length = 0;  // trigger refill() on read()
-      SeekInternal(pos);
-      Refill();
-      idx = 0;
-    }
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN_
-    iab.bytes[7] = buffer[idx++];
-    iab.bytes[6] = buffer[idx++];
-    iab.bytes[5] = buffer[idx++];
-    iab.bytes[4] = buffer[idx++];
-    iab.bytes[3] = buffer[idx++];
-    iab.bytes[2] = buffer[idx++];
-    iab.bytes[1] = buffer[idx++];
-    iab.bytes[0] = buffer[idx++];
-#else
-    iab.bytes[0] = buffer[idx++];
-    iab.bytes[1] = buffer[idx++];
-    iab.bytes[2] = buffer[idx++];
-    iab.bytes[3] = buffer[idx++];
-    iab.bytes[4] = buffer[idx++];
-    iab.bytes[5] = buffer[idx++];
-    iab.bytes[6] = buffer[idx++];
-    iab.bytes[7] = buffer[idx++];
-#endif
-
-    return iab.int64;
+    return lucene::core::util::EndianUtil::ReadInt64(
+           BufferAt(pos, sizeof(int64_t)));
   }
 
+  using IndexInput::ReadInt16s;
+  using IndexInput::ReadInt32s;
+  using IndexInput::ReadInt64s;
+  using RandomAccessInput::ReadInt16s;
+  using RandomAccessInput::ReadInt32s;
+  using RandomAccessInput::ReadInt64s;
+
   uint64_t GetFilePointer() {
     return buffer_start + buffer_position;
   }
@@ -855,6 +975,13 @@ class BufferedIndexInput::SlicedIndexInput: public BufferedIndexInput {
     base->ReadBytes(bytes, offset, len, false);
   }
 
+  void Prefetch(const uint64_t offset, const uint64_t prefetch_length) {
+    if (offset < length) {
+      base->Prefetch(file_offset + offset,
+                     std::min(prefetch_length, length - offset));
+    }
+  }
+
   void Close() {
     base->Close();
   }
@@ -918,58 +1045,60 @@ class ByteArrayReferenceDataInput : public DataInput {
   }
 
   int16_t ReadInt16() {
-    lucene::core::util::numeric::Int16AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[0] = bytes[pos++];
-#else
-    iab.bytes[0] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-#endif
-
-    return iab.int16;
+    const int16_t v = lucene::core::util::EndianUtil::ReadInt16(bytes + pos);
+    pos += sizeof(int16_t);
+    return v;
   }
 
   int32_t ReadInt32() {
-    lucene::core::util::numeric::Int32AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[3] = bytes[pos++];
-    iab.bytes[2] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[0] = bytes[pos++];
-#else
-    iab.bytes[0] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[2] = bytes[pos++];
-    iab.bytes[3] = bytes[pos++];
-#endif
-
-    return iab.int32;
+    const int32_t v = lucene::core::util::EndianUtil::ReadInt32(bytes + pos);
+    pos += sizeof(int32_t);
+    return v;
   }
 
   int64_t ReadInt64() {
-    lucene::core::util::numeric::Int64AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[7] = bytes[pos++];
-    iab.bytes[6] = bytes[pos++];
-    iab.bytes[5] = bytes[pos++];
-    iab.bytes[4] = bytes[pos++];
-    iab.bytes[3] = bytes[pos++];
-    iab.bytes[2] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[0] = bytes[pos++];
-#else
-    iab.bytes[0] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[2] = bytes[pos++];
-    iab.bytes[3] = bytes[pos++];
-    iab.bytes[4] = bytes[pos++];
-    iab.bytes[5] = bytes[pos++];
-    iab.bytes[6] = bytes[pos++];
-    iab.bytes[7] = bytes[pos++];
-#endif
-
-    return iab.int64;
+    const int64_t v = lucene::core::util::EndianUtil::ReadInt64(bytes + pos);
+    pos += sizeof(int64_t);
+    return v;
+  }
+
+  void ReadInt16s(int16_t dst[], const uint32_t n) {
+    if (static_cast<uint64_t>(n) * sizeof(int16_t) > limit - pos) {
+      throw lucene::core::util::EOFException();
+    }
+
+    lucene::core::util::EndianUtil::ReadInt16s(bytes + pos, dst, n);
+    pos += n * sizeof(int16_t);
+  }
+
+  void ReadInt32s(int32_t dst[], const uint32_t n) {
+    if (static_cast<uint64_t>(n) * sizeof(int32_t) > limit - pos) {
+      throw lucene::core::util::EOFException();
+    }
+
+    lucene::core::util::EndianUtil::ReadInt32s(bytes + pos, dst, n);
+    pos += n * sizeof(int32_t);
+  }
+
+  void ReadInt64s(int64_t dst[], const uint32_t n) {
+    if (static_cast<uint64_t>(n) * sizeof(int64_t) > limit - pos) {
+      throw lucene::core::util::EOFException();
+    }
+
+    lucene::core::util::EndianUtil::ReadInt64s(bytes + pos, dst, n);
+    pos += n * sizeof(int64_t);
+  }
+
+  void ReadVInt32s(int32_t dst[], const uint32_t n) {
+    uint32_t decoded = 0;
+    pos += lucene::core::util::VIntUtil::DecodeVInt32s(bytes + pos,
+                                                       limit - pos,
+                                                       dst,
+                                                       n,
+                                                       &decoded);
+    if (decoded < n) {
+      throw lucene::core::util::EOFException();
+    }
   }
 
   int32_t ReadVInt32() {
@@ -1069,6 +1198,17 @@ class BytesArrayReferenceIndexInput : public IndexInput {
     limit = offset + len;
   }
 
+  lucene::core::util::BytesRef ReadBytesRef(const uint32_t len) {
+    if (pos + len > limit) {
+      throw lucene::core::util::EOFException();
+    }
+
+    lucene::core::util::BytesRef ref =
+    lucene::core::util::BytesRef::View(bytes + pos, 0, len);
+    pos += len;
+    return ref;
+  }
+
   uint64_t Length() {
     return limit;
   }
@@ -1082,58 +1222,60 @@ class BytesArrayReferenceIndexInput : public IndexInput {
   }
 
   int16_t ReadInt16() {
-    lucene::core::util::numeric::Int16AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[0] = bytes[pos++];
-#else
-    iab.bytes[0] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-#endif
-
-    return iab.int16;
+    const int16_t v = lucene::core::util::EndianUtil::ReadInt16(bytes + pos);
+    pos += sizeof(int16_t);
+    return v;
   }
 
   int32_t ReadInt32() {
-    lucene::core::util::numeric::Int32AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[3] = bytes[pos++];
-    iab.bytes[2] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[0] = bytes[pos++];
-#else
-    iab.bytes[0] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[2] = bytes[pos++];
-    iab.bytes[3] = bytes[pos++];
-#endif
-
-    return iab.int32;
+    const int32_t v = lucene::core::util::EndianUtil::ReadInt32(bytes + pos);
+    pos += sizeof(int32_t);
+    return v;
   }
 
   int64_t ReadInt64() {
-    lucene::core::util::numeric::Int64AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[7] = bytes[pos++];
-    iab.bytes[6] = bytes[pos++];
-    iab.bytes[5] = bytes[pos++];
-    iab.bytes[4] = bytes[pos++];
-    iab.bytes[3] = bytes[pos++];
-    iab.bytes[2] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[0] = bytes[pos++];
-#else
-    iab.bytes[0] = bytes[pos++];
-    iab.bytes[1] = bytes[pos++];
-    iab.bytes[2] = bytes[pos++];
-    iab.bytes[3] = bytes[pos++];
-    iab.bytes[4] = bytes[pos++];
-    iab.bytes[5] = bytes[pos++];
-    iab.bytes[6] = bytes[pos++];
-    iab.bytes[7] = bytes[pos++];
-#endif
-
-    return iab.int64;
+    const int64_t v = lucene::core::util::EndianUtil::ReadInt64(bytes + pos);
+    pos += sizeof(int64_t);
+    return v;
+  }
+
+  void ReadInt16s(int16_t dst[], const uint32_t n) {
+    if (static_cast<uint64_t>(n) * sizeof(int16_t) > limit - pos) {
+      throw lucene::core::util::EOFException();
+    }
+
+    lucene::core::util::EndianUtil::ReadInt16s(bytes + pos, dst, n);
+    pos += n * sizeof(int16_t);
+  }
+
+  void ReadInt32s(int32_t dst[], const uint32_t n) {
+    if (static_cast<uint64_t>(n) * sizeof(int32_t) > limit - pos) {
+      throw lucene::core::util::EOFException();
+    }
+
+    lucene::core::util::EndianUtil::ReadInt32s(bytes + pos, dst, n);
+    pos += n * sizeof(int32_t);
+  }
+
+  void ReadInt64s(int64_t dst[], const uint32_t n) {
+    if (static_cast<uint64_t>(n) * sizeof(int64_t) > limit - pos) {
+      throw lucene::core::util::EOFException();
+    }
+
+    lucene::core::util::EndianUtil::ReadInt64s(bytes + pos, dst, n);
+    pos += n * sizeof(int64_t);
+  }
+
+  void ReadVInt32s(int32_t dst[], const uint32_t n) {
+    uint32_t decoded = 0;
+    pos += lucene::core::util::VIntUtil::DecodeVInt32s(bytes + pos,
+                                                       limit - pos,
+                                                       dst,
+                                                       n,
+                                                       &decoded);
+    if (decoded < n) {
+      throw lucene::core::util::EOFException();
+    }
   }
 
   int32_t ReadVInt32() {
@@ -1210,32 +1352,94 @@ class BytesArrayReferenceIndexInput : public IndexInput {
 };
 
 
+/**
+ * Owns a memory mapping. Every ByteBufferIndexInput, clones and slices
+ * included, holds a reference to it, so the region is only unmapped after
+ * the last of them has gone. A reader can never touch unmapped memory,
+ * while reads themselves don't pay for any atomic operation.
+ */
+class MappedRegion {
+ private:
+  char* base;
+  uint64_t length;
+  std::atomic_bool invalidated;
+
+ public:
+  MappedRegion(char* base, const uint64_t length)
+    : base(base),
+      length(length),
+      invalidated(false) {
+  }
+
+  MappedRegion(const MappedRegion& other) = delete;
+
+  MappedRegion& operator=(const MappedRegion& other) = delete;
+
+  ~MappedRegion() {
+    munmap(static_cast<void*>(base), length);
+  }
+
+  const char* GetBase() const noexcept {
+    return base;
+  }
+
+  uint64_t Length() const noexcept {
+    return length;
+  }
+
+  // Called when the original input is closed
+  void Invalidate() noexcept {
+    invalidated.store(true, std::memory_order_release);
+  }
+
+  bool IsInvalidated() const noexcept {
+    return invalidated.load(std::memory_order_acquire);
+  }
+};
+
 class ByteBufferIndexInput: public IndexInput, public RandomAccessInput {
  protected:
   const uint64_t length;
   uint64_t idx;
   const char* base;
-  bool* isClosed;
-  bool isClone;
+  std::shared_ptr<MappedRegion> region;
+  bool is_clone;
 
  private:
   void EnsureValid() const {
-    if (*isClosed) {
-      throw AlreadyClosedException();
+    if (!region || region->IsInvalidated()) {
+      throw AlreadyClosedException("Already closed: " + resource_desc);
+    }
+  }
+
+  void CheckRange(const uint64_t pos, const uint64_t len) const {
+    if (pos + len > length) {
+      throw lucene::core::util::EOFException("Read past EOF: " +
+                                             resource_desc);
     }
   }
 
  public:
   ByteBufferIndexInput(const std::string& resource_desc,
+                       const std::shared_ptr<MappedRegion>& region)
+    : ByteBufferIndexInput(resource_desc,
+                           region,
+                           region->GetBase(),
+                           region->Length(),
+                           false) {
+  }
+
+  ByteBufferIndexInput(const std::string& resource_desc,
+                       const std::shared_ptr<MappedRegion>& region,
                        const char* base,
                        const uint64_t length,
-                       const bool isClone = false)
+                       const bool is_clone)
     : IndexInput(resource_desc),
       length(length),
       idx(0),
       base(base),
-      isClosed(!isClone ? new bool(false) : nullptr),
-      isClone(isClone) {
+      region(region),
+      is_clone(is_clone) {
   }
 
   ByteBufferIndexInput(const ByteBufferIndexInput& other)
@@ -1243,8 +1447,9 @@ class ByteBufferIndexInput: public IndexInput, public RandomAccessInput {
       length(other.length),
       idx(0),
       base(other.base),
-      isClosed(other.isClosed),
-      isClone(true) {
+      region(other.region),
+      is_clone(true) {
+    other.EnsureValid();
   }
 
   ByteBufferIndexInput(ByteBufferIndexInput&& other)
@@ -1252,10 +1457,8 @@ class ByteBufferIndexInput: public IndexInput, public RandomAccessInput {
       length(other.length),
       idx(other.idx),
       base(other.base),
-      isClosed(other.isClosed),
-      isClone(other.isClone) {
-    // Prevent double memory deallocation
-    other.isClone = true;
+      region(std::move(other.region)),
+      is_clone(other.is_clone) {
   }
 
   ~ByteBufferIndexInput() {
@@ -1264,10 +1467,22 @@ class ByteBufferIndexInput: public IndexInput, public RandomAccessInput {
     } catch(...) {
       // Ignore
     }
+  }
 
-    if (!isClone) {
-      delete isClosed;
-    }
+  /**
+   * Clone shares the mapping and starts at the same file pointer.
+   * It can be handed to another thread and stays readable even after the
+   * original is closed.
+   */
+  std::unique_ptr<ByteBufferIndexInput> Clone() const {
+    std::unique_ptr<ByteBufferIndexInput> clone =
+    std::make_unique<ByteBufferIndexInput>(*this);
+    clone->idx = idx;
+    return clone;
+  }
+
+  bool IsValid() const noexcept {
+    return (region && !region->IsInvalidated());
   }
 
   char ReadByte() {
@@ -1279,6 +1494,90 @@ class ByteBufferIndexInput: public IndexInput, public RandomAccessInput {
     idx += len;
   }
 
+  int16_t ReadInt16() {
+    const int16_t v = lucene::core::util::EndianUtil::ReadInt16(base + idx);
+    idx += sizeof(int16_t);
+    return v;
+  }
+
+  int32_t ReadInt32() {
+    const int32_t v = lucene::core::util::EndianUtil::ReadInt32(base + idx);
+    idx += sizeof(int32_t);
+    return v;
+  }
+
+  int64_t ReadInt64() {
+    const int64_t v = lucene::core::util::EndianUtil::ReadInt64(base + idx);
+    idx += sizeof(int64_t);
+    return v;
+  }
+
+  void ReadInt16s(int16_t dst[], const uint32_t n) {
+    const uint64_t num_bytes = static_cast<uint64_t>(n) * sizeof(int16_t);
+    CheckRange(idx, num_bytes);
+    lucene::core::util::EndianUtil::ReadInt16s(base + idx, dst, n);
+    idx += num_bytes;
+  }
+
+  void ReadInt32s(int32_t dst[], const uint32_t n) {
+    const uint64_t num_bytes = static_cast<uint64_t>(n) * sizeof(int32_t);
+    CheckRange(idx, num_bytes);
+    lucene::core::util::EndianUtil::ReadInt32s(base + idx, dst, n);
+    idx += num_bytes;
+  }
+
+  void ReadInt64s(int64_t dst[], const uint32_t n) {
+    const uint64_t num_bytes = static_cast<uint64_t>(n) * sizeof(int64_t);
+    CheckRange(idx, num_bytes);
+    lucene::core::util::EndianUtil::ReadInt64s(base + idx, dst, n);
+    idx += num_bytes;
+  }
+
+  void Prefetch(const uint64_t offset, const uint64_t prefetch_length) {
+    if (offset >= length || prefetch_length == 0) {
+      return;
+    }
+
+    // madvise wants a page aligned address
+    static const uintptr_t page_mask = (sysconf(_SC_PAGESIZE) - 1);
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(base + offset);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(base + offset +
+                          std::min(prefetch_length, length - offset));
+    const uintptr_t aligned_begin = (begin & ~page_mask);
+    madvise(reinterpret_cast<void*>(aligned_begin),
+            end - aligned_begin,
+            MADV_WILLNEED);
+  }
+
+  lucene::core::util::BytesRef ReadBytesRef(const uint32_t len) {
+    if (idx + len > length) {
+      throw lucene::core::util::EOFException("Read past EOF: " +
+                                             resource_desc);
+    }
+
+    // Points into the mapping, `region` keeps it mapped
+    lucene::core::util::BytesRef ref =
+    lucene::core::util::BytesRef::View(base + idx, 0, len);
+    idx += len;
+    return ref;
+  }
+
+  void ReadVInt32s(int32_t dst[], const uint32_t n) {
+    const uint64_t max_bytes =
+    static_cast<uint64_t>(n) * lucene::core::util::VIntUtil::MAX_VINT32_BYTES;
+    uint32_t decoded = 0;
+    idx += lucene::core::util::VIntUtil::DecodeVInt32s(
+             base + idx,
+             static_cast<uint32_t>(std::min(length - idx, max_bytes)),
+             dst,
+             n,
+             &decoded);
+    if (decoded < n) {
+      throw lucene::core::util::EOFException("Read past EOF: " +
+                                             resource_desc);
+    }
+  }
+
   uint64_t GetFilePointer() {
     return idx;
   }
@@ -1292,38 +1591,36 @@ class ByteBufferIndexInput: public IndexInput, public RandomAccessInput {
   }
 
   int16_t ReadInt16(const uint64_t pos) {
-    lucene::core::util::numeric::Int16AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[1] = base[pos];
-    iab.bytes[0] = base[pos + 1];
-#else
-    iab.bytes[0] = base[pos];
-    iab.bytes[1] = base[pos + 1];
-#endif
-
-    return iab.int16;
+    return lucene::core::util::EndianUtil::ReadInt16(base + pos);
   }
 
   int32_t ReadInt32(const uint64_t pos) {
-    lucene::core::util::numeric::Int32AndBytes iab;
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    iab.bytes[3] = base[pos];
-    iab.bytes[2] = base[pos + 1];
-    iab.bytes[1] = base[pos + 2];
-    iab.bytes[0] = base[pos + 3];
-#else
-    iab.bytes[0] = base[pos];
-    iab.bytes[1] = base[pos + 1];
-    iab.bytes[2] = base[pos + 2];
-    iab.bytes[3] = base[pos + 3];
-#endif
-
-    return iab.int32;
+    return lucene::core::util::EndianUtil::ReadInt32(base + pos);
   }
 
   int64_t ReadInt64(const uint64_t pos) {
-    return (static_cast<int64_t>(ReadInt32(pos)) << 32 |
-            ReadInt32(pos + 4) & 0xFFFFFFFFL);
+    return lucene::core::util::EndianUtil::ReadInt64(base + pos);
+  }
+
+  void ReadInt16s(const uint64_t pos,
+                  int16_t dst[],
+                  const uint32_t n) {
+    CheckRange(pos, static_cast<uint64_t>(n) * sizeof(int16_t));
+    lucene::core::util::EndianUtil::ReadInt16s(base + pos, dst, n);
+  }
+
+  void ReadInt32s(const uint64_t pos,
+                  int32_t dst[],
+                  const uint32_t n) {
+    CheckRange(pos, static_cast<uint64_t>(n) * sizeof(int32_t));
+    lucene::core::util::EndianUtil::ReadInt32s(base + pos, dst, n);
+  }
+
+  void ReadInt64s(const uint64_t pos,
+                  int64_t dst[],
+                  const uint32_t n) {
+    CheckRange(pos, static_cast<uint64_t>(n) * sizeof(int64_t));
+    lucene::core::util::EndianUtil::ReadInt64s(base + pos, dst, n);
   }
 
   uint64_t Length() {
@@ -1334,28 +1631,21 @@ class ByteBufferIndexInput: public IndexInput, public RandomAccessInput {
   Slice(const std::string& slice_description,
         const uint64_t offset,
         const uint64_t length) {
+    EnsureValid();
     return std::make_unique<ByteBufferIndexInput>(resource_desc,
+                                                  region,
                                                   base + offset,
                                                   length,
                                                   true);
   }
 
   void Close() {
-    if (!isClone && *isClosed == false) {
-      const int result = munmap(const_cast<char*>(base), length);
-      *isClosed = true;
-      // What happens if clear-cache-feature is not supported?
-      // Imagine this scenario. When destruct this instance
-      // isClosed variable was setted to false and be released by delete.
-      // And there are still remaining read threads out there try to read data
-      // Then is it possible for them to meet segment fault?
-      __builtin___clear_cache(reinterpret_cast<char*>(&isClosed),
-                              reinterpret_cast<char*>(&isClosed) + 1);
-      std::this_thread::yield();
-      if (result != 0) {
-        throw lucene::core::util::IOException(std::string("Failed to close ") +
-                                              resource_desc);
-      }
+    // Clones keep their reference until they are destructed, like Lucene
+    // where closing a clone is a no-op
+    if (!is_clone && region) {
+      region->Invalidate();
+      // Unmapped right here unless a clone or a slice is still alive
+      region.reset();
     }
   }
 };
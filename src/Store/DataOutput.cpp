@@ -0,0 +1,192 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <Store/DataOutput.h>
+#include <cstdlib>
+
+using lucene::core::store::DirectIndexOutput;
+using lucene::core::store::FileIndexOutput;
+using lucene::core::store::WriteBehindFlusher;
+using lucene::core::util::FileUtil;
+using lucene::core::util::IOException;
+
+const uint32_t FileIndexOutput::BUF_SIZE;
+const uint32_t FileIndexOutput::MAX_BUF_SIZE;
+const uint32_t DirectIndexOutput::ALIGNMENT;
+const uint32_t DirectIndexOutput::DEFAULT_BUFFER_SIZE;
+
+/**
+ *  WriteBehindFlusher
+ */
+std::future<void> WriteBehindFlusher::Submit(const int fd,
+                                             const char* data,
+                                             const uint32_t length,
+                                             const uint64_t offset) {
+  return threads.Submit([fd, data, length, offset](){
+    FileUtil::PWriteFully(fd, data, length, offset);
+  });
+}
+
+/**
+ *  DirectIndexOutput
+ */
+namespace {
+
+char* AllocateAligned(const uint32_t size) {
+  void* mem = nullptr;
+  if (posix_memalign(&mem, DirectIndexOutput::ALIGNMENT, size) != 0) {
+    throw std::bad_alloc();
+  }
+
+  return static_cast<char*>(mem);
+}
+
+uint32_t AlignUp(const uint32_t size) {
+  return ((size + DirectIndexOutput::ALIGNMENT - 1) &
+          ~(DirectIndexOutput::ALIGNMENT - 1));
+}
+
+}  // namespace
+
+DirectIndexOutput::DirectIndexOutput(const std::string& resource_desc,
+                                     const std::string& name,
+                                     const std::string& path)
+  : DirectIndexOutput(resource_desc,
+                      name,
+                      path,
+                      DirectIndexOutput::DEFAULT_BUFFER_SIZE,
+                      std::shared_ptr<std::atomic<uint64_t>>()) {
+}
+
+DirectIndexOutput::DirectIndexOutput(
+                   const std::string& resource_desc,
+                   const std::string& name,
+                   const std::string& path,
+                   const uint32_t buffer_size,
+                   const std::shared_ptr<std::atomic<uint64_t>>& bytes_counter)
+  : IndexOutput(resource_desc, name),
+    crc(),
+    bytes_written(0),
+    file_offset(0),
+    fd(-1),
+    direct(true),
+    buffer_size(AlignUp(std::max(buffer_size, DirectIndexOutput::ALIGNMENT))),
+    buf_idx(0),
+    buffer(nullptr, std::free),
+    closed(false),
+    bytes_counter(bytes_counter) {
+  const mode_t mode = (S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+  fd = open(path.c_str(), O_CREAT | O_WRONLY | O_EXCL | O_DIRECT, mode);
+  if (fd < 0 && errno == EINVAL) {
+    // File system without O_DIRECT support. The file may have been created
+    // before the flag got rejected
+    direct = false;
+    fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, mode);
+  }
+
+  if (fd < 0) {
+    throw IOException(std::strerror(errno));
+  }
+
+  buffer.reset(AllocateAligned(this->buffer_size));
+}
+
+DirectIndexOutput::~DirectIndexOutput() {
+  try {
+    Close();
+  } catch(...) {
+    // Ignore
+  }
+}
+
+void DirectIndexOutput::FlushBuffer(const uint32_t length) {
+  if (length == 0) {
+    return;
+  }
+
+  FileUtil::PWriteFully(fd, buffer.get(), length, file_offset);
+
+  if (!direct) {
+    // Dirty pages can not be dropped, so write them back first
+    sync_file_range(fd,
+                    file_offset,
+                    length,
+                    SYNC_FILE_RANGE_WAIT_BEFORE |
+                    SYNC_FILE_RANGE_WRITE |
+                    SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(fd, file_offset, length, POSIX_FADV_DONTNEED);
+  }
+
+  file_offset += length;
+  buf_idx = 0;
+}
+
+void DirectIndexOutput::WriteBytes(const char bytes[],
+                                   const uint32_t offset,
+                                   const uint32_t length) {
+  bytes_written += length;
+  crc.Update(bytes, offset, length);
+
+  // O_DIRECT wants an aligned source, so always go through the buffer
+  const char* src = bytes + offset;
+  uint32_t left = length;
+  while (left > 0) {
+    const uint32_t to_copy = std::min(left, buffer_size - buf_idx);
+    std::memcpy(buffer.get() + buf_idx, src, to_copy);
+    buf_idx += to_copy;
+    src += to_copy;
+    left -= to_copy;
+
+    if (buf_idx >= buffer_size) {
+      FlushBuffer(buf_idx);
+    }
+  }
+}
+
+void DirectIndexOutput::Close() {
+  if (closed) {
+    return;
+  }
+
+  closed = true;
+  try {
+    if (direct && buf_idx > 0) {
+      // Pad the tail to a whole block, then cut the padding off
+      const uint32_t aligned = AlignUp(buf_idx);
+      std::memset(buffer.get() + buf_idx, 0, aligned - buf_idx);
+      FlushBuffer(aligned);
+      if (ftruncate(fd, bytes_written) != 0) {
+        throw IOException(std::strerror(errno));
+      }
+    } else {
+      FlushBuffer(buf_idx);
+    }
+  } catch(...) {
+    // Descriptor must not leak, later Close calls do nothing
+    close(fd);
+    throw;
+  }
+
+  if (close(fd) < 0) {
+    throw IOException(std::strerror(errno));
+  }
+
+  if (bytes_counter) {
+    bytes_counter->fetch_add(bytes_written, std::memory_order_relaxed);
+  }
+}
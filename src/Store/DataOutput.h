@@ -22,20 +22,32 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <Store/DataInput.h>
+#include <Store/RateLimiter.h>
 #include <Util/ArrayUtil.h>
 #include <Util/Bits.h>
 #include <Util/Bytes.h>
+#include <Util/Concurrency.h>
 #include <Util/Etc.h>
 #include <Util/Exception.h>
+#include <Util/File.h>
 #include <Util/Numeric.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <exception>
 #include <fstream>
+#include <future>
 #include <stdexcept>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
 namespace lucene {
 namespace core {
@@ -82,44 +94,41 @@ class DataOutput {
   }
 
   void WriteInt32(const int32_t i) {
-    lucene::core::util::numeric::Int32AndBytes iab;
-    iab.int32 = i;
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    char buf[4] = {
-      iab.bytes[3],
-      iab.bytes[2],
-      iab.bytes[1],
-      iab.bytes[0]
-    };
-    WriteBytes(buf, 0, 4);
-#else
-    WriteBytes(iab.bytes, 0, 4);
-#endif
+    char buf[sizeof(int32_t)];
+    lucene::core::util::EndianUtil::WriteInt32(i, buf);
+    WriteBytes(buf, 0, sizeof(buf));
   }
 
   void WriteInt16(const int16_t i) {
-    lucene::core::util::numeric::Int16AndBytes iab;
-    iab.int16 = i;
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    char buf[2] = {
-      iab.bytes[1],
-      iab.bytes[0]
-    };
-    WriteBytes(buf, 0, 2);
-#else
-    WriteBytes(iab.bytes, 0, 2);
-#endif
-  }
-
-  void WriteVInt32(int32_t i) {
-    while (i > 127) {
-      WriteByte(static_cast<char>((i & 127) | 128));
-      i >>= 7;
+    char buf[sizeof(int16_t)];
+    lucene::core::util::EndianUtil::WriteInt16(i, buf);
+    WriteBytes(buf, 0, sizeof(buf));
+  }
+
+  void WriteVInt32(const int32_t i) {
+    // Negative values take five bytes
+    uint32_t u = static_cast<uint32_t>(i);
+    while (u > 127) {
+      WriteByte(static_cast<char>((u & 127) | 128));
+      u >>= 7;
     }
 
-    WriteByte(static_cast<char>(i));
+    WriteByte(static_cast<char>(u));
+  }
+
+  // Encodes a block of values at once, then writes them with one call
+  void WriteVInt32s(const int32_t values[], const uint32_t n) {
+    AllocateCopyBufferIf();
+    const uint32_t chunk = (DataOutput::COPY_BUFFER_SIZE /
+                            lucene::core::util::VIntUtil::MAX_VINT32_BYTES);
+    for (uint32_t i = 0 ; i < n ; i += chunk) {
+      const uint32_t num_values = std::min(chunk, n - i);
+      const uint32_t num_bytes =
+      lucene::core::util::VIntUtil::EncodeVInt32s(values + i,
+                                                  num_values,
+                                                  copy_buffer.get());
+      WriteBytes(copy_buffer.get(), 0, num_bytes);
+    }
   }
 
   void WriteZInt32(const int32_t i) {
@@ -127,25 +136,46 @@ class DataOutput {
   }
 
   void WriteInt64(const int64_t i) {
-    lucene::core::util::numeric::Int64AndBytes iab;
-    iab.int64 = i;
-
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    char buf[8] = {
-      iab.bytes[7],
-      iab.bytes[6],
-      iab.bytes[5],
-      iab.bytes[4],
-      iab.bytes[3],
-      iab.bytes[2],
-      iab.bytes[1],
-      iab.bytes[0]
-    };
-
-    WriteBytes(buf, 0, 8);
-#else
-    WriteBytes(iab.bytes, 0, 8);
-#endif
+    char buf[sizeof(int64_t)];
+    lucene::core::util::EndianUtil::WriteInt64(i, buf);
+    WriteBytes(buf, 0, sizeof(buf));
+  }
+
+  // Fixed width values, swapped a block at a time and written with one call
+  void WriteInt16s(const int16_t values[], const uint32_t n) {
+    AllocateCopyBufferIf();
+    const uint32_t chunk = (DataOutput::COPY_BUFFER_SIZE / sizeof(int16_t));
+    for (uint32_t i = 0 ; i < n ; i += chunk) {
+      const uint32_t num_values = std::min(chunk, n - i);
+      lucene::core::util::EndianUtil::WriteInt16s(values + i,
+                                                  num_values,
+                                                  copy_buffer.get());
+      WriteBytes(copy_buffer.get(), 0, num_values * sizeof(int16_t));
+    }
+  }
+
+  void WriteInt32s(const int32_t values[], const uint32_t n) {
+    AllocateCopyBufferIf();
+    const uint32_t chunk = (DataOutput::COPY_BUFFER_SIZE / sizeof(int32_t));
+    for (uint32_t i = 0 ; i < n ; i += chunk) {
+      const uint32_t num_values = std::min(chunk, n - i);
+      lucene::core::util::EndianUtil::WriteInt32s(values + i,
+                                                  num_values,
+                                                  copy_buffer.get());
+      WriteBytes(copy_buffer.get(), 0, num_values * sizeof(int32_t));
+    }
+  }
+
+  void WriteInt64s(const int64_t values[], const uint32_t n) {
+    AllocateCopyBufferIf();
+    const uint32_t chunk = (DataOutput::COPY_BUFFER_SIZE / sizeof(int64_t));
+    for (uint32_t i = 0 ; i < n ; i += chunk) {
+      const uint32_t num_values = std::min(chunk, n - i);
+      lucene::core::util::EndianUtil::WriteInt64s(values + i,
+                                                  num_values,
+                                                  copy_buffer.get());
+      WriteBytes(copy_buffer.get(), 0, num_values * sizeof(int64_t));
+    }
   }
 
   void WriteVInt64(const int64_t i) {
@@ -333,43 +363,190 @@ class GrowableByteArrayDataOutput: public DataOutput {
   }
 };
 
+/**
+ * Shared background writer for write-behind outputs.
+ * Each submission is written with pwrite, so several threads can serve
+ * buffers of a same file without ordering issue.
+ */
+class WriteBehindFlusher {
+ private:
+  // Drains queued writes before joining its threads
+  lucene::core::util::ThreadPool threads;
+
+ public:
+  explicit WriteBehindFlusher(const uint32_t num_threads = 1)
+    : threads(num_threads) {
+  }
+
+  WriteBehindFlusher(const WriteBehindFlusher& other) = delete;
+
+  WriteBehindFlusher& operator=(const WriteBehindFlusher& other) = delete;
+
+  // `data` must stay untouched until returned future is ready
+  std::future<void> Submit(const int fd,
+                           const char* data,
+                           const uint32_t length,
+                           const uint64_t offset);
+};
+
 class FileIndexOutput: public IndexOutput {
  public:
   static const uint32_t BUF_SIZE = 8192;
+  static const uint32_t MAX_BUF_SIZE = 1048576;
 
  private:
   lucene::core::util::Crc32 crc;
   uint64_t bytes_written;
+  uint64_t file_offset;
   std::string path;
   int fd;
+  uint32_t buffer_size;
   uint32_t buf_idx;
+  uint32_t current;
   bool flushed_on_close;
-  char buffer[BUF_SIZE];
+  std::shared_ptr<WriteBehindFlusher> flusher;
+  // Two buffers in write-behind mode, otherwise only the first one is used
+  std::unique_ptr<char[]> buffers[2];
+  std::future<void> pending[2];
+  char* buffer;
+  std::shared_ptr<std::atomic<uint64_t>> bytes_counter;
+  // First failed write. The file has a hole from then on, so it is thrown
+  // again by every later flush, Close and GetChecksum
+  std::exception_ptr flush_error;
 
  private:
   void flush() {
+    if (flush_error) {
+      std::rethrow_exception(flush_error);
+    }
+
     if (buf_idx > 0) {
-      write(fd, buffer, buf_idx);
-      buf_idx = 0;
+      if (flusher) {
+        pending[current] =
+        flusher->Submit(fd, buffer, buf_idx, file_offset);
+        current ^= 1;
+        buffer = buffers[current].get();
+        // The submitted buffer is the flusher's now, whatever the wait says
+        file_offset += buf_idx;
+        buf_idx = 0;
+        // Only stalls when the flusher is one whole buffer behind
+        WaitPending(current);
+      } else {
+        try {
+          lucene::core::util::FileUtil::WriteFully(fd, buffer, buf_idx);
+        } catch(...) {
+          flush_error = std::current_exception();
+          throw;
+        }
+
+        file_offset += buf_idx;
+        buf_idx = 0;
+      }
     }
   }
 
+  void WaitPending(const uint32_t idx) {
+    if (pending[idx].valid()) {
+      // Rethrows the error from the flusher thread if there was any. The
+      // future is spent after get(), so the error is kept
+      try {
+        pending[idx].get();
+      } catch(...) {
+        if (!flush_error) {
+          flush_error = std::current_exception();
+        }
+        throw;
+      }
+    }
+  }
+
+  void WaitAllPending() {
+    WaitPending(0);
+    WaitPending(1);
+  }
+
+ public:
+  /**
+   * Sizes the buffer after the amount of bytes expected to be written.
+   * Flushes and merges get larger buffers so they hit the kernel less often.
+   */
+  static uint32_t BufferSize(const IOContext& context) {
+    uint64_t expected;
+    switch (context.context) {
+      case IOContext::Context::MERGE:
+        expected = context.merge_info.estimate_merge_bytes;
+        break;
+      case IOContext::Context::FLUSH:
+        expected = context.flush_info.estimated_segment_size;
+        break;
+      default:
+        return FileIndexOutput::BUF_SIZE;
+    }
+
+    // Around 64 buffer fills for the whole segment
+    uint32_t size = FileIndexOutput::BUF_SIZE;
+    while (size < FileIndexOutput::MAX_BUF_SIZE && (size << 6) < expected) {
+      size <<= 1;
+    }
+
+    return size;
+  }
+
  public:
   FileIndexOutput(const std::string& resource_desc,
                   const std::string& name,
                   const std::string& path)
+    : FileIndexOutput(resource_desc,
+                      name,
+                      path,
+                      FileIndexOutput::BUF_SIZE,
+                      std::shared_ptr<WriteBehindFlusher>()) {
+  }
+
+  FileIndexOutput(const std::string& resource_desc,
+                  const std::string& name,
+                  const std::string& path,
+                  const IOContext& context,
+                  const std::shared_ptr<WriteBehindFlusher>& flusher)
+    : FileIndexOutput(resource_desc,
+                      name,
+                      path,
+                      FileIndexOutput::BufferSize(context),
+                      flusher) {
+  }
+
+  FileIndexOutput(const std::string& resource_desc,
+                  const std::string& name,
+                  const std::string& path,
+                  const uint32_t buffer_size,
+                  const std::shared_ptr<WriteBehindFlusher>& flusher)
     : IndexOutput(resource_desc, name),
       crc(),
       bytes_written(0L),
+      file_offset(0L),
       path(path),
       fd(open(path.c_str(),
               O_CREAT | O_WRONLY | O_EXCL,
               S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH)),
+      buffer_size(buffer_size),
       buf_idx(0),
-      flushed_on_close(false) {
+      current(0),
+      flushed_on_close(false),
+      flusher(flusher),
+      buffers(),
+      pending(),
+      buffer(nullptr),
+      bytes_counter(),
+      flush_error() {
     if (fd < 0) {
       throw lucene::core::util::IOException(std::strerror(errno));
     }
+
+    buffers[0] = std::make_unique<char[]>(buffer_size);
+    if (flusher) {
+      buffers[1] = std::make_unique<char[]>(buffer_size);
+    }
+    buffer = buffers[0].get();
   }
 
   ~FileIndexOutput() {
@@ -378,6 +555,27 @@ class FileIndexOutput: public IndexOutput {
     } catch(...) {
       // Ignore
     }
+
+    // Buffers must outlive in-flight writes
+    for (std::future<void>& future : pending) {
+      if (future.valid()) {
+        future.wait();
+      }
+    }
+  }
+
+  bool IsWriteBehind() const noexcept {
+    return static_cast<bool>(flusher);
+  }
+
+  uint32_t GetBufferSize() const noexcept {
+    return buffer_size;
+  }
+
+  // Written bytes are added to given counter when this output is closed
+  void SetBytesCounter(
+    const std::shared_ptr<std::atomic<uint64_t>>& new_bytes_counter) {
+    bytes_counter = new_bytes_counter;
   }
 
   void WriteByte(const char b) {
@@ -385,7 +583,7 @@ class FileIndexOutput: public IndexOutput {
     buffer[buf_idx++] = b;
     bytes_written++;
 
-    if (buf_idx >= BUF_SIZE) {
+    if (buf_idx >= buffer_size) {
       flush();
     }
   }
@@ -396,28 +594,58 @@ class FileIndexOutput: public IndexOutput {
     bytes_written += length;
     crc.Update(bytes, offset, length);
 
-    if (length > BUF_SIZE) {
+    if (length > buffer_size && !flusher) {
       flush();
-      write(fd, bytes + offset, length);
+      lucene::core::util::FileUtil::WriteFully(fd, bytes + offset, length);
+      file_offset += length;
       return;
     }
 
-    if (length + buf_idx > BUF_SIZE) {
-      flush();
-    }
+    const char* src = bytes + offset;
+    uint32_t left = length;
+    while (left > 0) {
+      if (buf_idx >= buffer_size) {
+        flush();
+      }
 
-    std::memcpy(buffer + buf_idx, bytes + offset, length);
-    buf_idx += length;
+      const uint32_t to_copy = std::min(left, buffer_size - buf_idx);
+      std::memcpy(buffer + buf_idx, src, to_copy);
+      buf_idx += to_copy;
+      src += to_copy;
+      left -= to_copy;
+    }
   }
 
   void Close() {
     if (!flushed_on_close) {
       flushed_on_close = true;
-      flush();
+      // Descriptor is closed whatever fails, but only once no write is
+      // left in flight on it. First error wins
+      std::exception_ptr error;
+      try {
+        flush();
+      } catch(...) {
+        error = std::current_exception();
+      }
+      try {
+        WaitAllPending();
+      } catch(...) {
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
 
       const int result = close(fd);
+      const int err = errno;
+      if (error) {
+        std::rethrow_exception(error);
+      }
       if (result < 0) {
-        throw lucene::core::util::IOException(std::strerror(errno));
+        throw lucene::core::util::IOException(std::strerror(err));
+      }
+
+      if (bytes_counter) {
+        bytes_counter->fetch_add(bytes_written, std::memory_order_relaxed);
       }
     }
   }
@@ -427,21 +655,154 @@ class FileIndexOutput: public IndexOutput {
   }
 
   uint64_t GetChecksum() {
+    if (flush_error) {
+      std::rethrow_exception(flush_error);
+    }
+
     if (!flushed_on_close) {
-      write(fd, buffer, buf_idx);
+      flush();
+      WaitAllPending();
       fsync(fd);
-      buf_idx = 0;
     }
 
     return crc.GetValue();
   }
 };
 
+/**
+ * Output writing through O_DIRECT from an aligned buffer, so written bytes
+ * never go through the page cache and never evict pages readers still need.
+ * Meant for large merges. The last block is padded on close and the file
+ * is truncated back to its real length.
+ * If the file system refuses O_DIRECT, it falls back to buffered writes and
+ * drops every written range from the page cache right away.
+ */
+class DirectIndexOutput: public IndexOutput {
+ public:
+  static const uint32_t ALIGNMENT = 4096;
+  static const uint32_t DEFAULT_BUFFER_SIZE = 1048576;
+
+ private:
+  lucene::core::util::Crc32 crc;
+  uint64_t bytes_written;
+  uint64_t file_offset;
+  int fd;
+  bool direct;
+  uint32_t buffer_size;
+  uint32_t buf_idx;
+  std::unique_ptr<char, void(*)(void*)> buffer;
+  bool closed;
+  std::shared_ptr<std::atomic<uint64_t>> bytes_counter;
+
+ private:
+  void FlushBuffer(const uint32_t length);
+
+ public:
+  DirectIndexOutput(const std::string& resource_desc,
+                    const std::string& name,
+                    const std::string& path);
+
+  // `buffer_size` is rounded up to ALIGNMENT
+  DirectIndexOutput(const std::string& resource_desc,
+                    const std::string& name,
+                    const std::string& path,
+                    const uint32_t buffer_size,
+                    const std::shared_ptr<std::atomic<uint64_t>>&
+                    bytes_counter);
+
+  ~DirectIndexOutput();
+
+  // False when the file system did not take O_DIRECT
+  bool IsDirect() const noexcept {
+    return direct;
+  }
+
+  void WriteByte(const char b) {
+    crc.Update(b);
+    buffer.get()[buf_idx++] = b;
+    bytes_written++;
+
+    if (buf_idx >= buffer_size) {
+      FlushBuffer(buf_idx);
+    }
+  }
+
+  void WriteBytes(const char bytes[],
+                  const uint32_t offset,
+                  const uint32_t length);
+
+  void Close();
+
+  uint64_t GetFilePointer() {
+    return bytes_written;
+  }
+
+  uint64_t GetChecksum() {
+    return crc.GetValue();
+  }
+};
+
 class RateLimitedIndexOutput: public IndexOutput {
  private:
   std::unique_ptr<IndexOutput> delegate;
+  std::shared_ptr<RateLimiter> rate_limiter;
+  uint64_t bytes_since_last_pause;
+  uint64_t current_min_pause_check_bytes;
+  uint64_t paused_ns;
+
+ private:
+  void CheckRate() {
+    // Pause in coarse chunks rather than on every write
+    if (bytes_since_last_pause > current_min_pause_check_bytes) {
+      paused_ns += rate_limiter->Pause(bytes_since_last_pause);
+      bytes_since_last_pause = 0;
+      current_min_pause_check_bytes = rate_limiter->GetMinPauseCheckBytes();
+    }
+  }
 
-  // TODO(0ctopus13prime): Implement it
+ public:
+  RateLimitedIndexOutput(const std::shared_ptr<RateLimiter>& rate_limiter,
+                         std::unique_ptr<IndexOutput>&& delegate)
+    : IndexOutput(std::string("RateLimitedIndexOutput(") +
+                  delegate->GetName() + ')',
+                  delegate->GetName()),
+      delegate(std::forward<std::unique_ptr<IndexOutput>>(delegate)),
+      rate_limiter(rate_limiter),
+      bytes_since_last_pause(0),
+      current_min_pause_check_bytes(rate_limiter->GetMinPauseCheckBytes()),
+      paused_ns(0) {
+  }
+
+  void WriteByte(const char b) {
+    bytes_since_last_pause++;
+    CheckRate();
+    delegate->WriteByte(b);
+  }
+
+  void WriteBytes(const char bytes[],
+                  const uint32_t offset,
+                  const uint32_t length) {
+    bytes_since_last_pause += length;
+    CheckRate();
+    delegate->WriteBytes(bytes, offset, length);
+  }
+
+  void Close() {
+    delegate->Close();
+  }
+
+  uint64_t GetFilePointer() {
+    return delegate->GetFilePointer();
+  }
+
+  uint64_t GetChecksum() {
+    return delegate->GetChecksum();
+  }
+
+  // Total time this output has been throttled, in nanoseconds
+  uint64_t GetPausedNS() const noexcept {
+    return paused_ns;
+  }
 };
 
 }  // namespace store
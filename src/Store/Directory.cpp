@@ -18,13 +18,19 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <Index/File.h>
+#include <Store/BlockCache.h>
 #include <Util/Exception.h>
 #include <Util/File.h>
 #include <Store/DataInput.h>
 #include <Store/Directory.h>
 #include <Store/Exception.h>
+#include <Store/IoUring.h>
 #include <Store/Lock.h>
 #include <algorithm>
+#include <chrono>
+#include <exception>
+#include <thread>
+#include <vector>
 
 using lucene::core::index::IndexFileNames;
 using lucene::core::store::AlreadyClosedException;
@@ -37,10 +43,24 @@ using lucene::core::store::Directory;
 using lucene::core::store::IOUtils;
 using lucene::core::store::BaseDirectory;
 using lucene::core::store::FSDirectory;
+using lucene::core::store::FsyncPool;
+using lucene::core::store::WriteBehindFlusher;
+using lucene::core::store::DirectIndexOutput;
+using lucene::core::store::FileIndexOutput;
+using lucene::core::store::RateLimitedIndexOutput;
 using lucene::core::store::MMapDirectory;
+using lucene::core::store::IoUring;
+using lucene::core::store::IoUringDirectory;
+using lucene::core::store::IoUringIndexInput;
+using lucene::core::store::IoUringIndexOutput;
 using lucene::core::store::FSLockFactory;
 using lucene::core::store::ByteBufferIndexInput;
+using lucene::core::store::MappedRegion;
+using lucene::core::store::PReadDirectory;
+using lucene::core::store::PReadIndexInput;
+using lucene::core::util::Crc32Util;
 using lucene::core::util::FileUtil;
+using lucene::core::util::EOFException;
 using lucene::core::util::IOException;
 using lucene::core::util::NoSuchFileException;
 
@@ -62,20 +82,26 @@ IOUtils::DeleteFilesIgnoringExceptions(Directory& dir,
 /**
  *  Directory
  */
+const uint64_t Directory::MIN_CHECKSUM_RANGE;
+
 void Directory::CopyFrom(Directory& from,
                          const std::string& src,
                          const std::string& dest,
                          const IOContext& context) {
-  // If we copy from another file to another file
-  // then we can use native approach like `sendfile`?
-  // It is much more faster and efficient
-
+  bool created = false;
   try {
     std::unique_ptr<IndexInput> is(from.OpenInput(src, context));
     std::unique_ptr<IndexOutput> os(CreateOutput(dest, context));
+    created = true;
     os->CopyBytes(*(is.get()), is->Length());
+    // Destructors swallow errors of the last flush, close here to see them
+    os->Close();
+    is->Close();
   } catch(...) {
-    IOUtils::DeleteFilesIgnoringExceptions(*this, {});
+    if (created) {
+      IOUtils::DeleteFilesIgnoringExceptions(*this, {dest});
+    }
+    throw;
   }
 }
 
@@ -86,6 +112,85 @@ Directory::OpenChecksumInput(const std::string& name,
   std::make_unique<BufferedChecksumIndexInput>(OpenInput(name, context));
 }
 
+int64_t Directory::ComputeChecksum(const std::string& name,
+                                   const uint64_t length,
+                                   const IOContext& context,
+                                   const uint32_t num_threads) {
+  std::unique_ptr<IndexInput> in = OpenInput(name, context);
+  if (length > in->Length()) {
+    throw EOFException("Checksum range " + std::to_string(length) +
+                       " is past EOF of " + name);
+  }
+
+  const uint32_t max_ranges =
+  std::max(1U, num_threads > 0 ?
+               num_threads : std::thread::hardware_concurrency());
+  const uint64_t num_ranges =
+  std::max<uint64_t>(1, std::min<uint64_t>(max_ranges,
+                                           length / MIN_CHECKSUM_RANGE));
+  const uint64_t range_size = length / num_ranges;
+
+  std::vector<uint32_t> crcs(num_ranges, 0);
+  std::vector<uint64_t> lengths(num_ranges, 0);
+  std::vector<std::exception_ptr> errors(num_ranges);
+  // Slices of some inputs share the base file pointer, so every range gets
+  // an input of its own
+  std::vector<std::unique_ptr<IndexInput>> range_ins;
+  range_ins.reserve(num_ranges);
+  for (uint64_t i = 0 ; i < num_ranges ; ++i) {
+    const uint64_t offset = i * range_size;
+    lengths[i] = (i + 1 == num_ranges ? length - offset : range_size);
+    range_ins.push_back(i == 0 ? std::move(in) : OpenInput(name, context));
+    range_ins[i]->Seek(offset);
+  }
+
+  auto checksum_range =
+  [&crcs, &lengths, &errors, &range_ins](const uint64_t i) {
+    try {
+      std::unique_ptr<char[]> buf = std::make_unique<char[]>(65536);
+      uint32_t crc = 0;
+      for (uint64_t left = lengths[i] ; left > 0 ; ) {
+        const uint32_t to_read =
+        static_cast<uint32_t>(std::min<uint64_t>(left, 65536));
+        range_ins[i]->ReadBytes(buf.get(), 0, to_read);
+        crc = Crc32Util::Update(crc, buf.get(), to_read);
+        left -= to_read;
+      }
+
+      crcs[i] = crc;
+    } catch(...) {
+      errors[i] = std::current_exception();
+    }
+  };
+
+  // Calling thread takes the first range itself
+  std::vector<std::thread> threads;
+  threads.reserve(num_ranges - 1);
+  for (uint64_t i = 1 ; i < num_ranges ; ++i) {
+    threads.emplace_back(checksum_range, i);
+  }
+  checksum_range(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (const std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  uint32_t crc = crcs[0];
+  for (uint64_t i = 1 ; i < num_ranges ; ++i) {
+    crc = Crc32Util::Combine(crc, crcs[i], lengths[i]);
+  }
+
+  for (std::unique_ptr<IndexInput>& range_in : range_ins) {
+    range_in->Close();
+  }
+  return static_cast<int64_t>(crc) & 0xFFFFFFFFL;
+}
+
 /**
  *  BaseDirectory
  */
@@ -105,6 +210,39 @@ std::unique_ptr<Lock> BaseDirectory::ObtainLock(const std::string& name) {
   return lock_factory->ObtainLock(*this, name);
 }
 
+/**
+ *  FsyncPool
+ */
+std::future<void> FsyncPool::Submit(const std::string& path) {
+  return threads.Submit([path](){
+    FileUtil::Fsync(path);
+  });
+}
+
+void FsyncPool::SyncAll(const std::vector<std::string>& paths) {
+  std::vector<std::future<void>> futures;
+  futures.reserve(paths.size());
+  for (const std::string& path : paths) {
+    futures.push_back(Submit(path));
+  }
+
+  // Wait for every fsync even after a failure, no task outlives this call
+  std::exception_ptr first_error;
+  for (std::future<void>& future : futures) {
+    try {
+      future.get();
+    } catch(...) {
+      if (!first_error) {
+        first_error = std::current_exception();
+      }
+    }
+  }
+
+  if (first_error) {
+    std::rethrow_exception(first_error);
+  }
+}
+
 /**
  *  FSDirectory
  */
@@ -112,18 +250,30 @@ FSDirectory::FSDirectory(const std::string path,
             const std::shared_ptr<LockFactory>& lock_factory)
   : BaseDirectory(lock_factory),
     directory(),
-    pending_deletes(),
-    ops_since_last_delete(),
-    next_temp_file_counter() {
+    pending_deleter(),
+    next_temp_file_counter(),
+    write_behind_flusher(),
+    merge_rate_limiter(),
+    direct_io_min_merge_bytes(0),
+    direct_written_bytes(std::make_shared<std::atomic<uint64_t>>(0)),
+    buffered_written_bytes(std::make_shared<std::atomic<uint64_t>>(0)),
+    fsync_pool(),
+    syncfs_min_files(0),
+    sync_mutex(),
+    sync_cond(),
+    open_sync_group(std::make_shared<SyncGroup>()),
+    sync_running(false),
+    sync_stats() {
   if (!lucene::core::util::FileUtil::IsDirectory(path)) {
     lucene::core::util::FileUtil::CreateDirectory(path);
   }
 
   directory = lucene::core::util::FileUtil::ToRealPath(path);
+  pending_deleter = std::make_unique<PendingDeleter>(directory);
 }
 
 void FSDirectory::EnsureCanRead(const std::string& name) {
-  if (pending_deletes.find(name) != pending_deletes.end()) {
+  if (pending_deleter->IsPending(name)) {
     throw lucene::core::util::NoSuchFileException(
           std::string("File \"") +
           name +
@@ -131,26 +281,6 @@ void FSDirectory::EnsureCanRead(const std::string& name) {
   }
 }
 
-void FSDirectory::MaybeDeletePendingFiles() {
-  if (!pending_deletes.empty()) {
-    DeletePendingFiles();
-  }
-}
-
-void FSDirectory::PrivateDeleteFile(const std::string& name,
-                                  const bool is_pending_delete) {
-  const std::string resolved = FileUtil::ToRealPath(directory + '/' + name);
-
-  try {
-    FileUtil::Delete(resolved);
-    pending_deletes.erase(name);
-  } catch (lucene::core::util::NoSuchFileException&) {
-    pending_deletes.erase(name);
-  } catch (lucene::core::util::IOException&) {
-    pending_deletes.insert(name);
-  }
-}
-
 const std::string& FSDirectory::GetDirectory() {
   EnsureOpen();
   return directory;
@@ -180,24 +310,69 @@ void FSDirectory::Fsync(const std::string& name) {
 }
 
 std::vector<std::string> FSDirectory::ListAll() {
-  std::vector<std::string> ret =
-  FileUtil::ListFiles(directory);
-  std::sort(ret.begin(), ret.end());
-  return ret;
+  // Deleted files may still be on the disk until the deleter gets to them
+  const std::vector<std::string> pending = pending_deleter->ListPending();
+  return ListAllWithSkipNames(directory,
+                              std::set<std::string>(pending.begin(),
+                                                    pending.end()));
 }
 
 uint64_t FSDirectory::FileLength(const std::string& name) {
   return FileUtil::Size(directory + '/' + name);
 }
 
+std::unique_ptr<IndexOutput>
+FSDirectory::NewIndexOutput(const std::string& name,
+                            const std::string& path,
+                            const IOContext& context) {
+  if (IsDirectIOMerge(context)) {
+    return std::make_unique<DirectIndexOutput>(
+           std::string("DirectIndexOutput(path=\"") + path + "\")",
+           name,
+           path,
+           DirectIndexOutput::DEFAULT_BUFFER_SIZE,
+           direct_written_bytes);
+  }
+
+  std::unique_ptr<FileIndexOutput> output =
+  std::make_unique<FileIndexOutput>(
+    std::string("FileIndexOutput(path=\"") + path,
+    name,
+    path,
+    context,
+    write_behind_flusher);
+  output->SetBytesCounter(buffered_written_bytes);
+  return output;
+}
+
+void FSDirectory::SetWriteBehind(const bool new_write_behind) {
+  if (new_write_behind && !write_behind_flusher) {
+    write_behind_flusher = std::make_shared<WriteBehindFlusher>();
+  } else if (!new_write_behind) {
+    // Outputs still writing keep their own reference to the flusher
+    write_behind_flusher.reset();
+  }
+}
+
+std::unique_ptr<IndexOutput>
+FSDirectory::MaybeRateLimit(std::unique_ptr<IndexOutput>&& output,
+                            const IOContext& context) {
+  if (merge_rate_limiter && context.context == IOContext::Context::MERGE) {
+    return std::make_unique<RateLimitedIndexOutput>(
+           merge_rate_limiter,
+           std::forward<std::unique_ptr<IndexOutput>>(output));
+  }
+
+  return std::move(output);
+}
+
 std::unique_ptr<IndexOutput>
 FSDirectory::CreateOutput(const std::string& name, const IOContext& context) {
   EnsureOpen();
-  pending_deletes.erase(name);
-  return std::make_unique<FileIndexOutput>(
-         std::string("FileIndexOutput(path=\"") + directory + '/' + name,
-         name,
-         directory + '/' + name);
+  // Name may be reused right after it was deleted
+  pending_deleter->Claim(name);
+  return MaybeRateLimit(NewIndexOutput(name, directory + '/' + name, context),
+                        context);
 }
 
 std::unique_ptr<IndexOutput>
@@ -205,7 +380,6 @@ FSDirectory::CreateTempOutput(const std::string& prefix,
                               const std::string& suffix,
                               const IOContext& context) {
   EnsureOpen();
-  MaybeDeletePendingFiles();
   std::string path = directory + '/';
   const uint32_t path_prefix_len = path.length();
   std::string name;
@@ -216,46 +390,156 @@ FSDirectory::CreateTempOutput(const std::string& prefix,
            prefix,
            suffix + '_' + std::to_string(next_temp_file_counter++),
            "tmp");
-    if (pending_deletes.find(name) != pending_deletes.end()) {
+    if (pending_deleter->IsPending(name)) {
       continue;
     }
 
     path += name;
   } while (FileUtil::Exists(path));
 
-  return std::make_unique<FileIndexOutput>(
-         std::string("FileIndexOutput(path=\"") + path,
-         name,
-         path);
+  return MaybeRateLimit(NewIndexOutput(name, path, context), context);
+}
+
+void FSDirectory::SetSyncThreads(const uint32_t num_threads) {
+  SetFsyncPool(num_threads > 1 ?
+               std::make_shared<FsyncPool>(num_threads) :
+               std::shared_ptr<FsyncPool>());
+}
+
+void FSDirectory::SetFsyncPool(const std::shared_ptr<FsyncPool>& pool) {
+  // The replaced pool is joined out of the lock, once no group sync uses it
+  std::shared_ptr<FsyncPool> old_pool;
+  {
+    std::lock_guard<std::mutex> guard(sync_mutex);
+    old_pool = std::move(fsync_pool);
+    fsync_pool = pool;
+  }
+}
+
+std::shared_ptr<FsyncPool> FSDirectory::GetFsyncPool() {
+  std::lock_guard<std::mutex> guard(sync_mutex);
+  return fsync_pool;
+}
+
+FSDirectory::SyncStats FSDirectory::GetSyncStats() {
+  std::lock_guard<std::mutex> guard(sync_mutex);
+  return sync_stats;
+}
+
+void FSDirectory::SyncGroupFiles(const SyncGroup& group) {
+  if (syncfs_min_files > 0 && group.names.size() >= syncfs_min_files) {
+    FileUtil::SyncFs(directory);
+    return;
+  }
+
+  std::vector<std::string> paths;
+  paths.reserve(group.names.size());
+  for (const std::string& name : group.names) {
+    paths.push_back(directory + '/' + name);
+  }
+
+  std::shared_ptr<FsyncPool> pool = GetFsyncPool();
+  if (pool && paths.size() > 1) {
+    pool->SyncAll(paths);
+  } else {
+    for (const std::string& path : paths) {
+      Fsync(path);
+    }
+  }
 }
 
 void FSDirectory::Sync(const std::vector<std::string>& names) {
   EnsureOpen();
-  for (const std::string& name : names) {
-    Fsync(directory + '/' + name);
+  if (names.empty()) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> guard(sync_mutex);
+  sync_stats.sync_calls++;
+  std::shared_ptr<SyncGroup> group = open_sync_group;
+  group->names.insert(names.begin(), names.end());
+
+  while (!group->done) {
+    if (sync_running) {
+      sync_cond.wait(guard);
+      continue;
+    }
+
+    // Nobody is flushing, so our group is still the open one. Lead it
+    sync_running = true;
+    open_sync_group = std::make_shared<SyncGroup>();
+    guard.unlock();
+
+    const auto start = std::chrono::steady_clock::now();
+    try {
+      SyncGroupFiles(*group);
+    } catch(...) {
+      group->error = std::current_exception();
+    }
+    const uint64_t elapsed_nanos =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+
+    guard.lock();
+    sync_running = false;
+    group->done = true;
+    sync_stats.group_syncs++;
+    if (syncfs_min_files > 0 && group->names.size() >= syncfs_min_files) {
+      sync_stats.syncfs_calls++;
+    } else {
+      sync_stats.synced_files += group->names.size();
+    }
+    sync_stats.total_sync_nanos += elapsed_nanos;
+    sync_stats.max_sync_nanos =
+    std::max(sync_stats.max_sync_nanos, elapsed_nanos);
+    sync_cond.notify_all();
   }
 
-  MaybeDeletePendingFiles();
+  guard.unlock();
+  if (group->error) {
+    std::rethrow_exception(group->error);
+  }
 }
 
 void FSDirectory::Rename(const std::string& source, const std::string& dest) {
   EnsureOpen();
-  if (pending_deletes.find(source) != pending_deletes.end()) {
+  if (pending_deleter->IsPending(source)) {
     throw NoSuchFileException(std::string("File \"") +
                               source +
                               "\" is pending delete and cannot be moved");
   }
 
-  pending_deletes.erase(dest);
+  pending_deleter->Claim(dest);
   FileUtil::Move(directory + '/' + source,
                  directory + '/' + dest);
-  MaybeDeletePendingFiles();
+}
+
+void FSDirectory::CopyFrom(Directory& from,
+                           const std::string& src,
+                           const std::string& dest,
+                           const IOContext& context) {
+  FSDirectory* fs_from = dynamic_cast<FSDirectory*>(&from);
+  if (fs_from == nullptr ||
+      (merge_rate_limiter && context.context == IOContext::Context::MERGE)) {
+    Directory::CopyFrom(from, src, dest, context);
+    return;
+  }
+
+  EnsureOpen();
+  fs_from->EnsureOpen();
+  fs_from->EnsureCanRead(src);
+  pending_deleter->Claim(dest);
+  FileUtil::CopyFile(fs_from->directory + '/' + src,
+                     directory + '/' + dest);
 }
 
 void FSDirectory::SyncMetaData() {
   EnsureOpen();
   FileUtil::Fsync(directory);
-  MaybeDeletePendingFiles();
+  {
+    std::lock_guard<std::mutex> guard(sync_mutex);
+    sync_stats.metadata_syncs++;
+  }
 }
 
 void FSDirectory::Close() {
@@ -265,27 +549,28 @@ void FSDirectory::Close() {
 }
 
 void FSDirectory::DeleteFile(const std::string& name) {
-  if (pending_deletes.find(name) != pending_deletes.end()) {
+  if (pending_deleter->IsPending(name)) {
     throw NoSuchFileException(std::string("File \"") +
                               name +
                               "\" is already pending delete");
   }
-  PrivateDeleteFile(name, false);
-  MaybeDeletePendingFiles();
+
+  if (!FileUtil::Exists(directory + '/' + name)) {
+    throw NoSuchFileException(std::string("File \"") +
+                              name +
+                              "\" does not exist");
+  }
+
+  pending_deleter->Delete(name);
 }
 
 bool FSDirectory::CheckPendingDeletions() {
   DeletePendingFiles();
-  return !pending_deletes.empty();
+  return pending_deleter->HasPending();
 }
 
-// TODO(0ctopus13prime): Not synchronized. Make it thread safe
 void FSDirectory::DeletePendingFiles() {
-  if (!pending_deletes.empty()) {
-    for (const std::string& name : pending_deletes) {
-      PrivateDeleteFile(name, true);
-    }
-  }
+  pending_deleter->DeleteAllNow();
 }
 
 /**
@@ -298,7 +583,45 @@ MMapDirectory::MMapDirectory(const std::string& path)
 
 MMapDirectory::MMapDirectory(const std::string& path,
               const std::shared_ptr<LockFactory>& lock_factory)
-  : FSDirectory(path, lock_factory) {
+  : FSDirectory(path, lock_factory),
+    preload(false),
+    policy_mutex(),
+    extension_policies() {
+  const MapPolicy random_policy(ReadAdvice::RANDOM, false, false);
+  // Term dictionary, terms index and doc values
+  extension_policies["tim"] = random_policy;
+  extension_policies["tip"] = random_policy;
+  extension_policies["dvd"] = random_policy;
+}
+
+void MMapDirectory::SetExtensionPolicy(const std::string& ext,
+                                       const MapPolicy& policy) {
+  std::unique_lock<std::shared_mutex> guard(policy_mutex);
+  extension_policies[ext] = policy;
+}
+
+void MMapDirectory::RemoveExtensionPolicy(const std::string& ext) {
+  std::unique_lock<std::shared_mutex> guard(policy_mutex);
+  extension_policies.erase(ext);
+}
+
+MMapDirectory::MapPolicy
+MMapDirectory::GetMapPolicy(const std::string& name,
+                            const IOContext& context) const {
+  MapPolicy policy;
+  {
+    std::shared_lock<std::shared_mutex> guard(policy_mutex);
+    auto it = extension_policies.find(IndexFileNames::GetExtension(name));
+    if (it != extension_policies.end()) {
+      policy = it->second;
+    }
+  }
+
+  if (context.context == IOContext::Context::MERGE || context.read_once) {
+    policy.advice = ReadAdvice::SEQUENTIAL;
+  }
+
+  return policy;
 }
 
 std::unique_ptr<IndexInput> MMapDirectory::OpenInput(const std::string& name,
@@ -310,20 +633,39 @@ std::unique_ptr<IndexInput> MMapDirectory::OpenInput(const std::string& name,
 
   const int fd = open(abs_path.c_str(), O_RDONLY);
   struct stat sb;
-  if (fstat(fd, &sb) == -1) {
+  if (fd == -1 || fstat(fd, &sb) == -1) {
+    if (fd != -1) {
+      close(fd);
+    }
     throw IOException("Failed to open " + abs_path);
   }
+
+  const MapPolicy policy = GetMapPolicy(name, context);
   char* addr = static_cast<char*>(mmap(NULL,
                                        sb.st_size,
                                        PROT_READ,
-                                       MAP_PRIVATE,
+                                       MAP_PRIVATE |
+                                       (policy.populate ? MAP_POPULATE : 0),
                                        fd,
                                        0));
+  close(fd);
   if (addr == MAP_FAILED) {
     throw IOException("Failed to map " + abs_path);
   }
 
-  close(fd);
+  // Advices are only hints, so failures are ignored
+  if (policy.advice == ReadAdvice::SEQUENTIAL) {
+    madvise(static_cast<void*>(addr), sb.st_size, MADV_SEQUENTIAL);
+  } else if (policy.advice == ReadAdvice::RANDOM) {
+    madvise(static_cast<void*>(addr), sb.st_size, MADV_RANDOM);
+  }
+
+#ifdef MADV_HUGEPAGE
+  if (policy.huge_page) {
+    madvise(static_cast<void*>(addr), sb.st_size, MADV_HUGEPAGE);
+  }
+#endif
+
   if (preload) {
     madvise(static_cast<void*>(addr), sb.st_size, MADV_WILLNEED);
   }
@@ -331,7 +673,325 @@ std::unique_ptr<IndexInput> MMapDirectory::OpenInput(const std::string& name,
   std::string resource_desc("MMapIndexInput(path=\"");
   resource_desc += abs_path;
   resource_desc += '\"';
-  return std::make_unique<ByteBufferIndexInput>(resource_desc,
-                                                addr,
-                                                sb.st_size);
+  return std::make_unique<ByteBufferIndexInput>(
+         resource_desc,
+         std::make_shared<MappedRegion>(addr, sb.st_size));
+}
+
+const uint64_t MMapDirectory::WARM_UP_CHUNK_SIZE;
+
+MMapDirectory::WarmUpStats
+MMapDirectory::WarmUp(const std::set<std::string>& extensions,
+                      const uint32_t num_threads,
+                      const bool lock) {
+  EnsureOpen();
+  const auto start = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> guard(warm_up_mutex);
+    warm_up_stats = WarmUpStats();
+  }
+
+  // Map every file first, chunks of all files are then shared by the threads
+  WarmUpStats stats;
+  std::vector<std::shared_ptr<MappedRegion>> regions;
+  for (const std::string& name : ListAll()) {
+    if (!extensions.empty() &&
+        extensions.find(IndexFileNames::GetExtension(name)) ==
+        extensions.end()) {
+      continue;
+    }
+
+    const std::string path(directory + '/' + name);
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      if (errno == ENOENT) {
+        // Deleted since listed
+        continue;
+      }
+      throw IOException("Failed to open " + path);
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+      close(fd);
+      throw IOException("Failed to open " + path);
+    }
+
+    if (sb.st_size == 0) {
+      close(fd);
+      continue;
+    }
+
+    char* addr = static_cast<char*>(mmap(NULL,
+                                         sb.st_size,
+                                         PROT_READ,
+                                         MAP_PRIVATE,
+                                         fd,
+                                         0));
+    close(fd);
+    if (addr == MAP_FAILED) {
+      throw IOException("Failed to map " + path);
+    }
+
+    // Lets readahead run ahead of the threads touching pages
+    madvise(static_cast<void*>(addr), sb.st_size, MADV_WILLNEED);
+    regions.push_back(std::make_shared<MappedRegion>(addr, sb.st_size));
+    stats.files++;
+    stats.bytes += sb.st_size;
+  }
+
+  std::vector<std::pair<uint32_t, uint64_t>> chunks;
+  for (uint32_t i = 0 ; i < regions.size() ; ++i) {
+    for (uint64_t offset = 0 ;
+         offset < regions[i]->Length() ;
+         offset += WARM_UP_CHUNK_SIZE) {
+      chunks.emplace_back(i, offset);
+    }
+  }
+
+  const uint64_t page_size = sysconf(_SC_PAGESIZE);
+  std::atomic<uint64_t> next_chunk(0);
+  std::atomic<uint64_t> locked_bytes(0);
+  auto warm_chunks = [&]() {
+    for (uint64_t i = next_chunk.fetch_add(1) ;
+         i < chunks.size() ;
+         i = next_chunk.fetch_add(1)) {
+      const MappedRegion& region = *regions[chunks[i].first];
+      const uint64_t offset = chunks[i].second;
+      const uint64_t length =
+      std::min(WARM_UP_CHUNK_SIZE, region.Length() - offset);
+      const char* base = region.GetBase() + offset;
+
+      // mlock faults pages in itself. Past RLIMIT_MEMLOCK it fails and
+      // pages are just touched
+      if (lock && mlock(base, length) == 0) {
+        locked_bytes.fetch_add(length, std::memory_order_relaxed);
+        continue;
+      }
+
+      volatile char sink = 0;
+      for (uint64_t j = 0 ; j < length ; j += page_size) {
+        sink = base[j];
+      }
+      (void) sink;
+    }
+  };
+
+  const uint32_t max_threads =
+  std::max(1U, num_threads > 0 ?
+               num_threads : std::thread::hardware_concurrency());
+  const uint64_t thread_count =
+  std::max<uint64_t>(1, std::min<uint64_t>(max_threads, chunks.size()));
+
+  // Calling thread takes part as well
+  std::vector<std::thread> threads;
+  threads.reserve(thread_count - 1);
+  for (uint64_t i = 1 ; i < thread_count ; ++i) {
+    threads.emplace_back(warm_chunks);
+  }
+  warm_chunks();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  stats.locked_bytes = locked_bytes.load();
+  stats.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+  stats.completed = true;
+
+  std::lock_guard<std::mutex> guard(warm_up_mutex);
+  if (lock) {
+    // Unlocked regions are unmapped right away, page cache stays warm
+    locked_regions.insert(locked_regions.end(),
+                          regions.begin(),
+                          regions.end());
+  }
+  warm_up_stats = stats;
+  return stats;
+}
+
+MMapDirectory::WarmUpStats MMapDirectory::GetWarmUpStats() {
+  std::lock_guard<std::mutex> guard(warm_up_mutex);
+  return warm_up_stats;
+}
+
+void MMapDirectory::ReleaseWarmUp() {
+  std::vector<std::shared_ptr<MappedRegion>> regions;
+  {
+    std::lock_guard<std::mutex> guard(warm_up_mutex);
+    regions.swap(locked_regions);
+  }
+  // munmap drops the locks
+}
+
+void MMapDirectory::Close() {
+  ReleaseWarmUp();
+  FSDirectory::Close();
+}
+
+/**
+ *  IoUringDirectory
+ */
+
+IoUringDirectory::IoUringDirectory(const std::string& path)
+  : IoUringDirectory(path, FSLockFactory::GetDefault()) {
+}
+
+IoUringDirectory::IoUringDirectory(
+                  const std::string& path,
+                  const std::shared_ptr<LockFactory>& lock_factory)
+  : IoUringDirectory(path, lock_factory, std::make_shared<IoUring>()) {
+}
+
+IoUringDirectory::IoUringDirectory(
+                  const std::string& path,
+                  const std::shared_ptr<LockFactory>& lock_factory,
+                  const std::shared_ptr<IoUring>& ring)
+  : FSDirectory(path, lock_factory),
+    ring(ring) {
+}
+
+bool IoUringDirectory::IsAsync() const noexcept {
+  return ring->IsAsync();
+}
+
+std::unique_ptr<IndexOutput>
+IoUringDirectory::NewIndexOutput(const std::string& name,
+                                 const std::string& path,
+                                 const IOContext& context) {
+  // Large merges stay off the page cache the same way as in FSDirectory
+  if (IsDirectIOMerge(context)) {
+    return FSDirectory::NewIndexOutput(name, path, context);
+  }
+
+  return std::make_unique<IoUringIndexOutput>(
+         std::string("IoUringIndexOutput(path=\"") + path + "\")",
+         name,
+         path,
+         ring);
+}
+
+std::unique_ptr<IndexInput>
+IoUringDirectory::OpenInput(const std::string& name,
+                            const IOContext& context) {
+  EnsureOpen();
+  EnsureCanRead(name);
+  const std::string path(directory + '/' + name);
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw IOException("Failed to open " + path);
+  }
+
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    close(fd);
+    throw IOException("Failed to stat " + path);
+  }
+
+  return std::make_unique<IoUringIndexInput>(
+         std::string("IoUringIndexInput(path=\"") + path + "\")",
+         ring,
+         fd,
+         sb.st_size,
+         context);
+}
+
+/**
+ *  PReadDirectory
+ */
+PReadDirectory::PReadDirectory(const std::string& path)
+  : PReadDirectory(path, FSLockFactory::GetDefault()) {
+}
+
+PReadDirectory::PReadDirectory(
+                const std::string& path,
+                const std::shared_ptr<LockFactory>& lock_factory)
+  : PReadDirectory(path, lock_factory, std::shared_ptr<BlockCache>()) {
+}
+
+PReadDirectory::PReadDirectory(
+                const std::string& path,
+                const std::shared_ptr<LockFactory>& lock_factory,
+                const std::shared_ptr<BlockCache>& cache)
+  : FSDirectory(path, lock_factory),
+    cache(cache),
+    file_ids_mutex(),
+    file_ids() {
+}
+
+uint64_t PReadDirectory::GetFileId(const std::string& name) {
+  std::lock_guard<std::mutex> guard(file_ids_mutex);
+  auto it = file_ids.find(name);
+  if (it == file_ids.end()) {
+    it = file_ids.emplace(name, cache->NewFileId()).first;
+  }
+
+  return it->second;
+}
+
+void PReadDirectory::ForgetFileId(const std::string& name) {
+  if (cache) {
+    // Blocks cached under the old id are never looked up again
+    std::lock_guard<std::mutex> guard(file_ids_mutex);
+    file_ids.erase(name);
+  }
+}
+
+std::unique_ptr<IndexOutput>
+PReadDirectory::CreateOutput(const std::string& name,
+                             const IOContext& context) {
+  ForgetFileId(name);
+  return FSDirectory::CreateOutput(name, context);
+}
+
+void PReadDirectory::Rename(const std::string& source,
+                            const std::string& dest) {
+  FSDirectory::Rename(source, dest);
+  ForgetFileId(source);
+  ForgetFileId(dest);
+}
+
+void PReadDirectory::DeleteFile(const std::string& name) {
+  FSDirectory::DeleteFile(name);
+  ForgetFileId(name);
+}
+
+std::unique_ptr<IndexInput>
+PReadDirectory::OpenInput(const std::string& name,
+                          const IOContext& context) {
+  EnsureOpen();
+  EnsureCanRead(name);
+  const std::string path(directory + '/' + name);
+
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      throw NoSuchFileException(path);
+    }
+    throw IOException("Failed to open " + path);
+  }
+
+  std::shared_ptr<PReadIndexInput::FileHandle> handle =
+  std::make_shared<PReadIndexInput::FileHandle>(fd);
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    throw IOException("Failed to stat " + path);
+  }
+
+  const std::string desc("PReadIndexInput(path=\"" + path + "\")");
+  if (cache) {
+    return std::make_unique<PReadIndexInput>(desc,
+                                             handle,
+                                             sb.st_size,
+                                             cache,
+                                             GetFileId(name),
+                                             context);
+  }
+
+  return std::make_unique<PReadIndexInput>(desc,
+                                           handle,
+                                           sb.st_size,
+                                           cache,
+                                           context);
 }
@@ -19,17 +19,29 @@
 #define SRC_STORE_DIRECTORY_H_
 
 #include <Store/DataOutput.h>
+#include <Store/PendingDeleter.h>
+#include <Util/Concurrency.h>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <set>
+#include <shared_mutex>
+#include <thread>
 #include <vector>
 
 namespace lucene {
 namespace core {
 namespace store {
 
+class BlockCache;
 class Directory;
+class IoUring;
 
 class Lock {
  public:
@@ -64,6 +76,9 @@ class IOUtils {
 };
 
 class Directory {
+ public:
+  static const uint64_t MIN_CHECKSUM_RANGE = 4 * 1024 * 1024;
+
  protected:
   virtual void EnsureOpen() { }
 
@@ -102,10 +117,23 @@ class Directory {
   std::unique_ptr<ChecksumIndexInput>
   OpenChecksumInput(const std::string& name, const IOContext& context);
 
-  void CopyFrom(Directory& from,
-                const std::string& src,
-                const std::string& dest,
-                const IOContext& context);
+  /**
+   * CRC32 of the first `length` bytes of given file, the same value
+   * ChecksumIndexInput::GetChecksum returns after reading them.
+   * File is split into ranges of at least MIN_CHECKSUM_RANGE bytes, which
+   * are checksummed on up to `num_threads` threads over their own slices
+   * and then combined. 0 means one thread per core.
+   */
+  int64_t ComputeChecksum(const std::string& name,
+                          const uint64_t length,
+                          const IOContext& context,
+                          const uint32_t num_threads = 0);
+
+  // Copies `src` of `from` into a new file `dest`, which is removed on failure
+  virtual void CopyFrom(Directory& from,
+                        const std::string& src,
+                        const std::string& dest,
+                        const IOContext& context);
 };
 
 class BaseDirectory: public Directory {
@@ -122,21 +150,104 @@ class BaseDirectory: public Directory {
   std::unique_ptr<Lock> ObtainLock(const std::string& name);
 };
 
+/**
+ * Small pool of threads issuing fsync calls. Flushing several files at
+ * once lets the device work on them concurrently instead of paying one
+ * cache flush latency after another.
+ */
+class FsyncPool {
+ private:
+  lucene::core::util::ThreadPool threads;
+
+ public:
+  explicit FsyncPool(const uint32_t num_threads)
+    : threads(num_threads) {
+  }
+
+  FsyncPool(const FsyncPool& other) = delete;
+
+  FsyncPool& operator=(const FsyncPool& other) = delete;
+
+  uint32_t GetNumThreads() const noexcept {
+    return threads.GetNumThreads();
+  }
+
+  std::future<void> Submit(const std::string& path);
+
+  // Fsyncs every path and waits for all of them. First failure is rethrown
+  void SyncAll(const std::vector<std::string>& paths);
+};
+
 class FSDirectory: public BaseDirectory {
+ public:
+  class SyncStats {
+   public:
+    // Number of Sync calls with at least one name
+    uint64_t sync_calls;
+    // Number of group syncs actually issued, concurrent Sync calls share one
+    uint64_t group_syncs;
+    // Files flushed by fsync, duplicates within a group count once
+    uint64_t synced_files;
+    // Group syncs done with one syncfs instead of per file fsync
+    uint64_t syncfs_calls;
+    uint64_t metadata_syncs;
+    uint64_t total_sync_nanos;
+    uint64_t max_sync_nanos;
+
+    SyncStats()
+      : sync_calls(0),
+        group_syncs(0),
+        synced_files(0),
+        syncfs_calls(0),
+        metadata_syncs(0),
+        total_sync_nanos(0),
+        max_sync_nanos(0) {
+    }
+  };
+
+ private:
+  // Names collected from concurrent Sync calls, flushed by one leader
+  class SyncGroup {
+   public:
+    std::set<std::string> names;
+    bool done;
+    std::exception_ptr error;
+
+    SyncGroup()
+      : names(),
+        done(false),
+        error() {
+    }
+  };
+
  protected:
   std::string directory;
 
  private:
-  // TODO(0ctopus13prime): It's not thread safe. Make it thread safe
-  std::set<std::string> pending_deletes;
-  std::atomic<std::uint32_t> ops_since_last_delete;
+  // Deleted names wait here until the background thread unlinks them
+  std::unique_ptr<PendingDeleter> pending_deleter;
   std::atomic<std::uint32_t> next_temp_file_counter;
+  std::shared_ptr<WriteBehindFlusher> write_behind_flusher;
+  std::shared_ptr<RateLimiter> merge_rate_limiter;
+  uint64_t direct_io_min_merge_bytes;
+  std::shared_ptr<std::atomic<uint64_t>> direct_written_bytes;
+  std::shared_ptr<std::atomic<uint64_t>> buffered_written_bytes;
+  // Guarded by `sync_mutex`, a running group sync holds its own reference
+  std::shared_ptr<FsyncPool> fsync_pool;
+  uint32_t syncfs_min_files;
+  std::mutex sync_mutex;
+  std::condition_variable sync_cond;
+  std::shared_ptr<SyncGroup> open_sync_group;
+  bool sync_running;
+  SyncStats sync_stats;
 
  private:
-  void MaybeDeletePendingFiles();
+  // Flushes every file in the group, called by the group leader only
+  void SyncGroupFiles(const SyncGroup& group);
 
-  void PrivateDeleteFile(const std::string& name,
-                         const bool is_pending_delete);
+  std::unique_ptr<IndexOutput>
+  MaybeRateLimit(std::unique_ptr<IndexOutput>&& output,
+                 const IOContext& context);
 
  protected:
   FSDirectory(const std::string path,
@@ -144,6 +255,20 @@ class FSDirectory: public BaseDirectory {
 
   void EnsureCanRead(const std::string& name);
 
+  // A merge past the O_DIRECT threshold, see SetDirectIOMergeThreshold
+  bool IsDirectIOMerge(const IOContext& context) const noexcept {
+    return (direct_io_min_merge_bytes > 0 &&
+            context.context == IOContext::Context::MERGE &&
+            context.merge_info.estimate_merge_bytes >=
+            direct_io_min_merge_bytes);
+  }
+
+  // Every output handed out by CreateOutput and CreateTempOutput is made here
+  virtual std::unique_ptr<IndexOutput>
+  NewIndexOutput(const std::string& name,
+                 const std::string& path,
+                 const IOContext& context);
+
  public:
   static std::vector<std::string>
   ListAllWithSkipNames(const std::string& dir,
@@ -163,26 +288,176 @@ class FSDirectory: public BaseDirectory {
                                                 const std::string& suffix,
                                                 const IOContext& context);
 
+  /**
+   * Concurrent calls are coalesced. The first caller becomes the leader and
+   * flushes every name queued while the previous group was in flight, the
+   * others just wait for the group their names went into.
+   */
   void Sync(const std::vector<std::string>& names);
 
   void Rename(const std::string& source, const std::string& dest);
 
+  /**
+   * Between two FSDirectories the kernel does the copy, see
+   * FileUtil::CopyFile. Throttled merges and other directories go through
+   * the buffered copy.
+   */
+  void CopyFrom(Directory& from,
+                const std::string& src,
+                const std::string& dest,
+                const IOContext& context);
+
   void SyncMetaData();
 
   void Close();
 
   const std::string& GetDirectory();
 
+  // Only queues the file, it is unlinked on a background thread
   void DeleteFile(const std::string& name);
 
+  // Returns true if some files could not be deleted yet
   bool CheckPendingDeletions();
 
+  // Tries every pending file once in the calling thread
   void DeletePendingFiles();
+
+  std::vector<std::string> ListPendingDeletes() {
+    return pending_deleter->ListPending();
+  }
+
+  PendingDeleter::Stats GetPendingDeleteStats() {
+    return pending_deleter->GetStats();
+  }
+
+  // Outputs created after this call hand full buffers to a background writer
+  void SetWriteBehind(const bool new_write_behind);
+
+  bool IsWriteBehind() const noexcept {
+    return static_cast<bool>(write_behind_flusher);
+  }
+
+  /**
+   * Outputs created with MERGE context are throttled by given limiter.
+   * Share one limiter between directories to cap their merges together.
+   * Null turns throttling off.
+   */
+  void SetMergeRateLimiter(const std::shared_ptr<RateLimiter>& rate_limiter) {
+    merge_rate_limiter = rate_limiter;
+  }
+
+  const std::shared_ptr<RateLimiter>& GetMergeRateLimiter() const noexcept {
+    return merge_rate_limiter;
+  }
+
+  /**
+   * Merges expected to write at least `min_merge_bytes` use O_DIRECT
+   * outputs, so they do not push hot pages out of the page cache.
+   * Zero turns it off, which is the default.
+   */
+  void SetDirectIOMergeThreshold(const uint64_t min_merge_bytes) noexcept {
+    direct_io_min_merge_bytes = min_merge_bytes;
+  }
+
+  uint64_t GetDirectIOMergeThreshold() const noexcept {
+    return direct_io_min_merge_bytes;
+  }
+
+  // Bytes written by closed outputs that bypassed the page cache
+  uint64_t GetDirectWrittenBytes() const noexcept {
+    return direct_written_bytes->load(std::memory_order_relaxed);
+  }
+
+  // Bytes written by closed outputs through the page cache
+  uint64_t GetBufferedWrittenBytes() const noexcept {
+    return buffered_written_bytes->load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Sync fsyncs files on `num_threads` threads. Zero or one keeps fsync in
+   * the calling thread, which is the default.
+   */
+  void SetSyncThreads(const uint32_t num_threads);
+
+  // Share one pool among directories on a same device
+  void SetFsyncPool(const std::shared_ptr<FsyncPool>& pool);
+
+  std::shared_ptr<FsyncPool> GetFsyncPool();
+
+  /**
+   * A group sync of at least `min_files` files is done with one syncfs on
+   * the whole filesystem. It pays off on a dedicated index volume, but also
+   * flushes dirty data of every other file there. Zero turns it off.
+   */
+  void SetSyncFsThreshold(const uint32_t min_files) noexcept {
+    syncfs_min_files = min_files;
+  }
+
+  uint32_t GetSyncFsThreshold() const noexcept {
+    return syncfs_min_files;
+  }
+
+  SyncStats GetSyncStats();
 };
 
 class MMapDirectory: public FSDirectory {
+ public:
+  enum class ReadAdvice {
+    NORMAL, SEQUENTIAL, RANDOM
+  };
+
+  class MapPolicy {
+   public:
+    ReadAdvice advice;
+    // Prefault every page with MAP_POPULATE at map time
+    bool populate;
+    // Ask for transparent huge pages with MADV_HUGEPAGE
+    bool huge_page;
+
+    MapPolicy()
+      : MapPolicy(ReadAdvice::NORMAL, false, false) {
+    }
+
+    MapPolicy(const ReadAdvice advice,
+              const bool populate,
+              const bool huge_page)
+      : advice(advice),
+        populate(populate),
+        huge_page(huge_page) {
+    }
+  };
+
+  class WarmUpStats {
+   public:
+    uint32_t files;
+    uint64_t bytes;
+    // Bytes pinned with mlock, less than `bytes` when RLIMIT_MEMLOCK is hit
+    uint64_t locked_bytes;
+    uint64_t nanos;
+    // False while a warm up is running
+    bool completed;
+
+    WarmUpStats()
+      : files(0),
+        bytes(0),
+        locked_bytes(0),
+        nanos(0),
+        completed(false) {
+    }
+  };
+
  private:
+  // Pages are touched in chunks of this size, one chunk per task
+  static const uint64_t WARM_UP_CHUNK_SIZE = 4 * 1024 * 1024;
+
   bool preload;
+  // Policies can change while other threads open inputs
+  mutable std::shared_mutex policy_mutex;
+  std::map<std::string, MapPolicy> extension_policies;
+  std::mutex warm_up_mutex;
+  // Locked mappings, kept until ReleaseWarmUp so pages stay resident
+  std::vector<std::shared_ptr<MappedRegion>> locked_regions;
+  WarmUpStats warm_up_stats;
 
  public:
   explicit MMapDirectory(const std::string& path);
@@ -190,6 +465,22 @@ class MMapDirectory: public FSDirectory {
   MMapDirectory(const std::string& path,
                 const std::shared_ptr<LockFactory>& lock_factory);
 
+  /**
+   * Overrides the mapping policy of files with given extension.
+   * By default term dictionaries (tim, tip) and doc values (dvd) are
+   * read randomly, so readahead is turned off for them.
+   */
+  void SetExtensionPolicy(const std::string& ext, const MapPolicy& policy);
+
+  void RemoveExtensionPolicy(const std::string& ext);
+
+  /**
+   * Extension policy comes first. MERGE and READONCE contexts read the whole
+   * file once from start to end, so they always get sequential advice.
+   */
+  MapPolicy GetMapPolicy(const std::string& name,
+                         const IOContext& context) const;
+
   void SetPreLoad(const bool new_preload) noexcept {
     preload = new_preload;
   }
@@ -198,6 +489,96 @@ class MMapDirectory: public FSDirectory {
     return preload;
   }
 
+  /**
+   * Faults in every page of the files with given extensions, all files if
+   * empty, on `num_threads` threads (hardware concurrency if 0) and returns
+   * once they are resident. With `lock`, pages are also pinned with mlock
+   * until ReleaseWarmUp or Close. Unlike SetPreLoad, which only hints the
+   * kernel, this blocks so a node can wait for it before serving.
+   */
+  WarmUpStats WarmUp(const std::set<std::string>& extensions,
+                     const uint32_t num_threads = 0,
+                     const bool lock = false);
+
+  // Stats of the last warm up, can be polled while one is running
+  WarmUpStats GetWarmUpStats();
+
+  // Unlocks and unmaps pages pinned by WarmUp
+  void ReleaseWarmUp();
+
+  std::unique_ptr<IndexInput> OpenInput(const std::string& name,
+                                        const IOContext& context);
+
+  void Close();
+};
+
+class IoUringDirectory: public FSDirectory {
+ private:
+  std::shared_ptr<IoUring> ring;
+
+ protected:
+  std::unique_ptr<IndexOutput> NewIndexOutput(const std::string& name,
+                                              const std::string& path,
+                                              const IOContext& context);
+
+ public:
+  explicit IoUringDirectory(const std::string& path);
+
+  IoUringDirectory(const std::string& path,
+                   const std::shared_ptr<LockFactory>& lock_factory);
+
+  IoUringDirectory(const std::string& path,
+                   const std::shared_ptr<LockFactory>& lock_factory,
+                   const std::shared_ptr<IoUring>& ring);
+
+  // False when the kernel refused io_uring and I/O is done synchronously
+  bool IsAsync() const noexcept;
+
+  std::unique_ptr<IndexInput> OpenInput(const std::string& name,
+                                        const IOContext& context);
+};
+
+/**
+ * Reads files with pread instead of mapping them, for when address space
+ * or a memory cgroup is too tight for mmap. Inputs share one descriptor
+ * per open and never share a file pointer, clones and slices included.
+ * With a BlockCache, every open of a same file shares cached blocks until
+ * the name is deleted, renamed or written again.
+ */
+class PReadDirectory: public FSDirectory {
+ private:
+  std::shared_ptr<BlockCache> cache;
+  std::mutex file_ids_mutex;
+  // Cache id of each name opened so far
+  std::map<std::string, uint64_t> file_ids;
+
+ private:
+  uint64_t GetFileId(const std::string& name);
+
+  void ForgetFileId(const std::string& name);
+
+ public:
+  explicit PReadDirectory(const std::string& path);
+
+  PReadDirectory(const std::string& path,
+                 const std::shared_ptr<LockFactory>& lock_factory);
+
+  // `cache` can be null, and can be shared by many directories
+  PReadDirectory(const std::string& path,
+                 const std::shared_ptr<LockFactory>& lock_factory,
+                 const std::shared_ptr<BlockCache>& cache);
+
+  const std::shared_ptr<BlockCache>& GetBlockCache() const noexcept {
+    return cache;
+  }
+
+  std::unique_ptr<IndexOutput>
+  CreateOutput(const std::string& name, const IOContext& context);
+
+  void Rename(const std::string& source, const std::string& dest);
+
+  void DeleteFile(const std::string& name);
+
   std::unique_ptr<IndexInput> OpenInput(const std::string& name,
                                         const IOContext& context);
 };
@@ -0,0 +1,180 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <Index/File.h>
+#include <Store/FileSwitchDirectory.h>
+#include <Util/Exception.h>
+#include <algorithm>
+#include <exception>
+#include <set>
+
+using lucene::core::index::IndexFileNames;
+using lucene::core::store::Directory;
+using lucene::core::store::FileSwitchDirectory;
+using lucene::core::store::IndexInput;
+using lucene::core::store::IndexOutput;
+using lucene::core::store::Lock;
+using lucene::core::util::IOException;
+
+/**
+ *  FileSwitchDirectory
+ */
+FileSwitchDirectory::FileSwitchDirectory(
+  const std::shared_ptr<Directory>& default_directory,
+  const std::map<std::string, std::shared_ptr<Directory>>& routes)
+  : Directory(),
+    default_directory(default_directory),
+    routes(routes),
+    directories{default_directory} {
+  for (const auto& route : routes) {
+    if (std::find(directories.begin(),
+                  directories.end(),
+                  route.second) == directories.end()) {
+      directories.push_back(route.second);
+    }
+  }
+}
+
+std::string FileSwitchDirectory::RoutingExtension(const std::string& name) {
+  std::string ext = IndexFileNames::GetExtension(name);
+  if (ext != "tmp") {
+    return ext;
+  }
+
+  // Temp file is named as <prefix>_<suffix>_<counter>.tmp
+  const size_t counter_idx = name.rfind('_', name.rfind('.'));
+  if (counter_idx == std::string::npos || counter_idx == 0) {
+    return ext;
+  }
+
+  const size_t suffix_idx = name.rfind('_', counter_idx - 1);
+  if (suffix_idx == std::string::npos) {
+    return ext;
+  }
+
+  return name.substr(suffix_idx + 1, counter_idx - suffix_idx - 1);
+}
+
+const std::shared_ptr<Directory>&
+FileSwitchDirectory::GetDirectoryByExtension(const std::string& ext) const {
+  auto it = routes.find(ext);
+  if (it == routes.end()) {
+    return default_directory;
+  }
+
+  return it->second;
+}
+
+const std::shared_ptr<Directory>&
+FileSwitchDirectory::GetDirectory(const std::string& name) const {
+  return GetDirectoryByExtension(RoutingExtension(name));
+}
+
+std::vector<std::string> FileSwitchDirectory::ListAll() {
+  std::set<std::string> names;
+  for (const std::shared_ptr<Directory>& dir : directories) {
+    for (const std::string& name : dir->ListAll()) {
+      if (GetDirectory(name) == dir) {
+        names.insert(name);
+      }
+    }
+  }
+
+  return std::vector<std::string>(names.begin(), names.end());
+}
+
+void FileSwitchDirectory::DeleteFile(const std::string& name) {
+  GetDirectory(name)->DeleteFile(name);
+}
+
+uint64_t FileSwitchDirectory::FileLength(const std::string& name) {
+  return GetDirectory(name)->FileLength(name);
+}
+
+std::unique_ptr<IndexOutput>
+FileSwitchDirectory::CreateOutput(const std::string& name,
+                                  const IOContext& context) {
+  return GetDirectory(name)->CreateOutput(name, context);
+}
+
+std::unique_ptr<IndexOutput>
+FileSwitchDirectory::CreateTempOutput(const std::string& prefix,
+                                      const std::string& suffix,
+                                      const IOContext& context) {
+  return GetDirectoryByExtension(suffix)->CreateTempOutput(prefix,
+                                                           suffix,
+                                                           context);
+}
+
+void FileSwitchDirectory::Sync(const std::vector<std::string>& names) {
+  for (const std::shared_ptr<Directory>& dir : directories) {
+    std::vector<std::string> dir_names;
+    for (const std::string& name : names) {
+      if (GetDirectory(name) == dir) {
+        dir_names.push_back(name);
+      }
+    }
+
+    if (!dir_names.empty()) {
+      dir->Sync(dir_names);
+    }
+  }
+}
+
+void FileSwitchDirectory::Rename(const std::string& source,
+                                 const std::string& dest) {
+  const std::shared_ptr<Directory>& dir = GetDirectory(source);
+  if (dir != GetDirectory(dest)) {
+    throw IOException("Can not rename " + source + " to " + dest +
+                      " atomically, they belong to different directories");
+  }
+
+  dir->Rename(source, dest);
+}
+
+void FileSwitchDirectory::SyncMetaData() {
+  for (const std::shared_ptr<Directory>& dir : directories) {
+    dir->SyncMetaData();
+  }
+}
+
+std::unique_ptr<IndexInput>
+FileSwitchDirectory::OpenInput(const std::string& name,
+                               const IOContext& context) {
+  return GetDirectory(name)->OpenInput(name, context);
+}
+
+std::unique_ptr<Lock> FileSwitchDirectory::ObtainLock(const std::string& name) {
+  return default_directory->ObtainLock(name);
+}
+
+void FileSwitchDirectory::Close() {
+  std::exception_ptr first_error;
+  for (const std::shared_ptr<Directory>& dir : directories) {
+    try {
+      dir->Close();
+    } catch(...) {
+      if (!first_error) {
+        first_error = std::current_exception();
+      }
+    }
+  }
+
+  if (first_error) {
+    std::rethrow_exception(first_error);
+  }
+}
@@ -0,0 +1,106 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_FILESWITCHDIRECTORY_H_
+#define SRC_STORE_FILESWITCHDIRECTORY_H_
+
+#include <Store/Directory.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * Routes each file to one of several directories by its extension, so that
+ * latency critical files (e.g. term dictionary, doc values) can live on
+ * fast media while bulky ones (e.g. stored fields) go somewhere cheaper.
+ * Files whose extension has no route go to the default directory, and so
+ * does the write lock.
+ * A temp file is routed by the `suffix` it was created with, so renaming it
+ * to its final name stays within one directory. Renaming a file into a
+ * different directory is not atomic, hence not supported.
+ * Underlying directories may share a path, ListAll only reports a file from
+ * the directory it is routed to.
+ */
+class FileSwitchDirectory: public Directory {
+ private:
+  std::shared_ptr<Directory> default_directory;
+  std::map<std::string, std::shared_ptr<Directory>> routes;
+  // Distinct directories, default one comes first
+  std::vector<std::shared_ptr<Directory>> directories;
+
+ private:
+  static std::string RoutingExtension(const std::string& name);
+
+  const std::shared_ptr<Directory>&
+  GetDirectoryByExtension(const std::string& ext) const;
+
+ public:
+  /**
+   * `routes` maps an extension without the leading dot (e.g. "tim") to the
+   * directory that stores files with it.
+   */
+  FileSwitchDirectory(
+    const std::shared_ptr<Directory>& default_directory,
+    const std::map<std::string, std::shared_ptr<Directory>>& routes);
+
+  const std::shared_ptr<Directory>& GetDefaultDirectory() const noexcept {
+    return default_directory;
+  }
+
+  // Directory a file with given name is read from and written to
+  const std::shared_ptr<Directory>&
+  GetDirectory(const std::string& name) const;
+
+  std::vector<std::string> ListAll();
+
+  void DeleteFile(const std::string& name);
+
+  uint64_t FileLength(const std::string& name);
+
+  std::unique_ptr<IndexOutput>
+  CreateOutput(const std::string& name, const IOContext& context);
+
+  std::unique_ptr<IndexOutput> CreateTempOutput(const std::string& prefix,
+                                                const std::string& suffix,
+                                                const IOContext& context);
+
+  // Each directory syncs only the files routed to it
+  void Sync(const std::vector<std::string>& names);
+
+  void Rename(const std::string& source, const std::string& dest);
+
+  void SyncMetaData();
+
+  std::unique_ptr<IndexInput> OpenInput(const std::string& name,
+                                        const IOContext& context);
+
+  std::unique_ptr<Lock> ObtainLock(const std::string& name);
+
+  // Closes every underlying directory, the first failure is rethrown
+  void Close();
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_FILESWITCHDIRECTORY_H_
@@ -0,0 +1,461 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <Store/Exception.h>
+#include <Store/HandlePool.h>
+#include <Util/Exception.h>
+#include <algorithm>
+#include <utility>
+
+using lucene::core::store::AlreadyClosedException;
+using lucene::core::store::Directory;
+using lucene::core::store::HandlePool;
+using lucene::core::store::HandlePoolDirectory;
+using lucene::core::store::IndexInput;
+using lucene::core::store::IndexOutput;
+using lucene::core::store::IOContext;
+using lucene::core::store::Lock;
+using lucene::core::store::PooledHandle;
+using lucene::core::store::PooledIndexInput;
+using lucene::core::util::EOFException;
+using lucene::core::util::IllegalArgumentException;
+using lucene::core::util::IOException;
+
+namespace {
+
+// Evicted inputs are closed outside of the pool mutex, unmapping can be slow
+void CloseEvicted(std::vector<std::unique_ptr<IndexInput>>& evicted) {
+  for (std::unique_ptr<IndexInput>& input : evicted) {
+    try {
+      input->Close();
+    } catch(...) {
+      // Ignore
+    }
+  }
+  evicted.clear();
+}
+
+}  // namespace
+
+/**
+ *  PooledHandle
+ */
+PooledHandle::PooledHandle(const std::shared_ptr<HandlePool>& pool,
+                           const std::shared_ptr<Directory>& delegate,
+                           const std::string& name,
+                           const IOContext& context,
+                           std::unique_ptr<IndexInput>&& input)
+  : pool(pool),
+    delegate(delegate),
+    name(name),
+    context(context),
+    length(input->Length()),
+    mutex(),
+    input(std::forward<std::unique_ptr<IndexInput>>(input)),
+    cursors_mutex(),
+    cursors(),
+    referenced(false),
+    last_used(0),
+    in_pool(false),
+    pool_index(0) {
+  std::unique_lock<std::shared_mutex> guard(mutex);
+  pool->Register(this, false);
+}
+
+PooledHandle::~PooledHandle() {
+  pool->Unregister(this);
+  // Slices first, the input may take the mapping down with it
+  cursors.clear();
+  if (input) {
+    try {
+      input->Close();
+    } catch(...) {
+      // Ignore
+    }
+  }
+}
+
+void PooledHandle::Reopen() {
+  std::unique_lock<std::shared_mutex> guard(mutex);
+  if (input) {
+    return;
+  }
+
+  std::unique_ptr<IndexInput> reopened = delegate->OpenInput(name, context);
+  if (reopened->Length() != length) {
+    reopened->Close();
+    throw IOException("File changed since it was opened: " + name);
+  }
+
+  input = std::move(reopened);
+  pool->Register(this, true);
+}
+
+std::unique_ptr<IndexInput> PooledHandle::TakeCursor() {
+  {
+    std::lock_guard<std::mutex> guard(cursors_mutex);
+    if (!cursors.empty()) {
+      std::unique_ptr<IndexInput> cursor = std::move(cursors.back());
+      cursors.pop_back();
+      return cursor;
+    }
+  }
+
+  // More readers than ever before, `input` itself is never read through
+  return input->Slice("cursor", 0, length);
+}
+
+void PooledHandle::GiveBackCursor(std::unique_ptr<IndexInput>&& cursor) {
+  std::lock_guard<std::mutex> guard(cursors_mutex);
+  cursors.push_back(std::move(cursor));
+}
+
+void PooledHandle::Read(const uint64_t pos,
+                        char* dst,
+                        const uint32_t len) {
+  std::shared_lock<std::shared_mutex> guard(mutex);
+  // Evicted again before we got back in, rare enough to just retry
+  while (!input) {
+    guard.unlock();
+    Reopen();
+    guard.lock();
+  }
+
+  referenced.store(true, std::memory_order_relaxed);
+  last_used.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+                  std::memory_order_relaxed);
+
+  // Dropped if the read throws, the next reader slices a fresh one
+  std::unique_ptr<IndexInput> cursor = TakeCursor();
+  cursor->Seek(pos);
+  cursor->ReadBytes(dst, 0, len);
+  GiveBackCursor(std::move(cursor));
+}
+
+void PooledHandle::Prefetch(const uint64_t pos,
+                            const uint64_t prefetch_length) {
+  // Only a hint, an evicted file is not reopened for it
+  std::shared_lock<std::shared_mutex> guard(mutex);
+  if (input) {
+    input->Prefetch(pos, prefetch_length);
+  }
+}
+
+bool PooledHandle::IsOpen() {
+  std::shared_lock<std::shared_mutex> guard(mutex);
+  return static_cast<bool>(input);
+}
+
+/**
+ *  HandlePool
+ */
+const uint32_t HandlePool::DEFAULT_MAX_OPEN;
+
+std::shared_ptr<HandlePool> HandlePool::GetDefault() {
+  static std::shared_ptr<HandlePool> default_pool =
+  std::make_shared<HandlePool>(DEFAULT_MAX_OPEN);
+  return default_pool;
+}
+
+HandlePool::HandlePool(const uint32_t max_open)
+  : mutex(),
+    max_open(std::max(1U, max_open)),
+    handles(),
+    clock_hand(0),
+    stats() {
+}
+
+void HandlePool::Register(PooledHandle* handle, const bool reopen) {
+  std::vector<std::unique_ptr<IndexInput>> evicted;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    handle->pool_index = handles.size();
+    handle->in_pool = true;
+    handles.push_back(handle);
+    handle->referenced.store(true, std::memory_order_relaxed);
+    handle->last_used.store(
+      std::chrono::steady_clock::now().time_since_epoch().count(),
+      std::memory_order_relaxed);
+    stats.opens++;
+    if (reopen) {
+      stats.reopens++;
+    }
+
+    EvictOverflow(handle, evicted);
+  }
+
+  CloseEvicted(evicted);
+}
+
+void HandlePool::Unregister(PooledHandle* handle) {
+  std::lock_guard<std::mutex> guard(mutex);
+  Remove(handle);
+}
+
+void HandlePool::Remove(PooledHandle* handle) {
+  if (handle->in_pool) {
+    PooledHandle* last = handles.back();
+    handles[handle->pool_index] = last;
+    last->pool_index = handle->pool_index;
+    handles.pop_back();
+    handle->in_pool = false;
+  }
+}
+
+bool HandlePool::TryEvict(PooledHandle* victim,
+                          std::vector<std::unique_ptr<IndexInput>>& evicted) {
+  // A handle being read or reopened holds its mutex, it is skipped rather
+  // than waited for. Waiting would deadlock with a reopen waiting on the
+  // pool mutex
+  std::unique_lock<std::shared_mutex> victim_lock(victim->mutex,
+                                                  std::try_to_lock);
+  if (!victim_lock.owns_lock()) {
+    return false;
+  }
+
+  // Nobody reads, so every cursor is back. Slices go before the input
+  for (std::unique_ptr<IndexInput>& cursor : victim->cursors) {
+    evicted.push_back(std::move(cursor));
+  }
+  victim->cursors.clear();
+  evicted.push_back(std::move(victim->input));
+  Remove(victim);
+  stats.evictions++;
+  return true;
+}
+
+void HandlePool::EvictOverflow(
+                 PooledHandle* keep,
+                 std::vector<std::unique_ptr<IndexInput>>& evicted) {
+  // Two full turns clear every referenced bit, a busy handle can still hold
+  // the pool past `max_open` until the next sweep
+  uint64_t steps = 2 * static_cast<uint64_t>(handles.size());
+  while (handles.size() > max_open && steps-- > 0) {
+    if (clock_hand >= handles.size()) {
+      clock_hand = 0;
+    }
+
+    // Second chance, a handle read since the last sweep survives this one
+    PooledHandle* victim = handles[clock_hand];
+    if (victim != keep &&
+        !victim->referenced.exchange(false, std::memory_order_relaxed) &&
+        TryEvict(victim, evicted)) {
+      // The last handle moved under the hand
+      continue;
+    }
+
+    clock_hand++;
+  }
+}
+
+void HandlePool::SetMaxOpen(const uint32_t new_max_open) {
+  std::vector<std::unique_ptr<IndexInput>> evicted;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    max_open = std::max(1U, new_max_open);
+    EvictOverflow(nullptr, evicted);
+  }
+
+  CloseEvicted(evicted);
+}
+
+uint32_t HandlePool::GetMaxOpen() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return max_open;
+}
+
+uint32_t HandlePool::EvictIdle(const std::chrono::nanoseconds max_idle) {
+  std::vector<std::unique_ptr<IndexInput>> evicted;
+  uint32_t num_evicted = 0;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    const auto deadline = std::chrono::steady_clock::now() - max_idle;
+    const auto deadline_count = deadline.time_since_epoch().count();
+    uint32_t i = 0;
+    while (i < handles.size()) {
+      PooledHandle* handle = handles[i];
+      if (handle->last_used.load(std::memory_order_relaxed) <= deadline_count &&
+          TryEvict(handle, evicted)) {
+        // The last handle moved into `i`
+        num_evicted++;
+      } else {
+        i++;
+      }
+    }
+  }
+
+  CloseEvicted(evicted);
+  return num_evicted;
+}
+
+HandlePool::Stats HandlePool::GetStats() {
+  std::lock_guard<std::mutex> guard(mutex);
+  Stats snapshot(stats);
+  snapshot.open_handles = handles.size();
+  return snapshot;
+}
+
+/**
+ *  PooledIndexInput
+ */
+PooledIndexInput::PooledIndexInput(const std::string& resource_desc,
+                                   const std::shared_ptr<PooledHandle>& handle,
+                                   const IOContext& context)
+  : BufferedIndexInput(resource_desc, context),
+    handle(handle),
+    start_offset(0),
+    length(handle->Length()) {
+}
+
+PooledIndexInput::PooledIndexInput(const std::string& resource_desc,
+                                   const PooledIndexInput& parent,
+                                   const uint64_t start_offset,
+                                   const uint64_t length)
+  : BufferedIndexInput(resource_desc, parent.GetBufferSize()),
+    handle(parent.handle),
+    start_offset(start_offset),
+    length(length) {
+}
+
+std::unique_ptr<PooledIndexInput> PooledIndexInput::Clone() {
+  std::unique_ptr<PooledIndexInput> clone(
+    new PooledIndexInput(resource_desc, *this, start_offset, length));
+  clone->Seek(GetFilePointer());
+  return clone;
+}
+
+std::unique_ptr<IndexInput>
+PooledIndexInput::Slice(const std::string& slice_desc,
+                        const uint64_t offset,
+                        const uint64_t slice_length) {
+  if (offset + slice_length > length) {
+    throw IllegalArgumentException("Slice out of bounds: offset=" +
+                                   std::to_string(offset) + ", length=" +
+                                   std::to_string(slice_length) + ": " +
+                                   resource_desc);
+  }
+
+  return std::unique_ptr<IndexInput>(
+    new PooledIndexInput(resource_desc + " [slice=" + slice_desc + ']',
+                         *this,
+                         start_offset + offset,
+                         slice_length));
+}
+
+void PooledIndexInput::ReadInternal(char bytes[],
+                                    const uint32_t offset,
+                                    const uint32_t len) {
+  if (!handle) {
+    throw AlreadyClosedException("Already closed: " + resource_desc);
+  }
+
+  const uint64_t pos = GetFilePointer();
+  if (pos + len > length) {
+    throw EOFException("Read past EOF: " + resource_desc);
+  }
+
+  handle->Read(start_offset + pos, bytes + offset, len);
+}
+
+void PooledIndexInput::Prefetch(const uint64_t offset,
+                                const uint64_t prefetch_length) {
+  if (handle && offset < length && prefetch_length > 0) {
+    handle->Prefetch(start_offset + offset,
+                     std::min(prefetch_length, length - offset));
+  }
+}
+
+void PooledIndexInput::Close() {
+  handle.reset();
+}
+
+/**
+ *  HandlePoolDirectory
+ */
+HandlePoolDirectory::HandlePoolDirectory(
+                     const std::shared_ptr<Directory>& delegate)
+  : HandlePoolDirectory(delegate, HandlePool::GetDefault()) {
+}
+
+HandlePoolDirectory::HandlePoolDirectory(
+                     const std::shared_ptr<Directory>& delegate,
+                     const std::shared_ptr<HandlePool>& pool)
+  : Directory(),
+    delegate(delegate),
+    pool(pool) {
+}
+
+std::vector<std::string> HandlePoolDirectory::ListAll() {
+  return delegate->ListAll();
+}
+
+void HandlePoolDirectory::DeleteFile(const std::string& name) {
+  delegate->DeleteFile(name);
+}
+
+uint64_t HandlePoolDirectory::FileLength(const std::string& name) {
+  return delegate->FileLength(name);
+}
+
+std::unique_ptr<IndexOutput>
+HandlePoolDirectory::CreateOutput(const std::string& name,
+                                  const IOContext& context) {
+  return delegate->CreateOutput(name, context);
+}
+
+std::unique_ptr<IndexOutput>
+HandlePoolDirectory::CreateTempOutput(const std::string& prefix,
+                                      const std::string& suffix,
+                                      const IOContext& context) {
+  return delegate->CreateTempOutput(prefix, suffix, context);
+}
+
+void HandlePoolDirectory::Sync(const std::vector<std::string>& names) {
+  delegate->Sync(names);
+}
+
+void HandlePoolDirectory::Rename(const std::string& source,
+                                 const std::string& dest) {
+  delegate->Rename(source, dest);
+}
+
+void HandlePoolDirectory::SyncMetaData() {
+  delegate->SyncMetaData();
+}
+
+std::unique_ptr<IndexInput>
+HandlePoolDirectory::OpenInput(const std::string& name,
+                               const IOContext& context) {
+  std::shared_ptr<PooledHandle> handle =
+  std::make_shared<PooledHandle>(pool,
+                                 delegate,
+                                 name,
+                                 context,
+                                 delegate->OpenInput(name, context));
+  return std::make_unique<PooledIndexInput>(
+         std::string("PooledIndexInput(") + name + ')',
+         handle,
+         context);
+}
+
+std::unique_ptr<Lock> HandlePoolDirectory::ObtainLock(const std::string& name) {
+  return delegate->ObtainLock(name);
+}
+
+void HandlePoolDirectory::Close() {
+  delegate->Close();
+}
@@ -0,0 +1,280 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_HANDLEPOOL_H_
+#define SRC_STORE_HANDLEPOOL_H_
+
+#include <Store/DataInput.h>
+#include <Store/Directory.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+class HandlePool;
+
+/**
+ * One file opened through a HandlePoolDirectory. It owns the delegate's
+ * input (a mapping or a descriptor) only while the pool lets it, and opens
+ * it again on the next read once evicted.
+ * Many threads read one file at once, each through a slice of the
+ * delegate's input of its own, so the delegate's slices must keep their own
+ * file pointer as mmap, pread and io_uring inputs do.
+ */
+class PooledHandle {
+ private:
+  friend class HandlePool;
+
+  std::shared_ptr<HandlePool> pool;
+  std::shared_ptr<Directory> delegate;
+  const std::string name;
+  const IOContext context;
+  const uint64_t length;
+  // Shared while reading, exclusive to reopen or evict `input`
+  std::shared_mutex mutex;
+  std::unique_ptr<IndexInput> input;
+  // Idle slices of `input`. `cursors_mutex` is only held to take or give
+  // one back, never across a read
+  std::mutex cursors_mutex;
+  std::vector<std::unique_ptr<IndexInput>> cursors;
+  // Set by reads and cleared by the pool's clock hand, without any lock
+  std::atomic<bool> referenced;
+  std::atomic<std::chrono::steady_clock::rep> last_used;
+  // Guarded by the pool, `pool_index` is valid while `in_pool`
+  bool in_pool;
+  uint32_t pool_index;
+
+ private:
+  // Opens the file again unless another reader already did
+  void Reopen();
+
+  std::unique_ptr<IndexInput> TakeCursor();
+
+  void GiveBackCursor(std::unique_ptr<IndexInput>&& cursor);
+
+ public:
+  PooledHandle(const std::shared_ptr<HandlePool>& pool,
+               const std::shared_ptr<Directory>& delegate,
+               const std::string& name,
+               const IOContext& context,
+               std::unique_ptr<IndexInput>&& input);
+
+  PooledHandle(const PooledHandle& other) = delete;
+
+  PooledHandle& operator=(const PooledHandle& other) = delete;
+
+  ~PooledHandle();
+
+  uint64_t Length() const noexcept {
+    return length;
+  }
+
+  const std::string& GetName() const noexcept {
+    return name;
+  }
+
+  // Reopens the file first if it was evicted
+  void Read(const uint64_t pos, char* dst, const uint32_t len);
+
+  void Prefetch(const uint64_t pos, const uint64_t prefetch_length);
+
+  bool IsOpen();
+};
+
+/**
+ * Caps the number of files, and so mappings and descriptors, held open by
+ * every HandlePoolDirectory sharing it. Past the cap, a file not read
+ * since the last sweep is closed, picked with CLOCK (second chance) like
+ * BlockCache, so reads never take the pool lock. Files in the middle of a
+ * read are never closed.
+ */
+class HandlePool {
+ public:
+  static const uint32_t DEFAULT_MAX_OPEN = 4096;
+
+  class Stats {
+   public:
+    uint32_t open_handles;
+    uint64_t opens;
+    // Opens of a file that had been evicted before
+    uint64_t reopens;
+    uint64_t evictions;
+
+    Stats()
+      : open_handles(0),
+        opens(0),
+        reopens(0),
+        evictions(0) {
+    }
+  };
+
+ private:
+  std::mutex mutex;
+  uint32_t max_open;
+  // Open handles in no particular order, swept by `clock_hand`
+  std::vector<PooledHandle*> handles;
+  uint32_t clock_hand;
+  Stats stats;
+
+ private:
+  friend class PooledHandle;
+
+  // Called with the handle's mutex held exclusively
+  void Register(PooledHandle* handle, const bool reopen);
+
+  void Unregister(PooledHandle* handle);
+
+  // Drops `handle` from `handles`, moving the last handle into its place.
+  // Pool mutex held
+  void Remove(PooledHandle* handle);
+
+  // Takes the inputs of `victim` and removes it unless it is being read.
+  // Pool mutex held
+  bool TryEvict(PooledHandle* victim,
+                std::vector<std::unique_ptr<IndexInput>>& evicted);
+
+  // Evicts handles not read since the hand last passed them while past
+  // `max_open`, but `keep`
+  void EvictOverflow(PooledHandle* keep,
+                     std::vector<std::unique_ptr<IndexInput>>& evicted);
+
+ public:
+  // Shared by every HandlePoolDirectory not given a pool of its own
+  static std::shared_ptr<HandlePool> GetDefault();
+
+  explicit HandlePool(const uint32_t max_open);
+
+  HandlePool(const HandlePool& other) = delete;
+
+  HandlePool& operator=(const HandlePool& other) = delete;
+
+  // Shrinking the cap evicts right away
+  void SetMaxOpen(const uint32_t new_max_open);
+
+  uint32_t GetMaxOpen();
+
+  // Closes files not read for `max_idle`. Returns the number closed
+  uint32_t EvictIdle(const std::chrono::nanoseconds max_idle);
+
+  Stats GetStats();
+};
+
+class PooledIndexInput: public BufferedIndexInput {
+ private:
+  std::shared_ptr<PooledHandle> handle;
+  // Where this input (a slice possibly) starts in the file
+  uint64_t start_offset;
+  uint64_t length;
+
+ private:
+  PooledIndexInput(const std::string& resource_desc,
+                   const PooledIndexInput& parent,
+                   const uint64_t start_offset,
+                   const uint64_t length);
+
+ protected:
+  void SeekInternal(const uint64_t pos) { }
+
+  void ReadInternal(char bytes[], const uint32_t offset, const uint32_t len);
+
+ public:
+  PooledIndexInput(const std::string& resource_desc,
+                   const std::shared_ptr<PooledHandle>& handle,
+                   const IOContext& context);
+
+  // Clone shares the handle and starts at the same file pointer
+  std::unique_ptr<PooledIndexInput> Clone();
+
+  std::unique_ptr<IndexInput> Slice(const std::string& slice_desc,
+                                    const uint64_t offset,
+                                    const uint64_t slice_length);
+
+  void Prefetch(const uint64_t offset, const uint64_t prefetch_length);
+
+  uint64_t Length() {
+    return length;
+  }
+
+  void Close();
+};
+
+/**
+ * Wraps a directory so its inputs count against a HandlePool. For
+ * processes hosting many small indices, idle ones stop pinning address
+ * space and descriptors and are reopened on their next read.
+ * Files must not be deleted while pooled inputs of them are open, as an
+ * evicted file could not be opened again. Lucene only deletes files no
+ * reader refers to.
+ */
+class HandlePoolDirectory: public Directory {
+ private:
+  std::shared_ptr<Directory> delegate;
+  std::shared_ptr<HandlePool> pool;
+
+ public:
+  explicit HandlePoolDirectory(const std::shared_ptr<Directory>& delegate);
+
+  HandlePoolDirectory(const std::shared_ptr<Directory>& delegate,
+                      const std::shared_ptr<HandlePool>& pool);
+
+  const std::shared_ptr<Directory>& GetDelegate() const noexcept {
+    return delegate;
+  }
+
+  const std::shared_ptr<HandlePool>& GetPool() const noexcept {
+    return pool;
+  }
+
+  std::vector<std::string> ListAll();
+
+  void DeleteFile(const std::string& name);
+
+  uint64_t FileLength(const std::string& name);
+
+  std::unique_ptr<IndexOutput>
+  CreateOutput(const std::string& name, const IOContext& context);
+
+  std::unique_ptr<IndexOutput> CreateTempOutput(const std::string& prefix,
+                                                const std::string& suffix,
+                                                const IOContext& context);
+
+  void Sync(const std::vector<std::string>& names);
+
+  void Rename(const std::string& source, const std::string& dest);
+
+  void SyncMetaData();
+
+  std::unique_ptr<IndexInput> OpenInput(const std::string& name,
+                                        const IOContext& context);
+
+  std::unique_ptr<Lock> ObtainLock(const std::string& name);
+
+  void Close();
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_HANDLEPOOL_H_
@@ -0,0 +1,769 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <Store/Exception.h>
+#include <Store/IoUring.h>
+#include <Util/Exception.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+
+using lucene::core::store::AlreadyClosedException;
+using lucene::core::store::IndexInput;
+using lucene::core::store::IoUring;
+using lucene::core::store::IoUringIndexInput;
+using lucene::core::store::IoUringIndexOutput;
+using lucene::core::util::EOFException;
+using lucene::core::util::IllegalArgumentException;
+using lucene::core::util::IOException;
+
+namespace {
+
+int IoUringSetup(const uint32_t entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(const int ring_fd,
+                 const uint32_t to_submit,
+                 const uint32_t min_complete,
+                 const uint32_t flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter,
+                                  ring_fd,
+                                  to_submit,
+                                  min_complete,
+                                  flags,
+                                  nullptr,
+                                  0));
+}
+
+int IoUringRegister(const int ring_fd,
+                    const uint32_t opcode,
+                    const void* arg,
+                    const uint32_t nr_args) {
+  return static_cast<int>(syscall(__NR_io_uring_register,
+                                  ring_fd,
+                                  opcode,
+                                  arg,
+                                  nr_args));
+}
+
+}  // namespace
+
+/**
+ *  IoUring
+ */
+IoUring::IoUring()
+  : IoUring(IoUring::DEFAULT_QUEUE_DEPTH,
+            IoUring::DEFAULT_NUM_FIXED_BUFFERS,
+            IoUring::DEFAULT_FIXED_BUFFER_SIZE) {
+}
+
+IoUring::IoUring(const uint32_t queue_depth,
+                 const uint32_t num_fixed_buffers,
+                 const uint32_t fixed_buffer_size)
+  : ring_fd(-1),
+    sq_ring_ptr(MAP_FAILED),
+    sq_ring_size(0),
+    cq_ring_ptr(MAP_FAILED),
+    cq_ring_size(0),
+    sqes(nullptr),
+    sqes_size(0),
+    sq_head(nullptr),
+    sq_tail(nullptr),
+    sq_mask(nullptr),
+    sq_array(nullptr),
+    sq_entries(0),
+    cq_head(nullptr),
+    cq_tail(nullptr),
+    cq_mask(nullptr),
+    cqes(nullptr),
+    cq_entries(0),
+    plain_ops(false),
+    mutex(),
+    cond(),
+    reaping(false),
+    in_flight(0),
+    fixed_buffers(nullptr),
+    fixed_buffer_size(fixed_buffer_size),
+    free_fixed_buffers() {
+  SetUpRing(queue_depth);
+  if (IsAsync() && num_fixed_buffers > 0) {
+    RegisterFixedBuffers(num_fixed_buffers);
+  }
+}
+
+IoUring::~IoUring() {
+  if (fixed_buffers != nullptr) {
+    if (ring_fd >= 0) {
+      IoUringRegister(ring_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    }
+    std::free(fixed_buffers);
+  }
+
+  if (sqes != nullptr) {
+    munmap(sqes, sqes_size);
+  }
+
+  if (cq_ring_ptr != MAP_FAILED && cq_ring_ptr != sq_ring_ptr) {
+    munmap(cq_ring_ptr, cq_ring_size);
+  }
+
+  if (sq_ring_ptr != MAP_FAILED) {
+    munmap(sq_ring_ptr, sq_ring_size);
+  }
+
+  if (ring_fd >= 0) {
+    close(ring_fd);
+  }
+}
+
+void IoUring::SetUpRing(const uint32_t queue_depth) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+
+  const int fd = IoUringSetup(queue_depth, &params);
+  if (fd < 0) {
+    // No io_uring in this kernel (or it is disabled by seccomp).
+    // Stay in synchronous mode.
+    return;
+  }
+
+  sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+  if (single_mmap) {
+    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+  }
+
+  sq_ring_ptr = mmap(nullptr,
+                     sq_ring_size,
+                     PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE,
+                     fd,
+                     IORING_OFF_SQ_RING);
+  if (sq_ring_ptr == MAP_FAILED) {
+    close(fd);
+    return;
+  }
+
+  if (single_mmap) {
+    cq_ring_ptr = sq_ring_ptr;
+  } else {
+    cq_ring_ptr = mmap(nullptr,
+                       cq_ring_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,
+                       fd,
+                       IORING_OFF_CQ_RING);
+    if (cq_ring_ptr == MAP_FAILED) {
+      munmap(sq_ring_ptr, sq_ring_size);
+      sq_ring_ptr = MAP_FAILED;
+      close(fd);
+      return;
+    }
+  }
+
+  sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes_ptr = mmap(nullptr,
+                        sqes_size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE,
+                        fd,
+                        IORING_OFF_SQES);
+  if (sqes_ptr == MAP_FAILED) {
+    if (cq_ring_ptr != sq_ring_ptr) {
+      munmap(cq_ring_ptr, cq_ring_size);
+    }
+    munmap(sq_ring_ptr, sq_ring_size);
+    sq_ring_ptr = cq_ring_ptr = MAP_FAILED;
+    close(fd);
+    return;
+  }
+
+  char* sq_base = static_cast<char*>(sq_ring_ptr);
+  sq_head = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.head);
+  sq_tail = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.tail);
+  sq_mask = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.ring_mask);
+  sq_array = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.array);
+  sq_entries = params.sq_entries;
+
+  char* cq_base = static_cast<char*>(cq_ring_ptr);
+  cq_head = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.head);
+  cq_tail = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.tail);
+  cq_mask = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+  cq_entries = params.cq_entries;
+
+  sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+  ring_fd = fd;
+  plain_ops = ProbePlainOps();
+}
+
+bool IoUring::ProbePlainOps() {
+  const uint32_t num_ops = std::max(IORING_OP_READ, IORING_OP_WRITE) + 1;
+  const size_t probe_size = sizeof(io_uring_probe) +
+                            num_ops * sizeof(io_uring_probe_op);
+  std::unique_ptr<char[]> mem = std::make_unique<char[]>(probe_size);
+  std::memset(mem.get(), 0, probe_size);
+  io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(mem.get());
+
+  if (IoUringRegister(ring_fd, IORING_REGISTER_PROBE, probe, num_ops) != 0) {
+    // Probing came with the plain ops, a kernel without it has neither
+    return false;
+  }
+
+  auto supported = [probe](const uint32_t op) {
+    return (op <= probe->last_op &&
+            (probe->ops[op].flags & IO_URING_OP_SUPPORTED));
+  };
+  return (supported(IORING_OP_READ) && supported(IORING_OP_WRITE));
+}
+
+void IoUring::RegisterFixedBuffers(const uint32_t num_fixed_buffers) {
+  void* mem = nullptr;
+  const size_t total = static_cast<size_t>(num_fixed_buffers) *
+                       fixed_buffer_size;
+  if (posix_memalign(&mem, 4096, total) != 0) {
+    return;
+  }
+
+  std::vector<iovec> iovecs(num_fixed_buffers);
+  for (uint32_t i = 0 ; i < num_fixed_buffers ; ++i) {
+    iovecs[i].iov_base = static_cast<char*>(mem) +
+                         static_cast<size_t>(i) * fixed_buffer_size;
+    iovecs[i].iov_len = fixed_buffer_size;
+  }
+
+  if (IoUringRegister(ring_fd,
+                      IORING_REGISTER_BUFFERS,
+                      iovecs.data(),
+                      num_fixed_buffers) != 0) {
+    // Probably RLIMIT_MEMLOCK is too small. Plain buffers are still fine
+    std::free(mem);
+    return;
+  }
+
+  fixed_buffers = static_cast<char*>(mem);
+  free_fixed_buffers.reserve(num_fixed_buffers);
+  for (int32_t i = num_fixed_buffers - 1 ; i >= 0 ; --i) {
+    free_fixed_buffers.push_back(i);
+  }
+}
+
+int32_t IoUring::AcquireFixedBuffer() {
+  std::lock_guard<std::mutex> guard(mutex);
+  if (free_fixed_buffers.empty()) {
+    return -1;
+  }
+
+  const int32_t fixed_index = free_fixed_buffers.back();
+  free_fixed_buffers.pop_back();
+  return fixed_index;
+}
+
+void IoUring::ReleaseFixedBuffer(const int32_t fixed_index) {
+  if (fixed_index >= 0) {
+    std::lock_guard<std::mutex> guard(mutex);
+    free_fixed_buffers.push_back(fixed_index);
+  }
+}
+
+void IoUring::ExecuteSync(Request* request) {
+  uint32_t done = 0;
+  while (done < request->length) {
+    const ssize_t result =
+    (request->write ?
+     pwrite(request->fd,
+            request->buf + done,
+            request->length - done,
+            request->offset + done) :
+     pread(request->fd,
+           request->buf + done,
+           request->length - done,
+           request->offset + done));
+
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw IOException(std::strerror(errno));
+    } else if (result == 0) {
+      throw EOFException("Read past EOF");
+    }
+
+    done += result;
+  }
+
+  request->result = static_cast<int32_t>(done);
+  request->done = true;
+}
+
+void IoUring::ReapLocked() {
+  if (reaping) {
+    // Only the leader blocked in the kernel may consume the CQ. Reaping its
+    // completion here would leave it sleeping on an empty queue
+    return;
+  }
+
+  uint32_t head = *cq_head;
+  const uint32_t tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+  while (head != tail) {
+    const io_uring_cqe& cqe = cqes[head & *cq_mask];
+    Request* request = reinterpret_cast<Request*>(cqe.user_data);
+    request->result = cqe.res;
+    request->done = true;
+    ++head;
+    --in_flight;
+  }
+
+  if (head != *cq_head) {
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    cond.notify_all();
+  }
+}
+
+void IoUring::ReapOrWaitLocked(std::unique_lock<std::mutex>& guard) {
+  if (reaping) {
+    // Someone else is already blocking in the kernel on behalf of us
+    cond.wait(guard);
+    return;
+  }
+
+  reaping = true;
+  guard.unlock();
+  const int result = IoUringEnter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+  const int err = errno;
+  guard.lock();
+  reaping = false;
+  ReapLocked();
+  // Wakes waiters even when nothing completed, one of them has to lead now
+  cond.notify_all();
+
+  if (result < 0 && err != EINTR && err != EAGAIN && err != EBUSY) {
+    throw IOException(std::string("io_uring_enter failed, ") +
+                      std::strerror(err));
+  }
+}
+
+void IoUring::AbortSubmitLocked(std::unique_lock<std::mutex>& guard,
+                                Request requests[],
+                                const uint32_t num_consumed) {
+  // Nobody else submits while we hold the mutex, so SQEs past the kernel's
+  // head were never seen by it and can be taken back
+  const uint32_t head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+  in_flight -= (*sq_tail - head);
+  __atomic_store_n(sq_tail, head, __ATOMIC_RELEASE);
+
+  // Consumed ones still point at caller's requests, wait them out
+  for (uint32_t i = 0 ; i < num_consumed ; ++i) {
+    ReapLocked();
+    while (!requests[i].done) {
+      ReapOrWaitLocked(guard);
+    }
+  }
+}
+
+void IoUring::Submit(Request requests[], const uint32_t num_requests) {
+  if (!IsAsync()) {
+    for (uint32_t i = 0 ; i < num_requests ; ++i) {
+      ExecuteSync(requests + i);
+    }
+
+    return;
+  }
+
+  if (plain_ops) {
+    SubmitAsync(requests, num_requests);
+    return;
+  }
+
+  // Runs of fixed buffer requests go through the ring, the others are done
+  // right here
+  uint32_t start = 0;
+  while (start < num_requests) {
+    uint32_t end = start;
+    while (end < num_requests && requests[end].fixed_index >= 0) {
+      end++;
+    }
+
+    if (end > start) {
+      SubmitAsync(requests + start, end - start);
+    }
+    if (end < num_requests) {
+      ExecuteSync(requests + end);
+    }
+    start = end + 1;
+  }
+}
+
+void IoUring::SubmitAsync(Request requests[], const uint32_t num_requests) {
+  std::unique_lock<std::mutex> guard(mutex);
+  uint32_t submitted = 0;
+
+  while (submitted < num_requests) {
+    const uint32_t tail = *sq_tail;
+    const uint32_t head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    // Never let in-flight requests outnumber completion queue
+    const uint32_t to_fill = std::min({num_requests - submitted,
+                                       sq_entries - (tail - head),
+                                       cq_entries - in_flight});
+    if (to_fill == 0) {
+      ReapLocked();
+      if (cq_entries == in_flight || reaping) {
+        ReapOrWaitLocked(guard);
+      }
+      continue;
+    }
+
+    for (uint32_t i = 0 ; i < to_fill ; ++i) {
+      Request* request = requests + submitted + i;
+      const uint32_t idx = (tail + i) & *sq_mask;
+      io_uring_sqe* sqe = sqes + idx;
+      std::memset(sqe, 0, sizeof(io_uring_sqe));
+
+      if (request->fixed_index >= 0) {
+        sqe->opcode = (request->write ?
+                       IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED);
+        sqe->buf_index = static_cast<uint16_t>(request->fixed_index);
+      } else {
+        sqe->opcode = (request->write ? IORING_OP_WRITE : IORING_OP_READ);
+      }
+
+      sqe->fd = request->fd;
+      sqe->addr = reinterpret_cast<uint64_t>(request->buf);
+      sqe->len = request->length;
+      sqe->off = request->offset;
+      sqe->user_data = reinterpret_cast<uint64_t>(request);
+      request->done = false;
+      request->result = 0;
+      sq_array[idx] = idx;
+    }
+
+    __atomic_store_n(sq_tail, tail + to_fill, __ATOMIC_RELEASE);
+    in_flight += to_fill;
+
+    uint32_t to_submit = to_fill;
+    while (to_submit > 0) {
+      const int result = IoUringEnter(ring_fd, to_submit, 0, 0);
+      if (result < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          ReapLocked();
+          continue;
+        }
+
+        const int err = errno;
+        const uint32_t consumed =
+        __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) - tail;
+        AbortSubmitLocked(guard, requests, submitted + consumed);
+        throw IOException(std::string("io_uring_enter failed, ") +
+                          std::strerror(err));
+      }
+      to_submit -= std::min(to_submit, static_cast<uint32_t>(result));
+    }
+
+    submitted += to_fill;
+  }
+}
+
+void IoUring::Wait(Request* request) {
+  if (IsAsync()) {
+    std::unique_lock<std::mutex> guard(mutex);
+    ReapLocked();
+    while (!request->done) {
+      ReapOrWaitLocked(guard);
+    }
+  }
+
+  if (request->result < 0) {
+    throw IOException(std::strerror(-request->result));
+  }
+
+  const uint32_t transferred = static_cast<uint32_t>(request->result);
+  if (transferred < request->length) {
+    // Short read or write. Finish the rest in place
+    Request rest(request->fd,
+                 request->buf + transferred,
+                 request->length - transferred,
+                 request->offset + transferred,
+                 -1,
+                 request->write);
+    ExecuteSync(&rest);
+    request->result = static_cast<int32_t>(request->length);
+  }
+}
+
+/**
+ *  IoUringIndexInput
+ */
+IoUringIndexInput::IoUringIndexInput(const std::string& resource_desc,
+                                     const std::shared_ptr<IoUring>& ring,
+                                     const int fd,
+                                     const uint64_t length,
+                                     const IOContext& context)
+  : BufferedIndexInput(resource_desc, context),
+    ring(ring),
+    handle(std::make_shared<FileHandle>(fd)),
+    start_offset(0),
+    length(length) {
+}
+
+IoUringIndexInput::IoUringIndexInput(const std::string& resource_desc,
+                                     const IoUringIndexInput& parent,
+                                     const uint64_t start_offset,
+                                     const uint64_t length)
+  : BufferedIndexInput(resource_desc, parent.GetBufferSize()),
+    ring(parent.ring),
+    handle(parent.handle),
+    start_offset(start_offset),
+    length(length) {
+}
+
+void IoUringIndexInput::EnsureOpen() {
+  if (!handle) {
+    throw AlreadyClosedException("Already closed: " + resource_desc);
+  }
+}
+
+std::unique_ptr<IoUringIndexInput> IoUringIndexInput::Clone() {
+  EnsureOpen();
+  std::unique_ptr<IoUringIndexInput> clone(
+    new IoUringIndexInput(resource_desc, *this, start_offset, length));
+  clone->Seek(GetFilePointer());
+  return clone;
+}
+
+std::unique_ptr<IndexInput>
+IoUringIndexInput::Slice(const std::string& slice_desc,
+                         const uint64_t offset,
+                         const uint64_t slice_length) {
+  EnsureOpen();
+  if (offset + slice_length > length) {
+    throw IllegalArgumentException("Slice out of bounds: offset=" +
+                                   std::to_string(offset) + ", length=" +
+                                   std::to_string(slice_length) + ": " +
+                                   resource_desc);
+  }
+
+  return std::unique_ptr<IndexInput>(
+    new IoUringIndexInput(resource_desc + " [slice=" + slice_desc + ']',
+                          *this,
+                          start_offset + offset,
+                          slice_length));
+}
+
+void IoUringIndexInput::ReadInternal(char bytes[],
+                                     const uint32_t offset,
+                                     const uint32_t len) {
+  EnsureOpen();
+  // Positional read, file offset is never shared between slices
+  const uint64_t pos = GetFilePointer();
+  if (pos + len > length) {
+    throw EOFException("Read past EOF: " + resource_desc);
+  }
+
+  IoUring::Request request(handle->fd,
+                           bytes + offset,
+                           len,
+                           start_offset + pos,
+                           -1,
+                           false);
+  ring->Submit(&request, 1);
+  ring->Wait(&request);
+}
+
+void IoUringIndexInput::ReadBatch(ReadRequest requests[],
+                                  const uint32_t num_requests) {
+  EnsureOpen();
+  std::vector<IoUring::Request> batch;
+  batch.reserve(num_requests);
+
+  for (uint32_t i = 0 ; i < num_requests ; ++i) {
+    const ReadRequest& read_request = requests[i];
+    if (read_request.offset + read_request.length > length) {
+      throw EOFException("Read past EOF: " + resource_desc);
+    }
+
+    batch.emplace_back(handle->fd,
+                       read_request.dest,
+                       read_request.length,
+                       start_offset + read_request.offset,
+                       -1,
+                       false);
+  }
+
+  ring->Submit(batch.data(), num_requests);
+  ring->WaitAll(batch.data(), num_requests);
+}
+
+void IoUringIndexInput::Prefetch(const uint64_t offset,
+                                 const uint64_t prefetch_length) {
+  if (handle && offset < length && prefetch_length > 0) {
+    posix_fadvise(handle->fd,
+                  start_offset + offset,
+                  std::min(prefetch_length, length - offset),
+                  POSIX_FADV_WILLNEED);
+  }
+}
+
+void IoUringIndexInput::Close() {
+  // Descriptor is closed by the last clone or slice holding it
+  handle.reset();
+}
+
+/**
+ *  IoUringIndexOutput
+ */
+IoUringIndexOutput::IoUringIndexOutput(const std::string& resource_desc,
+                                       const std::string& name,
+                                       const std::string& path,
+                                       const std::shared_ptr<IoUring>& ring)
+  : IndexOutput(resource_desc, name),
+    ring(ring),
+    crc(),
+    bytes_written(0),
+    file_offset(0),
+    fd(open(path.c_str(),
+            O_CREAT | O_WRONLY | O_EXCL,
+            S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH)),
+    buffer_size(ring->GetFixedBufferSize()),
+    buf_idx(0),
+    current(0),
+    closed(false),
+    buffers() {
+  if (fd < 0) {
+    throw IOException(std::strerror(errno));
+  }
+
+  for (WriteBuffer& buffer : buffers) {
+    buffer.fixed_index = ring->AcquireFixedBuffer();
+    if (buffer.fixed_index >= 0) {
+      buffer.data = ring->GetFixedBuffer(buffer.fixed_index);
+    } else {
+      buffer.owned = std::make_unique<char[]>(buffer_size);
+      buffer.data = buffer.owned.get();
+    }
+  }
+}
+
+IoUringIndexOutput::~IoUringIndexOutput() {
+  try {
+    Close();
+  } catch(...) {
+    // Ignore
+  }
+
+  for (WriteBuffer& buffer : buffers) {
+    if (buffer.pending) {
+      try {
+        ring->Wait(&buffer.request);
+      } catch(...) {
+        // Ignore
+      }
+    }
+    ring->ReleaseFixedBuffer(buffer.fixed_index);
+  }
+}
+
+void IoUringIndexOutput::WaitBuffer(WriteBuffer& buffer) {
+  if (buffer.pending) {
+    buffer.pending = false;
+    ring->Wait(&buffer.request);
+  }
+}
+
+void IoUringIndexOutput::SubmitCurrent() {
+  if (buf_idx == 0) {
+    return;
+  }
+
+  WriteBuffer& buffer = buffers[current];
+  buffer.request = IoUring::Request(fd,
+                                    buffer.data,
+                                    buf_idx,
+                                    file_offset,
+                                    buffer.fixed_index,
+                                    true);
+  ring->Submit(&buffer.request, 1);
+  buffer.pending = true;
+  file_offset += buf_idx;
+  buf_idx = 0;
+
+  // Writer only stalls when the kernel is one whole buffer behind
+  current ^= 1;
+  WaitBuffer(buffers[current]);
+}
+
+void IoUringIndexOutput::WriteBytes(const char bytes[],
+                                    const uint32_t offset,
+                                    const uint32_t length) {
+  bytes_written += length;
+  crc.Update(bytes, offset, length);
+
+  const char* src = bytes + offset;
+  uint32_t left = length;
+  while (left > 0) {
+    const uint32_t to_copy = std::min(left, buffer_size - buf_idx);
+    std::memcpy(buffers[current].data + buf_idx, src, to_copy);
+    buf_idx += to_copy;
+    src += to_copy;
+    left -= to_copy;
+
+    if (buf_idx >= buffer_size) {
+      SubmitCurrent();
+    }
+  }
+}
+
+void IoUringIndexOutput::Close() {
+  if (!closed) {
+    closed = true;
+    // Descriptor is closed whatever fails, but only once no write is left
+    // in flight on it. First error wins
+    std::exception_ptr error;
+    try {
+      SubmitCurrent();
+    } catch(...) {
+      error = std::current_exception();
+    }
+    for (WriteBuffer& buffer : buffers) {
+      try {
+        WaitBuffer(buffer);
+      } catch(...) {
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+
+    const int result = close(fd);
+    const int err = errno;
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    if (result < 0) {
+      throw IOException(std::strerror(err));
+    }
+  }
+}
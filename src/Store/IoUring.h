@@ -0,0 +1,336 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_IOURING_H_
+#define SRC_STORE_IOURING_H_
+
+#include <linux/io_uring.h>
+#include <Store/BlockCache.h>
+#include <Store/DataInput.h>
+#include <Store/DataOutput.h>
+#include <Util/Etc.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * Thin wrapper of a Linux io_uring instance. It talks to the kernel with raw
+ * syscalls, so there is no dependency on liburing.
+ * One ring is shared by every input and output of a directory. Any thread
+ * can submit, and completions are reaped by whichever waiting thread happens
+ * to be the leader at that moment.
+ * If the kernel does not support io_uring, every request is executed
+ * synchronously with pread/pwrite at submission time. Plain reads and
+ * writes came to io_uring later than the ring and its fixed buffer ops, so
+ * on kernels with the ring but without them, only requests on registered
+ * buffers go through the ring.
+ */
+class IoUring {
+ public:
+  static const uint32_t DEFAULT_QUEUE_DEPTH = 64;
+  static const uint32_t DEFAULT_NUM_FIXED_BUFFERS = 32;
+  static const uint32_t DEFAULT_FIXED_BUFFER_SIZE = 65536;
+
+  class Request {
+   public:
+    int fd;
+    char* buf;
+    uint32_t length;
+    uint64_t offset;
+    // Index of a registered buffer, -1 if `buf` is a plain memory
+    int32_t fixed_index;
+    int32_t result;
+    bool write;
+    bool done;
+
+    Request()
+      : Request(-1, nullptr, 0, 0, -1, false) {
+    }
+
+    Request(const int fd,
+            char* buf,
+            const uint32_t length,
+            const uint64_t offset,
+            const int32_t fixed_index,
+            const bool write)
+      : fd(fd),
+        buf(buf),
+        length(length),
+        offset(offset),
+        fixed_index(fixed_index),
+        result(0),
+        write(write),
+        done(false) {
+    }
+  };
+
+ private:
+  int ring_fd;
+  void* sq_ring_ptr;
+  size_t sq_ring_size;
+  void* cq_ring_ptr;
+  size_t cq_ring_size;
+  io_uring_sqe* sqes;
+  size_t sqes_size;
+  uint32_t* sq_head;
+  uint32_t* sq_tail;
+  uint32_t* sq_mask;
+  uint32_t* sq_array;
+  uint32_t sq_entries;
+  uint32_t* cq_head;
+  uint32_t* cq_tail;
+  uint32_t* cq_mask;
+  io_uring_cqe* cqes;
+  uint32_t cq_entries;
+  // IORING_OP_READ and IORING_OP_WRITE are supported
+  bool plain_ops;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool reaping;
+  uint32_t in_flight;
+
+  char* fixed_buffers;
+  uint32_t fixed_buffer_size;
+  std::vector<int32_t> free_fixed_buffers;
+
+ private:
+  void SetUpRing(const uint32_t queue_depth);
+
+  void RegisterFixedBuffers(const uint32_t num_fixed_buffers);
+
+  // Asks the kernel which ops the ring supports
+  bool ProbePlainOps();
+
+  void SubmitAsync(Request requests[], const uint32_t num_requests);
+
+  void ReapLocked();
+
+  void ReapOrWaitLocked(std::unique_lock<std::mutex>& guard);
+
+  // Takes back SQEs the kernel has not consumed and waits for the first
+  // `num_consumed` requests, so none is left pointing at caller's memory
+  void AbortSubmitLocked(std::unique_lock<std::mutex>& guard,
+                         Request requests[],
+                         const uint32_t num_consumed);
+
+  static void ExecuteSync(Request* request);
+
+ public:
+  IoUring();
+
+  IoUring(const uint32_t queue_depth,
+          const uint32_t num_fixed_buffers,
+          const uint32_t fixed_buffer_size);
+
+  IoUring(const IoUring& other) = delete;
+
+  IoUring& operator=(const IoUring& other) = delete;
+
+  ~IoUring();
+
+  bool IsAsync() const noexcept {
+    return (ring_fd >= 0);
+  }
+
+  // Requests on plain memory go through the ring too, not only fixed ones
+  bool HasPlainOps() const noexcept {
+    return plain_ops;
+  }
+
+  uint32_t GetFixedBufferSize() const noexcept {
+    return fixed_buffer_size;
+  }
+
+  /**
+   * Leases one of registered buffers. Returns -1 when all of them are in use,
+   * caller should fall back to its own buffer then.
+   */
+  int32_t AcquireFixedBuffer();
+
+  char* GetFixedBuffer(const int32_t fixed_index) const noexcept {
+    return fixed_buffers + static_cast<size_t>(fixed_index) * fixed_buffer_size;
+  }
+
+  void ReleaseFixedBuffer(const int32_t fixed_index);
+
+  /**
+   * Queues all requests and enters the kernel once per batch.
+   * Given requests must stay alive until they are waited.
+   */
+  void Submit(Request requests[], const uint32_t num_requests);
+
+  /**
+   * Blocks until given request is completed. Short transfers are finished
+   * synchronously, an error is reported as an IOException.
+   */
+  void Wait(Request* request);
+
+  void WaitAll(Request requests[], const uint32_t num_requests) {
+    for (uint32_t i = 0 ; i < num_requests ; ++i) {
+      Wait(requests + i);
+    }
+  }
+};
+
+/**
+ * Every read is positional on a shared descriptor, so clones and slices
+ * keep their own file pointer and can be read from different threads.
+ * The descriptor is closed once the last of them is closed.
+ */
+class IoUringIndexInput: public BufferedIndexInput {
+ public:
+  class ReadRequest {
+   public:
+    uint64_t offset;
+    char* dest;
+    uint32_t length;
+  };
+
+  using FileHandle = PReadIndexInput::FileHandle;
+
+ private:
+  std::shared_ptr<IoUring> ring;
+  std::shared_ptr<FileHandle> handle;
+  // Where this input (a slice possibly) starts in the file
+  uint64_t start_offset;
+  uint64_t length;
+
+ private:
+  IoUringIndexInput(const std::string& resource_desc,
+                    const IoUringIndexInput& parent,
+                    const uint64_t start_offset,
+                    const uint64_t length);
+
+  void EnsureOpen();
+
+ protected:
+  void SeekInternal(const uint64_t pos) { }
+
+  void ReadInternal(char bytes[], const uint32_t offset, const uint32_t len);
+
+ public:
+  // Takes ownership of `fd`
+  IoUringIndexInput(const std::string& resource_desc,
+                    const std::shared_ptr<IoUring>& ring,
+                    const int fd,
+                    const uint64_t length,
+                    const IOContext& context);
+
+  // Clone shares the descriptor and starts at the same file pointer
+  std::unique_ptr<IoUringIndexInput> Clone();
+
+  std::unique_ptr<IndexInput> Slice(const std::string& slice_desc,
+                                    const uint64_t offset,
+                                    const uint64_t slice_length);
+
+  /**
+   * Reads all given ranges with every request in flight at the same time.
+   * Offsets are relative to this input. File pointer is not affected.
+   */
+  void ReadBatch(ReadRequest requests[], const uint32_t num_requests);
+
+  // Starts kernel readahead on the range
+  void Prefetch(const uint64_t offset, const uint64_t prefetch_length);
+
+  uint64_t Length() {
+    return length;
+  }
+
+  void Close();
+};
+
+class IoUringIndexOutput: public IndexOutput {
+ private:
+  class WriteBuffer {
+   public:
+    std::unique_ptr<char[]> owned;
+    char* data;
+    int32_t fixed_index;
+    bool pending;
+    IoUring::Request request;
+
+    WriteBuffer()
+      : owned(),
+        data(nullptr),
+        fixed_index(-1),
+        pending(false),
+        request() {
+    }
+  };
+
+ private:
+  std::shared_ptr<IoUring> ring;
+  lucene::core::util::Crc32 crc;
+  uint64_t bytes_written;
+  uint64_t file_offset;
+  int fd;
+  uint32_t buffer_size;
+  uint32_t buf_idx;
+  uint32_t current;
+  bool closed;
+  WriteBuffer buffers[2];
+
+ private:
+  void SubmitCurrent();
+
+  void WaitBuffer(WriteBuffer& buffer);
+
+ public:
+  IoUringIndexOutput(const std::string& resource_desc,
+                     const std::string& name,
+                     const std::string& path,
+                     const std::shared_ptr<IoUring>& ring);
+
+  ~IoUringIndexOutput();
+
+  void WriteByte(const char b) {
+    crc.Update(b);
+    buffers[current].data[buf_idx++] = b;
+    bytes_written++;
+
+    if (buf_idx >= buffer_size) {
+      SubmitCurrent();
+    }
+  }
+
+  void WriteBytes(const char bytes[],
+                  const uint32_t offset,
+                  const uint32_t length);
+
+  void Close();
+
+  uint64_t GetFilePointer() {
+    return bytes_written;
+  }
+
+  uint64_t GetChecksum() {
+    return crc.GetValue();
+  }
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_IOURING_H_
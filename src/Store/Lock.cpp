@@ -20,11 +20,15 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <Util/Exception.h>
+#include <Store/Exception.h>
 #include <Store/Lock.h>
 
+using lucene::core::store::AlreadyClosedException;
 using lucene::core::store::FSLockFactory;
 using lucene::core::store::NativeFSLockFactory;
+using lucene::core::store::SingleInstanceLockFactory;
 using lucene::core::store::Lock;
+using lucene::core::util::IOException;
 using lucene::core::util::UnsupportedOperationException;
 
 /**
@@ -120,3 +124,54 @@ void NativeFSLockFactory::NativeFSLock::Close() {
   closed = true;
   NativeFSLockFactory::ClearLockHeld(abs_lock_file);
 }
+
+/**
+ *  SingleInstanceLockFactory
+ */
+std::unique_ptr<Lock>
+SingleInstanceLockFactory::ObtainLock(Directory& dir,
+                                      const std::string& lock_name) {
+  std::lock_guard<std::mutex> guard(mutex);
+  if (!locks.insert(lock_name).second) {
+    throw IOException(std::string("Lock instance already obtained: ") +
+                      lock_name);
+  }
+
+  return std::make_unique<SingleInstanceLock>(*this, lock_name);
+}
+
+/**
+ *  SingleInstanceLock
+ */
+SingleInstanceLockFactory::SingleInstanceLock::SingleInstanceLock(
+                                         SingleInstanceLockFactory& factory,
+                                         const std::string& lock_name)
+  : factory(factory),
+    lock_name(lock_name),
+    closed(false) {
+}
+
+SingleInstanceLockFactory::SingleInstanceLock::~SingleInstanceLock() {
+  Close();
+}
+
+void SingleInstanceLockFactory::SingleInstanceLock::EnsureValid() {
+  if (closed) {
+    throw AlreadyClosedException("Lock instance already released: " +
+                                 lock_name);
+  }
+
+  std::lock_guard<std::mutex> guard(factory.mutex);
+  if (factory.locks.find(lock_name) == factory.locks.end()) {
+    throw AlreadyClosedException("Lock instance was invalidated "
+                                 "from map: " + lock_name);
+  }
+}
+
+void SingleInstanceLockFactory::SingleInstanceLock::Close() {
+  if (!closed) {
+    closed = true;
+    std::lock_guard<std::mutex> guard(factory.mutex);
+    factory.locks.erase(lock_name);
+  }
+}
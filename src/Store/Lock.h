@@ -101,6 +101,41 @@ class NativeFSLockFactory: public FSLockFactory {
                                      const std::string& lock_name);
 };
 
+/**
+ * Lock factory for directories that live in a single process,
+ * e.g. RAMDirectory. Locks are just names in an in-memory set.
+ * Factory must outlive the locks it handed out.
+ */
+class SingleInstanceLockFactory: public LockFactory {
+ private:
+  class SingleInstanceLock: public Lock {
+   private:
+    SingleInstanceLockFactory& factory;
+    const std::string lock_name;
+    bool closed;
+
+   public:
+    SingleInstanceLock(SingleInstanceLockFactory& factory,
+                       const std::string& lock_name);
+
+    ~SingleInstanceLock();
+
+    void EnsureValid();
+
+    void Close();
+  };
+
+ private:
+  std::mutex mutex;
+  std::set<std::string> locks;
+
+ public:
+  SingleInstanceLockFactory() = default;
+
+  std::unique_ptr<Lock> ObtainLock(Directory& dir,
+                                   const std::string& lock_name);
+};
+
 }  // namespace store
 }  // namespace core
 }  // namespace lucene
@@ -0,0 +1,205 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <Index/File.h>
+#include <Store/NRTCachingDirectory.h>
+#include <Util/Exception.h>
+#include <algorithm>
+#include <set>
+
+using lucene::core::index::IndexFileNames;
+using lucene::core::store::IndexInput;
+using lucene::core::store::IndexOutput;
+using lucene::core::store::Lock;
+using lucene::core::store::NRTCachingDirectory;
+using lucene::core::util::IOException;
+
+/**
+ *  NRTCachingDirectory
+ */
+NRTCachingDirectory::NRTCachingDirectory(
+                                  const std::shared_ptr<Directory>& delegate,
+                                  const double max_merge_size_mb,
+                                  const double max_cached_mb)
+  : Directory(),
+    delegate(delegate),
+    cache(),
+    max_merge_size_bytes(
+      static_cast<uint64_t>(max_merge_size_mb * 1024 * 1024)),
+    max_cached_bytes(static_cast<uint64_t>(max_cached_mb * 1024 * 1024)),
+    uncache_mutex() {
+}
+
+bool NRTCachingDirectory::DoCacheWrite(const std::string& name,
+                                       const IOContext& context) {
+  // Commit points must always reach the delegate
+  if (name.compare(0,
+                   IndexFileNames::SEGMENTS.size(),
+                   IndexFileNames::SEGMENTS) == 0 ||
+      name.compare(0,
+                   IndexFileNames::PENDING_SEGMENTS.size(),
+                   IndexFileNames::PENDING_SEGMENTS) == 0) {
+    return false;
+  }
+
+  uint64_t bytes = 0;
+  if (context.context == IOContext::Context::MERGE) {
+    bytes = context.merge_info.estimate_merge_bytes;
+  } else if (context.context == IOContext::Context::FLUSH) {
+    bytes = context.flush_info.estimated_segment_size;
+  }
+
+  return (bytes <= max_merge_size_bytes &&
+          bytes + cache.RamBytesUsed() <= max_cached_bytes);
+}
+
+void NRTCachingDirectory::UnCache(const std::string& name) {
+  std::lock_guard<std::mutex> guard(uncache_mutex);
+  if (!cache.FileExists(name)) {
+    // Another thread beat us to it
+    return;
+  }
+
+  {
+    std::unique_ptr<IndexInput> in = cache.OpenInput(name, IOContext::DEFAULT);
+    std::unique_ptr<IndexOutput> out =
+    delegate->CreateOutput(name, IOContext::DEFAULT);
+    out->CopyBytes(*in, in->Length());
+    out->Close();
+  }
+
+  cache.DeleteFile(name);
+}
+
+std::vector<std::string> NRTCachingDirectory::ListAll() {
+  std::set<std::string> names;
+  for (const std::string& name : cache.ListAll()) {
+    names.insert(name);
+  }
+
+  for (const std::string& name : delegate->ListAll()) {
+    names.insert(name);
+  }
+
+  return std::vector<std::string>(names.begin(), names.end());
+}
+
+void NRTCachingDirectory::DeleteFile(const std::string& name) {
+  if (cache.FileExists(name)) {
+    cache.DeleteFile(name);
+  } else {
+    delegate->DeleteFile(name);
+  }
+}
+
+uint64_t NRTCachingDirectory::FileLength(const std::string& name) {
+  if (cache.FileExists(name)) {
+    return cache.FileLength(name);
+  }
+
+  return delegate->FileLength(name);
+}
+
+std::unique_ptr<IndexOutput>
+NRTCachingDirectory::CreateOutput(const std::string& name,
+                                  const IOContext& context) {
+  if (DoCacheWrite(name, context)) {
+    try {
+      // Stale copy in the delegate would shadow nothing, but wastes disk
+      delegate->DeleteFile(name);
+    } catch(...) {
+      // Ignore
+    }
+
+    return cache.CreateOutput(name, context);
+  }
+
+  if (cache.FileExists(name)) {
+    cache.DeleteFile(name);
+  }
+
+  return delegate->CreateOutput(name, context);
+}
+
+std::unique_ptr<IndexOutput>
+NRTCachingDirectory::CreateTempOutput(const std::string& prefix,
+                                      const std::string& suffix,
+                                      const IOContext& context) {
+  if (!DoCacheWrite(prefix, context)) {
+    return delegate->CreateTempOutput(prefix, suffix, context);
+  }
+
+  while (true) {
+    std::unique_ptr<IndexOutput> out =
+    cache.CreateTempOutput(prefix, suffix, context);
+    // Temp name must be unique across both directories
+    const std::vector<std::string> delegate_names = delegate->ListAll();
+    if (std::find(delegate_names.begin(),
+                  delegate_names.end(),
+                  out->GetName()) == delegate_names.end()) {
+      return out;
+    }
+
+    out->Close();
+    cache.DeleteFile(out->GetName());
+  }
+}
+
+void NRTCachingDirectory::Sync(const std::vector<std::string>& names) {
+  for (const std::string& name : names) {
+    UnCache(name);
+  }
+
+  delegate->Sync(names);
+}
+
+void NRTCachingDirectory::Rename(const std::string& source,
+                                 const std::string& dest) {
+  if (cache.FileExists(source)) {
+    cache.Rename(source, dest);
+  } else {
+    delegate->Rename(source, dest);
+  }
+}
+
+void NRTCachingDirectory::SyncMetaData() {
+  delegate->SyncMetaData();
+}
+
+std::unique_ptr<IndexInput>
+NRTCachingDirectory::OpenInput(const std::string& name,
+                               const IOContext& context) {
+  if (cache.FileExists(name)) {
+    return cache.OpenInput(name, context);
+  }
+
+  return delegate->OpenInput(name, context);
+}
+
+std::unique_ptr<Lock> NRTCachingDirectory::ObtainLock(const std::string& name) {
+  return delegate->ObtainLock(name);
+}
+
+void NRTCachingDirectory::Close() {
+  // Do not lose anything that was never synced
+  for (const std::string& name : cache.ListAll()) {
+    UnCache(name);
+  }
+
+  cache.Close();
+  delegate->Close();
+}
@@ -0,0 +1,105 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_NRTCACHINGDIRECTORY_H_
+#define SRC_STORE_NRTCACHINGDIRECTORY_H_
+
+#include <Store/Directory.h>
+#include <Store/RAMDirectory.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * Wraps a directory and keeps small newly written files, such as segments
+ * flushed for a near real-time reopen, in a RAMDirectory.
+ * A file is cached when the size estimated from its IOContext fits under
+ * `max_merge_size_mb` and the cache stays under `max_cached_mb`. Cached
+ * files are copied to the delegate on Sync or Close, so a frequent reopen
+ * never creates, writes and maps many tiny files on the disk.
+ */
+class NRTCachingDirectory: public Directory {
+ private:
+  std::shared_ptr<Directory> delegate;
+  RAMDirectory cache;
+  const uint64_t max_merge_size_bytes;
+  const uint64_t max_cached_bytes;
+  // Serializes copying a file out of the cache
+  std::mutex uncache_mutex;
+
+ private:
+  bool DoCacheWrite(const std::string& name, const IOContext& context);
+
+  void UnCache(const std::string& name);
+
+ public:
+  NRTCachingDirectory(const std::shared_ptr<Directory>& delegate,
+                      const double max_merge_size_mb,
+                      const double max_cached_mb);
+
+  const std::shared_ptr<Directory>& GetDelegate() const noexcept {
+    return delegate;
+  }
+
+  // Names of files that exist only in the cache at the moment
+  std::vector<std::string> ListCachedFiles() {
+    return cache.ListAll();
+  }
+
+  uint64_t CacheRamBytesUsed() {
+    return cache.RamBytesUsed();
+  }
+
+  std::vector<std::string> ListAll();
+
+  void DeleteFile(const std::string& name);
+
+  uint64_t FileLength(const std::string& name);
+
+  std::unique_ptr<IndexOutput>
+  CreateOutput(const std::string& name, const IOContext& context);
+
+  std::unique_ptr<IndexOutput> CreateTempOutput(const std::string& prefix,
+                                                const std::string& suffix,
+                                                const IOContext& context);
+
+  // Cached files among `names` are written to the delegate first
+  void Sync(const std::vector<std::string>& names);
+
+  void Rename(const std::string& source, const std::string& dest);
+
+  void SyncMetaData();
+
+  std::unique_ptr<IndexInput> OpenInput(const std::string& name,
+                                        const IOContext& context);
+
+  std::unique_ptr<Lock> ObtainLock(const std::string& name);
+
+  // Flushes every cached file to the delegate and closes it
+  void Close();
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_NRTCACHINGDIRECTORY_H_
@@ -0,0 +1,369 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <Index/File.h>
+#include <Store/CodecUtil.h>
+#include <Store/PageHeat.h>
+#include <Util/Exception.h>
+#include <Util/File.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using lucene::core::index::IndexFileNames;
+using lucene::core::store::ChecksumIndexInput;
+using lucene::core::store::CodecUtil;
+using lucene::core::store::FSDirectory;
+using lucene::core::store::IndexOutput;
+using lucene::core::store::IOContext;
+using lucene::core::store::IOUtils;
+using lucene::core::store::PageHeatSampler;
+using lucene::core::store::PageHeatSnapshot;
+using lucene::core::util::FileUtil;
+using lucene::core::util::IOException;
+
+namespace {
+
+// Longest range one readahead call is given, so threads share big files
+const uint64_t MAX_REPLAY_CHUNK = 4 * 1024 * 1024;
+
+class HeatEntry {
+ public:
+  std::string name;
+  uint64_t length;
+  // Resident page ranges as {first page, number of pages}
+  std::vector<std::pair<uint64_t, uint64_t>> runs;
+};
+
+// Returns false if the file is gone or empty
+bool ScanResidentPages(const std::string& path,
+                       const uint64_t page_size,
+                       HeatEntry& entry) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return false;
+    }
+    throw IOException("Failed to open " + path);
+  }
+
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    close(fd);
+    throw IOException("Failed to open " + path);
+  }
+
+  if (sb.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  // Mapping alone faults nothing in, mincore only reads page cache state
+  void* addr = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    throw IOException("Failed to map " + path);
+  }
+
+  const uint64_t num_pages = (sb.st_size + page_size - 1) / page_size;
+  std::vector<unsigned char> resident(num_pages);
+  const int result = mincore(addr, sb.st_size, resident.data());
+  munmap(addr, sb.st_size);
+  if (result == -1) {
+    throw IOException("Failed to scan " + path);
+  }
+
+  entry.length = sb.st_size;
+  for (uint64_t page = 0 ; page < num_pages ; ) {
+    if ((resident[page] & 1) == 0) {
+      page++;
+      continue;
+    }
+
+    const uint64_t first = page;
+    while (page < num_pages && (resident[page] & 1) != 0) {
+      page++;
+    }
+    entry.runs.emplace_back(first, page - first);
+  }
+
+  return true;
+}
+
+uint64_t NanosSince(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+/**
+ *  PageHeatSnapshot
+ */
+const int32_t PageHeatSnapshot::VERSION;
+const std::string PageHeatSnapshot::CODEC("PageHeatSnapshot");
+
+PageHeatSnapshot::Stats
+PageHeatSnapshot::Save(FSDirectory& dir,
+                       const std::string& snapshot_name,
+                       const std::set<std::string>& extensions) {
+  const auto start = std::chrono::steady_clock::now();
+  const uint64_t page_size = sysconf(_SC_PAGESIZE);
+  const std::string& base = dir.GetDirectory();
+
+  Stats stats;
+  std::vector<HeatEntry> entries;
+  for (const std::string& name : dir.ListAll()) {
+    const std::string ext = IndexFileNames::GetExtension(name);
+    // Snapshots and their temp files are never worth replaying
+    if (name == snapshot_name || ext == "tmp" ||
+        (!extensions.empty() && extensions.find(ext) == extensions.end())) {
+      continue;
+    }
+
+    HeatEntry entry;
+    entry.name = name;
+    if (!ScanResidentPages(base + '/' + name, page_size, entry) ||
+        entry.runs.empty()) {
+      continue;
+    }
+
+    stats.files++;
+    for (const auto& run : entry.runs) {
+      stats.pages += run.second;
+    }
+    entries.push_back(std::move(entry));
+  }
+  stats.bytes = stats.pages * page_size;
+
+  std::unique_ptr<IndexOutput> out =
+  dir.CreateTempOutput(snapshot_name, "heat", IOContext::DEFAULT);
+  const std::string temp_name = out->GetName();
+  try {
+    CodecUtil::WriteHeader(*out, CODEC, VERSION);
+    out->WriteVInt32(static_cast<int32_t>(page_size));
+    out->WriteVInt32(static_cast<int32_t>(entries.size()));
+    for (const HeatEntry& entry : entries) {
+      out->WriteString(entry.name);
+      out->WriteVInt64(static_cast<int64_t>(entry.length));
+      out->WriteVInt32(static_cast<int32_t>(entry.runs.size()));
+      uint64_t prev_end = 0;
+      for (const auto& run : entry.runs) {
+        out->WriteVInt64(static_cast<int64_t>(run.first - prev_end));
+        out->WriteVInt64(static_cast<int64_t>(run.second));
+        prev_end = run.first + run.second;
+      }
+    }
+    CodecUtil::WriteFooter(*out);
+    out->Close();
+    out.reset();
+
+    dir.Sync({temp_name});
+    dir.Rename(temp_name, snapshot_name);
+    dir.SyncMetaData();
+  } catch(...) {
+    out.reset();
+    IOUtils::DeleteFilesIgnoringExceptions(dir, {temp_name});
+    throw;
+  }
+
+  stats.nanos = NanosSince(start);
+  return stats;
+}
+
+PageHeatSnapshot::Stats
+PageHeatSnapshot::Replay(FSDirectory& dir,
+                         const std::string& snapshot_name,
+                         const uint32_t num_threads) {
+  const auto start = std::chrono::steady_clock::now();
+  const std::string& base = dir.GetDirectory();
+  Stats stats;
+  if (!FileUtil::Exists(base + '/' + snapshot_name)) {
+    return stats;
+  }
+
+  std::unique_ptr<ChecksumIndexInput> in =
+  dir.OpenChecksumInput(snapshot_name, IOContext::READONCE);
+  CodecUtil::CheckHeader(*in, CODEC, VERSION);
+  const uint64_t page_size = static_cast<uint32_t>(in->ReadVInt32());
+  const uint32_t num_files = static_cast<uint32_t>(in->ReadVInt32());
+  std::vector<HeatEntry> entries(num_files);
+  for (HeatEntry& entry : entries) {
+    entry.name = in->ReadString();
+    entry.length = static_cast<uint64_t>(in->ReadVInt64());
+    const uint32_t num_runs = static_cast<uint32_t>(in->ReadVInt32());
+    entry.runs.reserve(num_runs);
+    uint64_t prev_end = 0;
+    for (uint32_t i = 0 ; i < num_runs ; ++i) {
+      const uint64_t first = prev_end + in->ReadVInt64();
+      const uint64_t pages = in->ReadVInt64();
+      entry.runs.emplace_back(first, pages);
+      prev_end = first + pages;
+    }
+  }
+  CodecUtil::CheckFooter(*in);
+  in->Close();
+
+  // {fd index, offset, length} of every range to read
+  std::vector<int> fds;
+  std::vector<std::tuple<uint32_t, uint64_t, uint64_t>> chunks;
+  for (const HeatEntry& entry : entries) {
+    const int fd = open((base + '/' + entry.name).c_str(), O_RDONLY);
+    if (fd == -1) {
+      continue;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 ||
+        static_cast<uint64_t>(sb.st_size) != entry.length) {
+      close(fd);
+      continue;
+    }
+
+    fds.push_back(fd);
+    stats.files++;
+    for (const auto& run : entry.runs) {
+      const uint64_t run_start = run.first * page_size;
+      const uint64_t run_end =
+      std::min(entry.length, (run.first + run.second) * page_size);
+      for (uint64_t offset = run_start ;
+           offset < run_end ;
+           offset += MAX_REPLAY_CHUNK) {
+        chunks.emplace_back(fds.size() - 1,
+                            offset,
+                            std::min(MAX_REPLAY_CHUNK, run_end - offset));
+      }
+      stats.pages += run.second;
+      stats.bytes += (run_end > run_start ? run_end - run_start : 0);
+    }
+  }
+
+  std::atomic<uint64_t> next_chunk(0);
+  auto replay_chunks = [&fds, &chunks, &next_chunk]() {
+    for (uint64_t i = next_chunk.fetch_add(1) ;
+         i < chunks.size() ;
+         i = next_chunk.fetch_add(1)) {
+      const int fd = fds[std::get<0>(chunks[i])];
+      const uint64_t offset = std::get<1>(chunks[i]);
+      const uint64_t length = std::get<2>(chunks[i]);
+      // readahead returns once pages are read. Hint is the fallback
+      if (readahead(fd, offset, length) == -1) {
+        posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+      }
+    }
+  };
+
+  const uint32_t max_threads =
+  std::max(1U, num_threads > 0 ?
+               num_threads : std::thread::hardware_concurrency());
+  const uint64_t thread_count =
+  std::max<uint64_t>(1, std::min<uint64_t>(max_threads, chunks.size()));
+
+  // Calling thread takes part as well
+  std::vector<std::thread> threads;
+  threads.reserve(thread_count - 1);
+  for (uint64_t i = 1 ; i < thread_count ; ++i) {
+    threads.emplace_back(replay_chunks);
+  }
+  replay_chunks();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (const int fd : fds) {
+    close(fd);
+  }
+
+  stats.nanos = NanosSince(start);
+  return stats;
+}
+
+/**
+ *  PageHeatSampler
+ */
+PageHeatSampler::PageHeatSampler(FSDirectory& dir,
+                                 const std::string& snapshot_name,
+                                 const std::set<std::string>& extensions,
+                                 const std::chrono::milliseconds interval)
+  : dir(dir),
+    snapshot_name(snapshot_name),
+    extensions(extensions),
+    interval(interval),
+    mutex(),
+    cond(),
+    stopped(false),
+    saves(0),
+    failures(0),
+    last_stats(),
+    thread() {
+  thread = std::thread(&PageHeatSampler::Run, this);
+}
+
+PageHeatSampler::~PageHeatSampler() {
+  Stop();
+}
+
+void PageHeatSampler::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!cond.wait_for(lock, interval, [this](){ return stopped; })) {
+    lock.unlock();
+    try {
+      const PageHeatSnapshot::Stats stats =
+      PageHeatSnapshot::Save(dir, snapshot_name, extensions);
+      lock.lock();
+      saves++;
+      last_stats = stats;
+    } catch(...) {
+      lock.lock();
+      failures++;
+    }
+  }
+}
+
+void PageHeatSampler::Stop() {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    stopped = true;
+  }
+  cond.notify_all();
+
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+uint64_t PageHeatSampler::GetSaves() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return saves;
+}
+
+uint64_t PageHeatSampler::GetFailures() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return failures;
+}
+
+lucene::core::store::PageHeatSnapshot::Stats PageHeatSampler::GetLastStats() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return last_stats;
+}
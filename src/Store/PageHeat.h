@@ -0,0 +1,139 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_PAGEHEAT_H_
+#define SRC_STORE_PAGEHEAT_H_
+
+#include <Store/Directory.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * Records which pages of the files in an FSDirectory sit in page cache,
+ * so a restarted process can read exactly those pages back before serving
+ * instead of rebuilding its working set from live traffic.
+ * Residency comes from mincore, so pages warmed by mmap and pread readers
+ * alike are recorded.
+ *
+ * Snapshot: Header, PageSize(VInt32), NumFiles(VInt32),
+ *           {Name(String), Length(VInt64), NumRuns(VInt32),
+ *            {Gap(VInt64), Pages(VInt64)} * NumRuns} * NumFiles, Footer
+ *   A run is a range of resident pages. Gap is the number of pages from
+ *   the end of the previous run, or from the start of the file.
+ * Header and Footer are the ones of CodecUtil.
+ */
+class PageHeatSnapshot {
+ public:
+  static const int32_t VERSION = 0;
+  static const std::string CODEC;
+
+  class Stats {
+   public:
+    uint32_t files;
+    uint64_t pages;
+    uint64_t bytes;
+    uint64_t nanos;
+
+    Stats()
+      : files(0),
+        pages(0),
+        bytes(0),
+        nanos(0) {
+    }
+  };
+
+ private:
+  PageHeatSnapshot() = default;
+
+ public:
+  /**
+   * Writes resident pages of the files with given extensions, all files if
+   * empty, into `snapshot_name` of `dir`. The snapshot is written to a
+   * temp file, synced and renamed, so an existing one is replaced only by
+   * a complete snapshot.
+   */
+  static Stats Save(FSDirectory& dir,
+                    const std::string& snapshot_name,
+                    const std::set<std::string>& extensions);
+
+  /**
+   * Reads the pages recorded in `snapshot_name` into page cache on
+   * `num_threads` threads (hardware concurrency if 0) and returns once
+   * they are read. Files gone or rewritten with another length since the
+   * snapshot are skipped. A missing snapshot replays nothing.
+   */
+  static Stats Replay(FSDirectory& dir,
+                      const std::string& snapshot_name,
+                      const uint32_t num_threads = 0);
+};
+
+/**
+ * Saves a PageHeatSnapshot of a directory every interval on a background
+ * thread. A failed save is counted and retried on the next interval.
+ */
+class PageHeatSampler {
+ private:
+  FSDirectory& dir;
+  const std::string snapshot_name;
+  const std::set<std::string> extensions;
+  const std::chrono::milliseconds interval;
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool stopped;
+  uint64_t saves;
+  uint64_t failures;
+  PageHeatSnapshot::Stats last_stats;
+  std::thread thread;
+
+ private:
+  void Run();
+
+ public:
+  PageHeatSampler(FSDirectory& dir,
+                  const std::string& snapshot_name,
+                  const std::set<std::string>& extensions,
+                  const std::chrono::milliseconds interval);
+
+  PageHeatSampler(const PageHeatSampler& other) = delete;
+
+  PageHeatSampler& operator=(const PageHeatSampler& other) = delete;
+
+  ~PageHeatSampler();
+
+  // Waits for a running save. Must be called before `dir` is closed
+  void Stop();
+
+  uint64_t GetSaves();
+
+  uint64_t GetFailures();
+
+  PageHeatSnapshot::Stats GetLastStats();
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_PAGEHEAT_H_
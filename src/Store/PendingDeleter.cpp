@@ -0,0 +1,225 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <Store/PendingDeleter.h>
+#include <Util/Exception.h>
+#include <Util/File.h>
+#include <algorithm>
+
+using lucene::core::store::PendingDeleter;
+using lucene::core::util::FileUtil;
+using lucene::core::util::IOException;
+
+/**
+ *  PendingDeleter
+ */
+const uint32_t PendingDeleter::MIN_RETRY_MSEC;
+const uint32_t PendingDeleter::MAX_RETRY_MSEC;
+
+PendingDeleter::PendingDeleter(const std::string& directory)
+  : directory(directory),
+    mutex(),
+    cond(),
+    pending(),
+    in_progress(),
+    thread(),
+    closed(false),
+    stats() {
+}
+
+PendingDeleter::~PendingDeleter() {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    closed = true;
+  }
+  cond.notify_all();
+
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+bool PendingDeleter::Unlink(const std::string& name, uint64_t* nanos) {
+  const auto start = std::chrono::steady_clock::now();
+  bool gone = true;
+  try {
+    FileUtil::Delete(directory + '/' + name);
+  } catch(IOException&) {
+    gone = false;
+  }
+
+  *nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now() - start).count();
+  return gone;
+}
+
+bool PendingDeleter::StartLocked(const std::string& name) {
+  return (pending.find(name) != pending.end() &&
+          in_progress.insert(name).second);
+}
+
+void PendingDeleter::FinishLocked(const std::string& name,
+                                  const bool gone,
+                                  const uint64_t nanos) {
+  in_progress.erase(name);
+  auto it = pending.find(name);
+  if (it == pending.end()) {
+    // Claimed or deleted by someone else meanwhile
+    return;
+  }
+
+  if (gone) {
+    pending.erase(it);
+    stats.deleted++;
+    stats.total_delete_nanos += nanos;
+    stats.max_delete_nanos = std::max(stats.max_delete_nanos, nanos);
+  } else {
+    stats.failed_attempts++;
+    Entry& entry = it->second;
+    const uint32_t shift = std::min(entry.attempts, 20U);
+    const uint64_t backoff_msec =
+    std::min(static_cast<uint64_t>(MIN_RETRY_MSEC) << shift,
+             static_cast<uint64_t>(MAX_RETRY_MSEC));
+    entry.attempts++;
+    entry.not_before = std::chrono::steady_clock::now() +
+                       std::chrono::milliseconds(backoff_msec);
+  }
+}
+
+void PendingDeleter::Run() {
+  std::unique_lock<std::mutex> guard(mutex);
+  while (!closed) {
+    auto next = pending.end();
+    for (auto it = pending.begin() ; it != pending.end() ; ++it) {
+      if (in_progress.count(it->first) > 0) {
+        // DeleteAllNow has it
+        continue;
+      }
+
+      if (next == pending.end() ||
+          it->second.not_before < next->second.not_before) {
+        next = it;
+      }
+    }
+
+    if (next == pending.end()) {
+      cond.wait(guard);
+      continue;
+    }
+
+    if (next->second.not_before > std::chrono::steady_clock::now()) {
+      cond.wait_until(guard, next->second.not_before);
+      continue;
+    }
+
+    const std::string name = next->first;
+    StartLocked(name);
+    guard.unlock();
+    uint64_t nanos = 0;
+    const bool gone = Unlink(name, &nanos);
+    guard.lock();
+    FinishLocked(name, gone, nanos);
+    cond.notify_all();
+  }
+}
+
+void PendingDeleter::Delete(const std::string& name) {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    Entry& entry = pending[name];
+    entry.attempts = 0;
+    entry.not_before = std::chrono::steady_clock::now();
+    stats.queued++;
+    if (!thread.joinable()) {
+      thread = std::thread(&PendingDeleter::Run, this);
+    }
+  }
+
+  cond.notify_all();
+}
+
+bool PendingDeleter::IsPending(const std::string& name) {
+  std::lock_guard<std::mutex> guard(mutex);
+  return (pending.find(name) != pending.end());
+}
+
+bool PendingDeleter::HasPending() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return !pending.empty();
+}
+
+std::vector<std::string> PendingDeleter::ListPending() {
+  std::lock_guard<std::mutex> guard(mutex);
+  std::vector<std::string> names;
+  names.reserve(pending.size());
+  for (const auto& pair : pending) {
+    names.push_back(pair.first);
+  }
+
+  return names;
+}
+
+void PendingDeleter::Claim(const std::string& name) {
+  std::unique_lock<std::mutex> guard(mutex);
+  cond.wait(guard, [this, &name](){ return in_progress.count(name) == 0; });
+  auto it = pending.find(name);
+  if (it == pending.end()) {
+    return;
+  }
+
+  const Entry entry = it->second;
+  pending.erase(it);
+  stats.claimed++;
+  guard.unlock();
+
+  try {
+    FileUtil::Delete(directory + '/' + name);
+  } catch(...) {
+    guard.lock();
+    pending.emplace(name, entry);
+    throw;
+  }
+}
+
+void PendingDeleter::DeleteAllNow() {
+  for (const std::string& name : ListPending()) {
+    // Waits out the background thread's attempt. A name claimed, and maybe
+    // created again, since the snapshot is not ours to unlink anymore
+    {
+      std::unique_lock<std::mutex> guard(mutex);
+      cond.wait(guard, [this, &name](){
+        return in_progress.count(name) == 0;
+      });
+      if (!StartLocked(name)) {
+        continue;
+      }
+    }
+
+    uint64_t nanos = 0;
+    const bool gone = Unlink(name, &nanos);
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      FinishLocked(name, gone, nanos);
+    }
+    cond.notify_all();
+  }
+}
+
+PendingDeleter::Stats PendingDeleter::GetStats() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return stats;
+}
@@ -0,0 +1,144 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_PENDINGDELETER_H_
+#define SRC_STORE_PENDINGDELETER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * Deletes files of one directory on a background thread.
+ * Unlinking a multi gigabyte file that a merge left behind can take long
+ * while the filesystem frees its extents. Callers only queue a name and
+ * return, a failed unlink is retried later with exponential backoff.
+ * A name stays pending until its file is actually gone.
+ */
+class PendingDeleter {
+ public:
+  static const uint32_t MIN_RETRY_MSEC = 10;
+  static const uint32_t MAX_RETRY_MSEC = 10000;
+
+  class Stats {
+   public:
+    // Names handed to Delete
+    uint64_t queued;
+    // Files unlinked, including ones that were already gone
+    uint64_t deleted;
+    // Unlink attempts that failed and were scheduled again
+    uint64_t failed_attempts;
+    // Pending names taken back by Claim and deleted inline
+    uint64_t claimed;
+    uint64_t total_delete_nanos;
+    uint64_t max_delete_nanos;
+
+    Stats()
+      : queued(0),
+        deleted(0),
+        failed_attempts(0),
+        claimed(0),
+        total_delete_nanos(0),
+        max_delete_nanos(0) {
+    }
+  };
+
+ private:
+  class Entry {
+   public:
+    uint32_t attempts;
+    std::chrono::steady_clock::time_point not_before;
+  };
+
+ private:
+  const std::string directory;
+  std::mutex mutex;
+  std::condition_variable cond;
+  // Pending names are expected to be a few, so picking the next one is a
+  // linear scan
+  std::map<std::string, Entry> pending;
+  // Names being unlinked right now, by the background thread or
+  // DeleteAllNow. They stay in `pending` until the unlink is done
+  std::set<std::string> in_progress;
+  std::thread thread;
+  bool closed;
+  Stats stats;
+
+ private:
+  void Run();
+
+  // Returns true when the file is gone. Caller must not hold the lock
+  bool Unlink(const std::string& name, uint64_t* nanos);
+
+  // Marks a pending name as being unlinked unless someone already does.
+  // Lock held
+  bool StartLocked(const std::string& name);
+
+  // Drops the name when it is gone, otherwise schedules a retry
+  void FinishLocked(const std::string& name,
+                    const bool gone,
+                    const uint64_t nanos);
+
+ public:
+  explicit PendingDeleter(const std::string& directory);
+
+  PendingDeleter(const PendingDeleter& other) = delete;
+
+  PendingDeleter& operator=(const PendingDeleter& other) = delete;
+
+  // Stops the background thread. Files still pending are left on the disk
+  ~PendingDeleter();
+
+  // Queues the name. Thread is started on the first call
+  void Delete(const std::string& name);
+
+  bool IsPending(const std::string& name);
+
+  bool HasPending();
+
+  std::vector<std::string> ListPending();
+
+  /**
+   * Takes the name back from the queue and deletes it in the calling
+   * thread, so the name can be created again right after. Waits if the
+   * background thread or DeleteAllNow is in the middle of deleting it.
+   * Throws IOException if the file can not be deleted.
+   */
+  void Claim(const std::string& name);
+
+  // Tries every pending file once in the calling thread, ignoring backoff.
+  // A file the background thread is deleting is waited for instead
+  void DeleteAllNow();
+
+  Stats GetStats();
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_PENDINGDELETER_H_
@@ -0,0 +1,254 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <Index/File.h>
+#include <Store/Exception.h>
+#include <Store/Lock.h>
+#include <Store/RAMDirectory.h>
+#include <Util/Exception.h>
+#include <algorithm>
+#include <cstring>
+
+using lucene::core::index::IndexFileNames;
+using lucene::core::store::IndexInput;
+using lucene::core::store::IndexOutput;
+using lucene::core::store::RAMDirectory;
+using lucene::core::store::RAMFile;
+using lucene::core::store::RAMIndexInput;
+using lucene::core::store::RAMIndexOutput;
+using lucene::core::store::SingleInstanceLockFactory;
+using lucene::core::util::EOFException;
+using lucene::core::util::IOException;
+using lucene::core::util::NoSuchFileException;
+
+/**
+ *  RAMFile
+ */
+const uint32_t RAMFile::BLOCK_BITS;
+const uint32_t RAMFile::BLOCK_LENGTH;
+const uint32_t RAMFile::BLOCK_MASK;
+
+/**
+ *  RAMIndexInput
+ */
+char RAMIndexInput::ReadByte() {
+  if (pos >= length) {
+    throw EOFException("Read past EOF: " + resource_desc);
+  }
+
+  const uint64_t file_pos = base + pos;
+  if (file_pos < block_start || file_pos >= block_end || block == nullptr) {
+    SwitchBlock(file_pos);
+  }
+
+  pos++;
+  return block[file_pos - block_start];
+}
+
+void RAMIndexInput::ReadBytes(char bytes[],
+                              const uint32_t offset,
+                              const uint32_t len) {
+  if (pos + len > length) {
+    throw EOFException("Read past EOF: " + resource_desc);
+  }
+
+  char* dest = bytes + offset;
+  uint32_t left = len;
+  while (left > 0) {
+    const uint64_t file_pos = base + pos;
+    if (file_pos < block_start || file_pos >= block_end || block == nullptr) {
+      SwitchBlock(file_pos);
+    }
+
+    const uint32_t to_copy =
+    static_cast<uint32_t>(std::min<uint64_t>(left, block_end - file_pos));
+    std::memcpy(dest, block + (file_pos - block_start), to_copy);
+    dest += to_copy;
+    pos += to_copy;
+    left -= to_copy;
+  }
+}
+
+void RAMIndexInput::Seek(const uint64_t new_pos) {
+  if (new_pos > length) {
+    throw EOFException("Seek past EOF: " + resource_desc);
+  }
+
+  pos = new_pos;
+}
+
+std::unique_ptr<IndexInput>
+RAMIndexInput::Slice(const std::string& slice_description,
+                     const uint64_t offset,
+                     const uint64_t slice_length) {
+  if (offset + slice_length > length) {
+    throw IOException("Slice is out of bounds: " + slice_description);
+  }
+
+  return std::make_unique<RAMIndexInput>(resource_desc,
+                                         file,
+                                         base + offset,
+                                         slice_length);
+}
+
+/**
+ *  RAMIndexOutput
+ */
+void RAMIndexOutput::WriteBytes(const char bytes[],
+                                const uint32_t offset,
+                                const uint32_t length) {
+  crc.Update(bytes, offset, length);
+
+  const char* src = bytes + offset;
+  uint32_t left = length;
+  while (left > 0) {
+    if (block_idx == RAMFile::BLOCK_LENGTH) {
+      block = file->AddBlock();
+      block_idx = 0;
+    }
+
+    const uint32_t to_copy = std::min(left, RAMFile::BLOCK_LENGTH - block_idx);
+    std::memcpy(block + block_idx, src, to_copy);
+    block_idx += to_copy;
+    src += to_copy;
+    left -= to_copy;
+  }
+
+  pos += length;
+  file->SetLength(pos);
+}
+
+/**
+ *  RAMDirectory
+ */
+RAMDirectory::RAMDirectory()
+  : BaseDirectory(std::make_shared<SingleInstanceLockFactory>()),
+    mutex(),
+    files(),
+    next_temp_file_counter(0) {
+}
+
+std::shared_ptr<RAMFile> RAMDirectory::GetFile(const std::string& name) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto it = files.find(name);
+  if (it == files.end()) {
+    throw NoSuchFileException(name);
+  }
+
+  return it->second;
+}
+
+std::vector<std::string> RAMDirectory::ListAll() {
+  EnsureOpen();
+  std::lock_guard<std::mutex> guard(mutex);
+  std::vector<std::string> names;
+  names.reserve(files.size());
+  for (const auto& pair : files) {
+    names.push_back(pair.first);
+  }
+
+  return names;
+}
+
+bool RAMDirectory::FileExists(const std::string& name) {
+  EnsureOpen();
+  std::lock_guard<std::mutex> guard(mutex);
+  return (files.find(name) != files.end());
+}
+
+void RAMDirectory::DeleteFile(const std::string& name) {
+  EnsureOpen();
+  std::lock_guard<std::mutex> guard(mutex);
+  if (files.erase(name) == 0) {
+    throw NoSuchFileException(name);
+  }
+}
+
+uint64_t RAMDirectory::FileLength(const std::string& name) {
+  EnsureOpen();
+  return GetFile(name)->GetLength();
+}
+
+std::unique_ptr<IndexOutput>
+RAMDirectory::CreateOutput(const std::string& name, const IOContext& context) {
+  EnsureOpen();
+  std::shared_ptr<RAMFile> file = std::make_shared<RAMFile>();
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!files.emplace(name, file).second) {
+      throw IOException("File already exists: " + name);
+    }
+  }
+
+  return std::make_unique<RAMIndexOutput>(name, file);
+}
+
+std::unique_ptr<IndexOutput>
+RAMDirectory::CreateTempOutput(const std::string& prefix,
+                               const std::string& suffix,
+                               const IOContext& context) {
+  EnsureOpen();
+  std::shared_ptr<RAMFile> file = std::make_shared<RAMFile>();
+  std::string name;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    do {
+      name = IndexFileNames::SegmentFileName(
+             prefix,
+             suffix + '_' + std::to_string(next_temp_file_counter++),
+             "tmp");
+    } while (!files.emplace(name, file).second);
+  }
+
+  return std::make_unique<RAMIndexOutput>(name, file);
+}
+
+void RAMDirectory::Rename(const std::string& source, const std::string& dest) {
+  EnsureOpen();
+  std::lock_guard<std::mutex> guard(mutex);
+  auto it = files.find(source);
+  if (it == files.end()) {
+    throw NoSuchFileException(source);
+  }
+
+  std::shared_ptr<RAMFile> file = std::move(it->second);
+  files.erase(it);
+  files[dest] = std::move(file);
+}
+
+std::unique_ptr<IndexInput>
+RAMDirectory::OpenInput(const std::string& name, const IOContext& context) {
+  EnsureOpen();
+  return std::make_unique<RAMIndexInput>("RAMIndexInput(name=" + name + ")",
+                                         GetFile(name));
+}
+
+void RAMDirectory::Close() {
+  is_open = false;
+  std::lock_guard<std::mutex> guard(mutex);
+  files.clear();
+}
+
+uint64_t RAMDirectory::RamBytesUsed() {
+  std::lock_guard<std::mutex> guard(mutex);
+  uint64_t total = 0;
+  for (const auto& pair : files) {
+    total += pair.second->RamBytesUsed();
+  }
+
+  return total;
+}
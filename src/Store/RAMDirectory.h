@@ -0,0 +1,255 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_RAMDIRECTORY_H_
+#define SRC_STORE_RAMDIRECTORY_H_
+
+#include <Store/DataInput.h>
+#include <Store/DataOutput.h>
+#include <Store/Directory.h>
+#include <Util/Etc.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * In-memory file made of fixed size blocks, so growing a file never moves
+ * bytes that were already written.
+ * A file is written by one output and read only after the output is closed.
+ */
+class RAMFile {
+ public:
+  static const uint32_t BLOCK_BITS = 13;
+  static const uint32_t BLOCK_LENGTH = (1U << BLOCK_BITS);
+  static const uint32_t BLOCK_MASK = (BLOCK_LENGTH - 1);
+
+ private:
+  std::vector<std::unique_ptr<char[]>> blocks;
+  std::atomic<uint64_t> length;
+  std::atomic<uint64_t> size_in_bytes;
+
+ public:
+  RAMFile()
+    : blocks(),
+      length(0),
+      size_in_bytes(0) {
+  }
+
+  RAMFile(const RAMFile& other) = delete;
+
+  RAMFile& operator=(const RAMFile& other) = delete;
+
+  char* AddBlock() {
+    blocks.push_back(std::make_unique<char[]>(BLOCK_LENGTH));
+    size_in_bytes.fetch_add(BLOCK_LENGTH, std::memory_order_relaxed);
+    return blocks.back().get();
+  }
+
+  char* GetBlock(const uint32_t index) const noexcept {
+    return blocks[index].get();
+  }
+
+  uint32_t NumBlocks() const noexcept {
+    return static_cast<uint32_t>(blocks.size());
+  }
+
+  uint64_t GetLength() const noexcept {
+    return length.load(std::memory_order_acquire);
+  }
+
+  void SetLength(const uint64_t new_length) noexcept {
+    length.store(new_length, std::memory_order_release);
+  }
+
+  uint64_t RamBytesUsed() const noexcept {
+    return size_in_bytes.load(std::memory_order_relaxed);
+  }
+};
+
+class RAMIndexInput: public IndexInput {
+ private:
+  std::shared_ptr<RAMFile> file;
+  // Slice window in the file
+  const uint64_t base;
+  const uint64_t length;
+  uint64_t pos;
+  // Current block covers [block_start, block_end) of the file
+  const char* block;
+  uint64_t block_start;
+  uint64_t block_end;
+
+ private:
+  void SwitchBlock(const uint64_t file_pos) {
+    const uint32_t index = static_cast<uint32_t>(file_pos >>
+                                                 RAMFile::BLOCK_BITS);
+    block = file->GetBlock(index);
+    block_start = (static_cast<uint64_t>(index) << RAMFile::BLOCK_BITS);
+    block_end = block_start + RAMFile::BLOCK_LENGTH;
+  }
+
+ public:
+  RAMIndexInput(const std::string& resource_desc,
+                const std::shared_ptr<RAMFile>& file)
+    : RAMIndexInput(resource_desc, file, 0, file->GetLength()) {
+  }
+
+  RAMIndexInput(const std::string& resource_desc,
+                const std::shared_ptr<RAMFile>& file,
+                const uint64_t base,
+                const uint64_t length)
+    : IndexInput(resource_desc),
+      file(file),
+      base(base),
+      length(length),
+      pos(0),
+      block(nullptr),
+      block_start(0),
+      block_end(0) {
+  }
+
+  char ReadByte();
+
+  void ReadBytes(char bytes[], const uint32_t offset, const uint32_t len);
+
+  uint64_t GetFilePointer() {
+    return pos;
+  }
+
+  void Seek(const uint64_t new_pos);
+
+  uint64_t Length() {
+    return length;
+  }
+
+  std::unique_ptr<IndexInput>
+  Slice(const std::string& slice_description,
+        const uint64_t offset,
+        const uint64_t slice_length);
+
+  void Close() {
+    file.reset();
+  }
+};
+
+class RAMIndexOutput: public IndexOutput {
+ private:
+  std::shared_ptr<RAMFile> file;
+  lucene::core::util::Crc32 crc;
+  uint64_t pos;
+  char* block;
+  uint32_t block_idx;
+
+ public:
+  RAMIndexOutput(const std::string& name,
+                 const std::shared_ptr<RAMFile>& file)
+    : IndexOutput("RAMIndexOutput(name=" + name + ")", name),
+      file(file),
+      crc(),
+      pos(0),
+      block(nullptr),
+      block_idx(RAMFile::BLOCK_LENGTH) {
+  }
+
+  void WriteByte(const char b) {
+    if (block_idx == RAMFile::BLOCK_LENGTH) {
+      block = file->AddBlock();
+      block_idx = 0;
+    }
+
+    crc.Update(b);
+    block[block_idx++] = b;
+    file->SetLength(++pos);
+  }
+
+  void WriteBytes(const char bytes[],
+                  const uint32_t offset,
+                  const uint32_t length);
+
+  void Close() { }
+
+  uint64_t GetFilePointer() {
+    return pos;
+  }
+
+  uint64_t GetChecksum() {
+    return crc.GetValue();
+  }
+};
+
+/**
+ * Directory keeping every file on the heap. Meant for small, short lived
+ * files such as freshly flushed NRT segments, not for a whole index.
+ */
+class RAMDirectory: public BaseDirectory {
+ private:
+  std::mutex mutex;
+  std::map<std::string, std::shared_ptr<RAMFile>> files;
+  uint32_t next_temp_file_counter;
+
+ private:
+  std::shared_ptr<RAMFile> GetFile(const std::string& name);
+
+ public:
+  RAMDirectory();
+
+  std::vector<std::string> ListAll();
+
+  bool FileExists(const std::string& name);
+
+  void DeleteFile(const std::string& name);
+
+  uint64_t FileLength(const std::string& name);
+
+  std::unique_ptr<IndexOutput>
+  CreateOutput(const std::string& name, const IOContext& context);
+
+  std::unique_ptr<IndexOutput> CreateTempOutput(const std::string& prefix,
+                                                const std::string& suffix,
+                                                const IOContext& context);
+
+  // Nothing to do, the heap is as durable as it gets
+  void Sync(const std::vector<std::string>& names) {
+    EnsureOpen();
+  }
+
+  void Rename(const std::string& source, const std::string& dest);
+
+  void SyncMetaData() {
+    EnsureOpen();
+  }
+
+  std::unique_ptr<IndexInput> OpenInput(const std::string& name,
+                                        const IOContext& context);
+
+  void Close();
+
+  // Bytes allocated by all files in this directory
+  uint64_t RamBytesUsed();
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_RAMDIRECTORY_H_
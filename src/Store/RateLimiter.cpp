@@ -0,0 +1,99 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <Store/RateLimiter.h>
+#include <chrono>
+#include <thread>
+
+using lucene::core::store::SimpleRateLimiter;
+
+namespace {
+
+int64_t NowNS() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+/**
+ *  SimpleRateLimiter
+ */
+const uint32_t SimpleRateLimiter::MIN_PAUSE_CHECK_MSEC;
+
+SimpleRateLimiter::SimpleRateLimiter(const double mb_per_sec)
+  : mutex(),
+    mb_per_sec(0),
+    min_pause_check_bytes(0),
+    next_free_ns(NowNS()),
+    total_paused_ns(0),
+    total_bytes(0) {
+  SetMBPerSec(mb_per_sec);
+}
+
+void SimpleRateLimiter::SetMBPerSec(const double new_mb_per_sec) {
+  std::lock_guard<std::mutex> guard(mutex);
+  mb_per_sec = new_mb_per_sec;
+
+  if (new_mb_per_sec > 0) {
+    min_pause_check_bytes.store(
+      static_cast<uint64_t>((MIN_PAUSE_CHECK_MSEC / 1000.0) *
+                            new_mb_per_sec * 1024 * 1024),
+      std::memory_order_relaxed);
+  } else {
+    // Unlimited. Check rarely so that a later SetMBPerSec is still noticed
+    min_pause_check_bytes.store(64 * 1024 * 1024, std::memory_order_relaxed);
+  }
+}
+
+double SimpleRateLimiter::GetMBPerSec() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return mb_per_sec;
+}
+
+uint64_t SimpleRateLimiter::Pause(const uint64_t bytes) {
+  total_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  int64_t now;
+  int64_t target;
+
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (mb_per_sec <= 0) {
+      return 0;
+    }
+
+    now = NowNS();
+    // Idle time is not banked, otherwise a long quiet period
+    // would allow an unbounded burst afterward
+    if (next_free_ns < now) {
+      next_free_ns = now;
+    }
+
+    target = next_free_ns +
+             static_cast<int64_t>(bytes * 1e9 / (mb_per_sec * 1024 * 1024));
+    next_free_ns = target;
+  }
+
+  if (target <= now) {
+    return 0;
+  }
+
+  std::this_thread::sleep_for(std::chrono::nanoseconds(target - now));
+  const uint64_t paused = static_cast<uint64_t>(NowNS() - now);
+  total_paused_ns.fetch_add(paused, std::memory_order_relaxed);
+  return paused;
+}
@@ -0,0 +1,96 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_RATELIMITER_H_
+#define SRC_STORE_RATELIMITER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+class RateLimiter {
+ public:
+  RateLimiter() = default;
+
+  virtual ~RateLimiter() = default;
+
+  virtual void SetMBPerSec(const double mb_per_sec) = 0;
+
+  virtual double GetMBPerSec() = 0;
+
+  /**
+   * Pauses, if necessary, to keep the written bytes under the rate.
+   * Returns the pause time in nanoseconds.
+   */
+  virtual uint64_t Pause(const uint64_t bytes) = 0;
+
+  // How many bytes caller should add up before calling Pause
+  virtual uint64_t GetMinPauseCheckBytes() = 0;
+};
+
+/**
+ * Token bucket that many outputs in many threads can share.
+ * Each Pause call books its own slot on a shared timeline under a lock and
+ * then sleeps outside the lock, so the total rate of all callers stays
+ * under the limit.
+ */
+class SimpleRateLimiter: public RateLimiter {
+ public:
+  // Pause at most every this many milliseconds worth of bytes
+  static const uint32_t MIN_PAUSE_CHECK_MSEC = 5;
+
+ private:
+  std::mutex mutex;
+  double mb_per_sec;
+  std::atomic<uint64_t> min_pause_check_bytes;
+  // Time when the bytes booked so far will have been paid off
+  int64_t next_free_ns;
+  std::atomic<uint64_t> total_paused_ns;
+  std::atomic<uint64_t> total_bytes;
+
+ public:
+  explicit SimpleRateLimiter(const double mb_per_sec);
+
+  // Zero or negative value turns the limit off
+  void SetMBPerSec(const double new_mb_per_sec);
+
+  double GetMBPerSec();
+
+  uint64_t Pause(const uint64_t bytes);
+
+  uint64_t GetMinPauseCheckBytes() {
+    return min_pause_check_bytes.load(std::memory_order_relaxed);
+  }
+
+  uint64_t GetTotalPausedNS() const noexcept {
+    return total_paused_ns.load(std::memory_order_relaxed);
+  }
+
+  uint64_t GetTotalBytes() const noexcept {
+    return total_bytes.load(std::memory_order_relaxed);
+  }
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_RATELIMITER_H_
@@ -0,0 +1,216 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <Index/File.h>
+#include <Store/TrackingDirectory.h>
+
+using lucene::core::index::IndexFileNames;
+using lucene::core::store::IndexInput;
+using lucene::core::store::IndexOutput;
+using lucene::core::store::IOCounters;
+using lucene::core::store::IOStats;
+using lucene::core::store::Lock;
+using lucene::core::store::TrackingDirectory;
+using lucene::core::store::TrackingIndexInput;
+using lucene::core::store::TrackingIndexOutput;
+
+const uint32_t IOStats::NUM_LATENCY_BUCKETS;
+const uint32_t TrackingIndexInput::FLUSH_INTERVAL_OPS;
+
+/**
+ *  IOStats
+ */
+IOStats::IOStats()
+  : opens(0),
+    bytes_read(0),
+    read_ops(0),
+    seeks(0),
+    bytes_written(0),
+    write_ops(0),
+    read_nanos(0),
+    write_nanos(0),
+    read_latency(),
+    write_latency() {
+}
+
+void IOStats::Merge(const IOStats& other) {
+  opens += other.opens;
+  bytes_read += other.bytes_read;
+  read_ops += other.read_ops;
+  seeks += other.seeks;
+  bytes_written += other.bytes_written;
+  write_ops += other.write_ops;
+  read_nanos += other.read_nanos;
+  write_nanos += other.write_nanos;
+  for (uint32_t i = 0 ; i < NUM_LATENCY_BUCKETS ; ++i) {
+    read_latency[i] += other.read_latency[i];
+    write_latency[i] += other.write_latency[i];
+  }
+}
+
+/**
+ *  IOCounters
+ */
+IOCounters::IOCounters()
+  : opens(0),
+    bytes_read(0),
+    read_ops(0),
+    seeks(0),
+    bytes_written(0),
+    write_ops(0),
+    read_nanos(0),
+    write_nanos(0) {
+  for (uint32_t i = 0 ; i < IOStats::NUM_LATENCY_BUCKETS ; ++i) {
+    read_latency[i].store(0, std::memory_order_relaxed);
+    write_latency[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+IOStats IOCounters::Snapshot() const {
+  IOStats stats;
+  stats.opens = opens.load(std::memory_order_relaxed);
+  stats.bytes_read = bytes_read.load(std::memory_order_relaxed);
+  stats.read_ops = read_ops.load(std::memory_order_relaxed);
+  stats.seeks = seeks.load(std::memory_order_relaxed);
+  stats.bytes_written = bytes_written.load(std::memory_order_relaxed);
+  stats.write_ops = write_ops.load(std::memory_order_relaxed);
+  stats.read_nanos = read_nanos.load(std::memory_order_relaxed);
+  stats.write_nanos = write_nanos.load(std::memory_order_relaxed);
+  for (uint32_t i = 0 ; i < IOStats::NUM_LATENCY_BUCKETS ; ++i) {
+    stats.read_latency[i] = read_latency[i].load(std::memory_order_relaxed);
+    stats.write_latency[i] = write_latency[i].load(std::memory_order_relaxed);
+  }
+
+  return stats;
+}
+
+/**
+ *  TrackingDirectory
+ */
+TrackingDirectory::TrackingDirectory(const std::shared_ptr<Directory>& delegate)
+  : Directory(),
+    delegate(delegate),
+    mutex(),
+    counters() {
+}
+
+std::shared_ptr<IOCounters>
+TrackingDirectory::GetCounters(const std::string& name,
+                               const IOContext& context) {
+  Key key(IndexFileNames::GetExtension(name), context.context);
+  std::lock_guard<std::mutex> guard(mutex);
+  std::shared_ptr<IOCounters>& found = counters[std::move(key)];
+  if (!found) {
+    found = std::make_shared<IOCounters>();
+  }
+
+  found->opens.fetch_add(1, std::memory_order_relaxed);
+  return found;
+}
+
+std::vector<TrackingDirectory::Entry> TrackingDirectory::GetStats() {
+  std::lock_guard<std::mutex> guard(mutex);
+  std::vector<Entry> entries;
+  entries.reserve(counters.size());
+  for (const auto& pair : counters) {
+    entries.push_back(Entry{pair.first.first,
+                            pair.first.second,
+                            pair.second->Snapshot()});
+  }
+
+  return entries;
+}
+
+IOStats TrackingDirectory::GetStats(const std::string& extension) {
+  std::lock_guard<std::mutex> guard(mutex);
+  IOStats stats;
+  for (auto it = counters.lower_bound(Key(extension, IOContext::Context()))
+       ; it != counters.end() && it->first.first == extension ; ++it) {
+    stats.Merge(it->second->Snapshot());
+  }
+
+  return stats;
+}
+
+void TrackingDirectory::ResetStats() {
+  // Open inputs and outputs keep counting into the old counters
+  std::lock_guard<std::mutex> guard(mutex);
+  counters.clear();
+}
+
+std::vector<std::string> TrackingDirectory::ListAll() {
+  return delegate->ListAll();
+}
+
+void TrackingDirectory::DeleteFile(const std::string& name) {
+  delegate->DeleteFile(name);
+}
+
+uint64_t TrackingDirectory::FileLength(const std::string& name) {
+  return delegate->FileLength(name);
+}
+
+std::unique_ptr<IndexOutput>
+TrackingDirectory::CreateOutput(const std::string& name,
+                                const IOContext& context) {
+  std::unique_ptr<IndexOutput> output = delegate->CreateOutput(name, context);
+  return std::make_unique<TrackingIndexOutput>(std::move(output),
+                                               GetCounters(name, context));
+}
+
+std::unique_ptr<IndexOutput>
+TrackingDirectory::CreateTempOutput(const std::string& prefix,
+                                    const std::string& suffix,
+                                    const IOContext& context) {
+  std::unique_ptr<IndexOutput> output =
+    delegate->CreateTempOutput(prefix, suffix, context);
+  std::shared_ptr<IOCounters> output_counters =
+    GetCounters(output->GetName(), context);
+  return std::make_unique<TrackingIndexOutput>(std::move(output),
+                                               std::move(output_counters));
+}
+
+void TrackingDirectory::Sync(const std::vector<std::string>& names) {
+  delegate->Sync(names);
+}
+
+void TrackingDirectory::Rename(const std::string& source,
+                               const std::string& dest) {
+  delegate->Rename(source, dest);
+}
+
+void TrackingDirectory::SyncMetaData() {
+  delegate->SyncMetaData();
+}
+
+std::unique_ptr<IndexInput>
+TrackingDirectory::OpenInput(const std::string& name,
+                             const IOContext& context) {
+  std::unique_ptr<IndexInput> input = delegate->OpenInput(name, context);
+  return std::make_unique<TrackingIndexInput>(
+         std::string("TrackingIndexInput(") + name + ')',
+         std::move(input),
+         GetCounters(name, context));
+}
+
+std::unique_ptr<Lock> TrackingDirectory::ObtainLock(const std::string& name) {
+  return delegate->ObtainLock(name);
+}
+
+void TrackingDirectory::Close() {
+  delegate->Close();
+}
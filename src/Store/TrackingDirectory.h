@@ -0,0 +1,474 @@
+/*
+ *
+ * Copyright (c) 2018-2019 Doo Yong Kim. All rights reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SRC_STORE_TRACKINGDIRECTORY_H_
+#define SRC_STORE_TRACKINGDIRECTORY_H_
+
+#include <Store/Directory.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lucene {
+namespace core {
+namespace store {
+
+/**
+ * Point in time copy of I/O counters.
+ * Latency histograms are log2 scaled, bucket `i` counts operations that
+ * took [2^i, 2^(i+1)) nanoseconds. Only bulk reads and writes (ReadBytes,
+ * ReadBytesRef and WriteBytes) are timed, timing every single byte would
+ * cost more than the byte itself.
+ */
+class IOStats {
+ public:
+  static const uint32_t NUM_LATENCY_BUCKETS = 40;
+
+  uint64_t opens;
+  uint64_t bytes_read;
+  uint64_t read_ops;
+  uint64_t seeks;
+  uint64_t bytes_written;
+  uint64_t write_ops;
+  uint64_t read_nanos;
+  uint64_t write_nanos;
+  uint64_t read_latency[NUM_LATENCY_BUCKETS];
+  uint64_t write_latency[NUM_LATENCY_BUCKETS];
+
+  IOStats();
+
+  void Merge(const IOStats& other);
+
+  static uint32_t LatencyBucket(const uint64_t nanos) noexcept {
+    const uint32_t bucket = 63 - __builtin_clzll(nanos | 1);
+    return (bucket < NUM_LATENCY_BUCKETS ? bucket : NUM_LATENCY_BUCKETS - 1);
+  }
+};
+
+// Shared counters of one (extension, context) pair
+class IOCounters {
+ public:
+  std::atomic<uint64_t> opens;
+  std::atomic<uint64_t> bytes_read;
+  std::atomic<uint64_t> read_ops;
+  std::atomic<uint64_t> seeks;
+  std::atomic<uint64_t> bytes_written;
+  std::atomic<uint64_t> write_ops;
+  std::atomic<uint64_t> read_nanos;
+  std::atomic<uint64_t> write_nanos;
+  std::atomic<uint64_t> read_latency[IOStats::NUM_LATENCY_BUCKETS];
+  std::atomic<uint64_t> write_latency[IOStats::NUM_LATENCY_BUCKETS];
+
+  IOCounters();
+
+  IOStats Snapshot() const;
+};
+
+/**
+ * Counts everything read through the delegate. Counts are kept locally
+ * and added to the shared counters every FLUSH_INTERVAL_OPS operations
+ * and on Close, so search threads do not fight over the counters' cache
+ * lines. A snapshot can be behind by that many operations per open input.
+ * Every call goes to the delegate's own version of it, positional reads
+ * included, so wrapping an input does not change how it reads.
+ */
+class TrackingIndexInput: public IndexInput, public RandomAccessInput {
+ public:
+  static const uint32_t FLUSH_INTERVAL_OPS = 1024;
+
+ private:
+  std::unique_ptr<IndexInput> delegate;
+  // Delegate itself when it reads positionally, otherwise nullptr
+  RandomAccessInput* random_access;
+  std::shared_ptr<IOCounters> counters;
+  uint64_t local_bytes;
+  uint32_t local_ops;
+  uint32_t local_seeks;
+
+ private:
+  // Encoded length of a VInt, same for a VInt64
+  static uint32_t VIntSize(const uint64_t value) noexcept {
+    return (value == 0 ? 1 : (70 - __builtin_clzll(value)) / 7);
+  }
+
+  void Count(const uint64_t bytes) {
+    local_bytes += bytes;
+    if (++local_ops >= FLUSH_INTERVAL_OPS) {
+      Flush();
+    }
+  }
+
+  void Flush() {
+    counters->bytes_read.fetch_add(local_bytes, std::memory_order_relaxed);
+    counters->read_ops.fetch_add(local_ops, std::memory_order_relaxed);
+    counters->seeks.fetch_add(local_seeks, std::memory_order_relaxed);
+    local_bytes = 0;
+    local_ops = 0;
+    local_seeks = 0;
+  }
+
+  void RecordLatency(const std::chrono::steady_clock::time_point start) {
+    const uint64_t nanos =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+    counters->read_nanos.fetch_add(nanos, std::memory_order_relaxed);
+    counters->read_latency[IOStats::LatencyBucket(nanos)].fetch_add(
+      1, std::memory_order_relaxed);
+  }
+
+ public:
+  TrackingIndexInput(const std::string& resource_desc,
+                     std::unique_ptr<IndexInput>&& delegate,
+                     const std::shared_ptr<IOCounters>& counters)
+    : IndexInput(resource_desc),
+      delegate(std::forward<std::unique_ptr<IndexInput>>(delegate)),
+      random_access(dynamic_cast<RandomAccessInput*>(this->delegate.get())),
+      counters(counters),
+      local_bytes(0),
+      local_ops(0),
+      local_seeks(0) {
+  }
+
+  ~TrackingIndexInput() {
+    Flush();
+  }
+
+  char ReadByte() {
+    Count(1);
+    return delegate->ReadByte();
+  }
+
+  void ReadBytes(char bytes[], const uint32_t offset, const uint32_t len) {
+    const auto start = std::chrono::steady_clock::now();
+    delegate->ReadBytes(bytes, offset, len);
+    RecordLatency(start);
+    Count(len);
+  }
+
+  int16_t ReadInt16() {
+    Count(sizeof(int16_t));
+    return delegate->ReadInt16();
+  }
+
+  int32_t ReadInt32() {
+    Count(sizeof(int32_t));
+    return delegate->ReadInt32();
+  }
+
+  int64_t ReadInt64() {
+    Count(sizeof(int64_t));
+    return delegate->ReadInt64();
+  }
+
+  int32_t ReadVInt32() {
+    const int32_t value = delegate->ReadVInt32();
+    Count(VIntSize(static_cast<uint32_t>(value)));
+    return value;
+  }
+
+  int64_t ReadVInt64() {
+    const int64_t value = delegate->ReadVInt64();
+    Count(VIntSize(static_cast<uint64_t>(value)));
+    return value;
+  }
+
+  std::string ReadString() {
+    std::string value = delegate->ReadString();
+    Count(VIntSize(value.size()) + value.size());
+    return value;
+  }
+
+  void SkipBytes(const int64_t num_bytes) {
+    delegate->SkipBytes(num_bytes);
+    Count(static_cast<uint64_t>(num_bytes));
+  }
+
+  // Bulk reads go to the delegate's own, they are one operation each
+  void ReadVInt32s(int32_t dst[], const uint32_t n) {
+    const uint64_t start_pos = delegate->GetFilePointer();
+    delegate->ReadVInt32s(dst, n);
+    Count(delegate->GetFilePointer() - start_pos);
+  }
+
+  void ReadInt16s(int16_t dst[], const uint32_t n) {
+    delegate->ReadInt16s(dst, n);
+    Count(static_cast<uint64_t>(n) * sizeof(int16_t));
+  }
+
+  void ReadInt32s(int32_t dst[], const uint32_t n) {
+    delegate->ReadInt32s(dst, n);
+    Count(static_cast<uint64_t>(n) * sizeof(int32_t));
+  }
+
+  void ReadInt64s(int64_t dst[], const uint32_t n) {
+    delegate->ReadInt64s(dst, n);
+    Count(static_cast<uint64_t>(n) * sizeof(int64_t));
+  }
+
+  lucene::core::util::BytesRef ReadBytesRef(const uint32_t len) {
+    const auto start = std::chrono::steady_clock::now();
+    lucene::core::util::BytesRef ref = delegate->ReadBytesRef(len);
+    RecordLatency(start);
+    Count(len);
+    return ref;
+  }
+
+  // Positional reads do not move the file pointer, so they are not seeks
+  char ReadByte(const uint64_t pos) {
+    Count(1);
+    if (random_access != nullptr) {
+      return random_access->ReadByte(pos);
+    }
+    delegate->Seek(pos);
+    return delegate->ReadByte();
+  }
+
+  int16_t ReadInt16(const uint64_t pos) {
+    Count(sizeof(int16_t));
+    if (random_access != nullptr) {
+      return random_access->ReadInt16(pos);
+    }
+    delegate->Seek(pos);
+    return delegate->ReadInt16();
+  }
+
+  int32_t ReadInt32(const uint64_t pos) {
+    Count(sizeof(int32_t));
+    if (random_access != nullptr) {
+      return random_access->ReadInt32(pos);
+    }
+    delegate->Seek(pos);
+    return delegate->ReadInt32();
+  }
+
+  int64_t ReadInt64(const uint64_t pos) {
+    Count(sizeof(int64_t));
+    if (random_access != nullptr) {
+      return random_access->ReadInt64(pos);
+    }
+    delegate->Seek(pos);
+    return delegate->ReadInt64();
+  }
+
+  void ReadInt16s(const uint64_t pos, int16_t dst[], const uint32_t n) {
+    Count(static_cast<uint64_t>(n) * sizeof(int16_t));
+    if (random_access != nullptr) {
+      random_access->ReadInt16s(pos, dst, n);
+    } else {
+      delegate->Seek(pos);
+      delegate->ReadInt16s(dst, n);
+    }
+  }
+
+  void ReadInt32s(const uint64_t pos, int32_t dst[], const uint32_t n) {
+    Count(static_cast<uint64_t>(n) * sizeof(int32_t));
+    if (random_access != nullptr) {
+      random_access->ReadInt32s(pos, dst, n);
+    } else {
+      delegate->Seek(pos);
+      delegate->ReadInt32s(dst, n);
+    }
+  }
+
+  void ReadInt64s(const uint64_t pos, int64_t dst[], const uint32_t n) {
+    Count(static_cast<uint64_t>(n) * sizeof(int64_t));
+    if (random_access != nullptr) {
+      random_access->ReadInt64s(pos, dst, n);
+    } else {
+      delegate->Seek(pos);
+      delegate->ReadInt64s(dst, n);
+    }
+  }
+
+  void Close() {
+    Flush();
+    delegate->Close();
+  }
+
+  uint64_t GetFilePointer() {
+    return delegate->GetFilePointer();
+  }
+
+  void Seek(const uint64_t pos) {
+    local_seeks++;
+    delegate->Seek(pos);
+  }
+
+  uint64_t Length() {
+    return delegate->Length();
+  }
+
+  void Prefetch(const uint64_t offset, const uint64_t length) {
+    delegate->Prefetch(offset, length);
+  }
+
+  // Slice is counted with the file it was taken from
+  std::unique_ptr<IndexInput> Slice(const std::string& slice_desc,
+                                    const uint64_t offset,
+                                    const uint64_t length) {
+    return std::make_unique<TrackingIndexInput>(
+           slice_desc,
+           delegate->Slice(slice_desc, offset, length),
+           counters);
+  }
+};
+
+class TrackingIndexOutput: public IndexOutput {
+ private:
+  std::unique_ptr<IndexOutput> delegate;
+  std::shared_ptr<IOCounters> counters;
+  uint64_t local_bytes;
+  uint64_t local_ops;
+
+ private:
+  void Flush() {
+    counters->bytes_written.fetch_add(local_bytes, std::memory_order_relaxed);
+    counters->write_ops.fetch_add(local_ops, std::memory_order_relaxed);
+    local_bytes = 0;
+    local_ops = 0;
+  }
+
+ public:
+  TrackingIndexOutput(std::unique_ptr<IndexOutput>&& delegate,
+                      const std::shared_ptr<IOCounters>& counters)
+    : IndexOutput(std::string("TrackingIndexOutput(") +
+                  delegate->GetName() + ')',
+                  delegate->GetName()),
+      delegate(std::forward<std::unique_ptr<IndexOutput>>(delegate)),
+      counters(counters),
+      local_bytes(0),
+      local_ops(0) {
+  }
+
+  ~TrackingIndexOutput() {
+    Flush();
+  }
+
+  void WriteByte(const char b) {
+    local_bytes++;
+    local_ops++;
+    delegate->WriteByte(b);
+  }
+
+  void WriteBytes(const char bytes[],
+                  const uint32_t offset,
+                  const uint32_t length) {
+    const auto start = std::chrono::steady_clock::now();
+    delegate->WriteBytes(bytes, offset, length);
+    const uint64_t nanos =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+    counters->write_nanos.fetch_add(nanos, std::memory_order_relaxed);
+    counters->write_latency[IOStats::LatencyBucket(nanos)].fetch_add(
+      1, std::memory_order_relaxed);
+    local_bytes += length;
+    local_ops++;
+  }
+
+  void Close() {
+    Flush();
+    delegate->Close();
+  }
+
+  uint64_t GetFilePointer() {
+    return delegate->GetFilePointer();
+  }
+
+  uint64_t GetChecksum() {
+    return delegate->GetChecksum();
+  }
+};
+
+/**
+ * Wraps a directory and records I/O of every input and output it hands
+ * out, broken down by file extension and IOContext::Context. It tells
+ * whether a slow query spends its time in the terms dictionary, postings
+ * or stored fields.
+ */
+class TrackingDirectory: public Directory {
+ public:
+  class Entry {
+   public:
+    std::string extension;
+    IOContext::Context context;
+    IOStats stats;
+  };
+
+ private:
+  using Key = std::pair<std::string, IOContext::Context>;
+
+ private:
+  std::shared_ptr<Directory> delegate;
+  std::mutex mutex;
+  std::map<Key, std::shared_ptr<IOCounters>> counters;
+
+ private:
+  std::shared_ptr<IOCounters> GetCounters(const std::string& name,
+                                          const IOContext& context);
+
+ public:
+  explicit TrackingDirectory(const std::shared_ptr<Directory>& delegate);
+
+  const std::shared_ptr<Directory>& GetDelegate() const noexcept {
+    return delegate;
+  }
+
+  // Snapshot of every (extension, context) seen so far
+  std::vector<Entry> GetStats();
+
+  // Sum over every context of given extension, e.g. "tim"
+  IOStats GetStats(const std::string& extension);
+
+  void ResetStats();
+
+  std::vector<std::string> ListAll();
+
+  void DeleteFile(const std::string& name);
+
+  uint64_t FileLength(const std::string& name);
+
+  std::unique_ptr<IndexOutput>
+  CreateOutput(const std::string& name, const IOContext& context);
+
+  std::unique_ptr<IndexOutput> CreateTempOutput(const std::string& prefix,
+                                                const std::string& suffix,
+                                                const IOContext& context);
+
+  void Sync(const std::vector<std::string>& names);
+
+  void Rename(const std::string& source, const std::string& dest);
+
+  void SyncMetaData();
+
+  std::unique_ptr<IndexInput> OpenInput(const std::string& name,
+                                        const IOContext& context);
+
+  std::unique_ptr<Lock> ObtainLock(const std::string& name);
+
+  void Close();
+};
+
+}  // namespace store
+}  // namespace core
+}  // namespace lucene
+
+#endif  // SRC_STORE_TRACKINGDIRECTORY_H_
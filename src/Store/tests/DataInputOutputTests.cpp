@@ -16,12 +16,21 @@
  */
 
 #include <assert.h>
+#include <sys/resource.h>
 #include <gtest/gtest.h>
 #include <Store/Directory.h>
+#include <Util/Bits.h>
 #include <Util/File.h>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 using lucene::core::store::ByteArrayReferenceDataInput;
 using lucene::core::store::MMapDirectory;
@@ -30,9 +39,27 @@ using lucene::core::store::IndexOutput;
 using lucene::core::store::IOContext;
 using lucene::core::store::BytesArrayReferenceIndexInput;
 using lucene::core::store::FileIndexOutput;
+using lucene::core::store::DirectIndexOutput;
+using lucene::core::store::FlushInfo;
+using lucene::core::store::MergeInfo;
+using lucene::core::store::WriteBehindFlusher;
+using lucene::core::store::RateLimitedIndexOutput;
+using lucene::core::store::SimpleRateLimiter;
 using lucene::core::store::GrowableByteArrayDataOutput;
 using lucene::core::store::BufferedChecksumIndexInput;
+using lucene::core::store::ChecksumIndexInput;
+using lucene::core::store::Directory;
+using lucene::core::store::PReadDirectory;
+using lucene::core::store::RandomAccessInput;
+using lucene::core::store::ByteBufferIndexInput;
+using lucene::core::store::BufferedIndexInput;
+using lucene::core::store::IoUringDirectory;
+using lucene::core::util::Crc32Util;
+using lucene::core::util::EndianUtil;
+using lucene::core::util::EOFException;
 using lucene::core::util::FileUtil;
+using lucene::core::util::IOException;
+using lucene::core::util::VIntUtil;
 
 TEST(DATA__OUTPUT__TESTS, FILE__INDEX__OUT) {
   FileUtil::Delete("/tmp/kdy");
@@ -53,6 +80,224 @@ TEST(DATA__OUTPUT__TESTS, FILE__INDEX__OUT) {
   EXPECT_EQ(2865713097, fio.GetChecksum());
 }
 
+TEST(DATA__OUTPUT__TESTS, WRITE__BEHIND__FILE__INDEX__OUT) {
+  // Buffer size follows IOContext
+  EXPECT_EQ(FileIndexOutput::BUF_SIZE,
+            FileIndexOutput::BufferSize(IOContext::DEFAULT));
+  EXPECT_EQ(FileIndexOutput::MAX_BUF_SIZE,
+            FileIndexOutput::BufferSize(
+              IOContext(FlushInfo(1000, 1024L * 1024L * 1024L))));
+  EXPECT_EQ(65536,
+            FileIndexOutput::BufferSize(
+              IOContext(MergeInfo(1000, 4 * 1024 * 1024, false, 1))));
+
+  FileUtil::Delete("/tmp/kdy_write_behind");
+  std::shared_ptr<WriteBehindFlusher> flusher =
+  std::make_shared<WriteBehindFlusher>(2);
+  FileIndexOutput fio("A write behind file index output",
+                      "For testing",
+                      "/tmp/kdy_write_behind",
+                      1024,
+                      flusher);
+  ASSERT_TRUE(fio.IsWriteBehind());
+
+  const uint32_t buf_size = 100000;
+  char buf[buf_size];
+  for (int i = 0 ; i < buf_size ; ++i) {
+    buf[i] = static_cast<char>(i);
+  }
+
+  // Mix of single bytes and chunks larger than the buffer
+  fio.WriteBytes(buf, 0, 77);
+  for (int i = 77 ; i < 5000 ; ++i) {
+    fio.WriteByte(buf[i]);
+  }
+  fio.WriteBytes(buf, 5000, buf_size - 5000);
+
+  EXPECT_EQ(buf_size, fio.GetFilePointer());
+  // Same Crc32 value with FILE__INDEX__OUT
+  EXPECT_EQ(2865713097, fio.GetChecksum());
+  fio.Close();
+
+  MMapDirectory dir("/tmp");
+  std::unique_ptr<IndexInput> in_ptr =
+  dir.OpenInput("kdy_write_behind", IOContext::READ);
+  ASSERT_EQ(buf_size, in_ptr->Length());
+  for (int i = 0 ; i < buf_size ; ++i) {
+    ASSERT_EQ(buf[i], in_ptr->ReadByte());
+  }
+}
+
+TEST(DATA__OUTPUT__TESTS, WRITE__BEHIND__FAILED__WRITE) {
+  // Writes past the file size limit fail with EFBIG on the flusher thread
+  FileUtil::Delete("/tmp/kdy_write_behind_failed");
+  struct rlimit old_limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_FSIZE, &old_limit));
+  struct rlimit limit = old_limit;
+  limit.rlim_cur = 10000;
+  void (*old_handler)(int) = std::signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(0, setrlimit(RLIMIT_FSIZE, &limit));
+
+  {
+    std::shared_ptr<WriteBehindFlusher> flusher =
+    std::make_shared<WriteBehindFlusher>(1);
+    FileIndexOutput fio("A failing write behind output",
+                        "For testing",
+                        "/tmp/kdy_write_behind_failed",
+                        4096,
+                        flusher);
+    try {
+      for (uint32_t i = 0 ; i < 100000 ; ++i) {
+        fio.WriteByte(static_cast<char>(i));
+      }
+    } catch(IOException&) {
+      // Failed write surfaced while writing
+    }
+
+    // Error is not lost to whoever waited on it first
+    EXPECT_THROW(fio.GetChecksum(), IOException);
+    EXPECT_THROW(fio.Close(), IOException);
+  }
+
+  setrlimit(RLIMIT_FSIZE, &old_limit);
+  std::signal(SIGXFSZ, old_handler);
+  FileUtil::Delete("/tmp/kdy_write_behind_failed");
+}
+
+TEST(DATA__OUTPUT__TESTS, RATE__LIMITED__INDEX__OUT) {
+  std::shared_ptr<SimpleRateLimiter> limiter =
+  std::make_shared<SimpleRateLimiter>(20);
+  // 5 msec worth of bytes at 20MB/s
+  EXPECT_EQ(104857, limiter->GetMinPauseCheckBytes());
+
+  MMapDirectory dir("/tmp");
+  dir.SetMergeRateLimiter(limiter);
+  const IOContext merge_ctx(MergeInfo(1000, 2 * 1024 * 1024, false, 1));
+  FileUtil::Delete("/tmp/kdy_rate_limited_0");
+  FileUtil::Delete("/tmp/kdy_rate_limited_1");
+  FileUtil::Delete("/tmp/kdy_not_rate_limited");
+
+  // Flush is never throttled
+  std::unique_ptr<IndexOutput> flush_out =
+  dir.CreateOutput("kdy_not_rate_limited", IOContext::DEFAULT);
+  ASSERT_EQ(nullptr,
+            dynamic_cast<RateLimitedIndexOutput*>(flush_out.get()));
+  flush_out->Close();
+
+  const uint32_t buf_size = 1024 * 1024;
+  std::unique_ptr<char[]> buf = std::make_unique<char[]>(buf_size);
+  for (uint32_t i = 0 ; i < buf_size ; ++i) {
+    buf[i] = static_cast<char>(i);
+  }
+
+  // Two merges share one limiter, 2MB in total takes about 100 msec
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0 ; t < 2 ; ++t) {
+    threads.emplace_back([&dir, &merge_ctx, &buf, buf_size, t](){
+      std::unique_ptr<IndexOutput> out =
+      dir.CreateOutput("kdy_rate_limited_" + std::to_string(t), merge_ctx);
+      ASSERT_NE(nullptr, dynamic_cast<RateLimitedIndexOutput*>(out.get()));
+      for (uint32_t i = 0 ; i < buf_size ; i += 4096) {
+        out->WriteBytes(buf.get(), i, 4096);
+      }
+      ASSERT_EQ(buf_size, out->GetFilePointer());
+      out->Close();
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const uint64_t elapsed_ms =
+  std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - start).count();
+
+  // Last check window can stay unpaid
+  EXPECT_LE(80, elapsed_ms);
+  EXPECT_LT(0, limiter->GetTotalPausedNS());
+  EXPECT_GE(2 * buf_size, limiter->GetTotalBytes());
+
+  for (int t = 0 ; t < 2 ; ++t) {
+    std::unique_ptr<IndexInput> in =
+    dir.OpenInput("kdy_rate_limited_" + std::to_string(t), IOContext::READ);
+    ASSERT_EQ(buf_size, in->Length());
+    for (uint32_t i = 0 ; i < buf_size ; ++i) {
+      ASSERT_EQ(buf[i], in->ReadByte());
+    }
+  }
+
+  // Check window follows the new rate
+  limiter->SetMBPerSec(40);
+  EXPECT_EQ(209715, limiter->GetMinPauseCheckBytes());
+}
+
+TEST(DATA__OUTPUT__TESTS, DIRECT__INDEX__OUT) {
+  const uint32_t buf_size = 100000;
+  char buf[buf_size];
+  for (int i = 0 ; i < buf_size ; ++i) {
+    buf[i] = static_cast<char>(i);
+  }
+
+  FileUtil::Delete("/tmp/kdy_direct");
+  {
+    DirectIndexOutput dio("A direct index output",
+                          "For testing",
+                          "/tmp/kdy_direct",
+                          10000,
+                          std::shared_ptr<std::atomic<uint64_t>>());
+    // Tail is not a multiple of the alignment
+    dio.WriteBytes(buf, 0, 3);
+    for (int i = 3 ; i < 5000 ; ++i) {
+      dio.WriteByte(buf[i]);
+    }
+    dio.WriteBytes(buf, 5000, buf_size - 5000);
+    EXPECT_EQ(buf_size, dio.GetFilePointer());
+    // Same Crc32 value with FILE__INDEX__OUT
+    EXPECT_EQ(2865713097, dio.GetChecksum());
+    dio.Close();
+  }
+  ASSERT_EQ(buf_size, FileUtil::Size("/tmp/kdy_direct"));
+
+  MMapDirectory dir("/tmp");
+  {
+    std::unique_ptr<IndexInput> in = dir.OpenInput("kdy_direct",
+                                                   IOContext::READ);
+    for (int i = 0 ; i < buf_size ; ++i) {
+      ASSERT_EQ(buf[i], in->ReadByte());
+    }
+  }
+
+  // Only large merges take the direct path
+  EXPECT_EQ(0, dir.GetDirectIOMergeThreshold());
+  dir.SetDirectIOMergeThreshold(1024 * 1024);
+  FileUtil::Delete("/tmp/kdy_direct_merge");
+  FileUtil::Delete("/tmp/kdy_small_merge");
+  FileUtil::Delete("/tmp/kdy_direct_flush");
+  const IOContext large_merge(MergeInfo(1000, 4 * 1024 * 1024, false, 1));
+  const IOContext small_merge(MergeInfo(10, 4096, false, 1));
+  const IOContext flush(FlushInfo(1000, 4 * 1024 * 1024));
+
+  std::unique_ptr<IndexOutput> out =
+  dir.CreateOutput("kdy_direct_merge", large_merge);
+  ASSERT_NE(nullptr, dynamic_cast<DirectIndexOutput*>(out.get()));
+  out->WriteBytes(buf, 0, buf_size);
+  out->Close();
+
+  out = dir.CreateOutput("kdy_small_merge", small_merge);
+  ASSERT_EQ(nullptr, dynamic_cast<DirectIndexOutput*>(out.get()));
+  out->WriteBytes(buf, 0, 1000);
+  out->Close();
+
+  out = dir.CreateOutput("kdy_direct_flush", flush);
+  ASSERT_EQ(nullptr, dynamic_cast<DirectIndexOutput*>(out.get()));
+  out->WriteBytes(buf, 0, 2000);
+  out->Close();
+
+  EXPECT_EQ(buf_size, dir.GetDirectWrittenBytes());
+  EXPECT_EQ(3000, dir.GetBufferedWrittenBytes());
+  ASSERT_EQ(buf_size, FileUtil::Size("/tmp/kdy_direct_merge"));
+}
+
 TEST(DATA__INPUT__TESTS, BYTE__ARRAY__REFERENCE__DATA__INPUT) {
     char buf[] = {0x1, 0x2, 0x3, 0x4};
     ByteArrayReferenceDataInput bar_input(buf, 4);
@@ -149,6 +394,134 @@ TEST(DATA__INPUT__TESTS, BYTE__ARRAY__REFERENCE__DATA__READ) {
   }
 }
 
+TEST(DATA__INPUT__TESTS, BULK__VINT32) {
+  // Long runs of one byte values, and of one and two byte values, mixed
+  // with every other length
+  std::vector<int32_t> values;
+  for (int32_t i = 0 ; i < 20000 ; ++i) {
+    switch ((i / 100) % 5) {
+      case 0: values.push_back(i % 128); break;
+      case 1: values.push_back(i * 131); break;
+      case 2: values.push_back((i * 7919) % ((i & 3) ? 128 : 16384)); break;
+      case 3: values.push_back(i * 2654435761U); break;
+      default: values.push_back((i & 1) ? -i : INT32_MAX - i); break;
+    }
+  }
+  const uint32_t n = values.size();
+
+  // Every kernel agrees with the scalar one
+  std::vector<char> encoded(n * VIntUtil::MAX_VINT32_BYTES);
+  std::vector<char> scalar_encoded(n * VIntUtil::MAX_VINT32_BYTES);
+  const uint32_t encoded_len =
+  VIntUtil::EncodeVInt32s(values.data(), n, encoded.data());
+  ASSERT_EQ(encoded_len,
+            VIntUtil::EncodeVInt32sScalar(values.data(),
+                                          n,
+                                          scalar_encoded.data()));
+  ASSERT_EQ(0, std::memcmp(encoded.data(),
+                           scalar_encoded.data(),
+                           encoded_len));
+
+  std::vector<int32_t> decoded_values(n);
+  uint32_t decoded = 0;
+  ASSERT_EQ(encoded_len,
+            VIntUtil::DecodeVInt32s(encoded.data(),
+                                    encoded_len,
+                                    decoded_values.data(),
+                                    n,
+                                    &decoded));
+  ASSERT_EQ(n, decoded);
+  ASSERT_EQ(values, decoded_values);
+
+  ASSERT_EQ(encoded_len,
+            VIntUtil::DecodeVInt32sScalar(encoded.data(),
+                                          encoded_len,
+                                          decoded_values.data(),
+                                          n,
+                                          &decoded));
+  ASSERT_EQ(values, decoded_values);
+
+  if (VIntUtil::HasAvx2()) {
+    ASSERT_EQ(encoded_len,
+              VIntUtil::DecodeVInt32sAvx2(encoded.data(),
+                                          encoded_len,
+                                          decoded_values.data(),
+                                          n,
+                                          &decoded));
+    ASSERT_EQ(values, decoded_values);
+  }
+
+  // Stops right before a value cut by the end
+  {
+    const int32_t big[2] = {1, 300};
+    char buf[8];
+    ASSERT_EQ(3, VIntUtil::EncodeVInt32s(big, 2, buf));
+    int32_t out[2];
+    ASSERT_EQ(1, VIntUtil::DecodeVInt32s(buf, 2, out, 2, &decoded));
+    ASSERT_EQ(1, decoded);
+    ASSERT_EQ(1, out[0]);
+  }
+
+  // Too many bits
+  {
+    char bad[64];
+    std::memset(bad, 0xFF, sizeof(bad));
+    int32_t out[64];
+    EXPECT_THROW(VIntUtil::DecodeVInt32s(bad, sizeof(bad), out, 64, &decoded),
+                 IOException);
+    EXPECT_THROW(VIntUtil::DecodeVInt32sScalar(bad, 6, out, 1, &decoded),
+                 IOException);
+  }
+
+  // Bulk and one by one calls are interchangeable on every input
+  const std::string name("kdy_bulk_vint32");
+  FileUtil::Delete("/tmp/" + name);
+  {
+    MMapDirectory dir("/tmp");
+    std::unique_ptr<IndexOutput> out = dir.CreateOutput(name, IOContext());
+    out->WriteVInt32s(values.data(), n / 2);
+    for (uint32_t i = n / 2 ; i < n ; ++i) {
+      out->WriteVInt32(values[i]);
+    }
+    ASSERT_EQ(encoded_len, out->GetFilePointer());
+    out->Close();
+  }
+
+  auto check = [&values, n](IndexInput& in) {
+    std::vector<int32_t> read(n);
+    in.ReadVInt32s(read.data(), 1000);
+    for (uint32_t i = 1000 ; i < 1003 ; ++i) {
+      read[i] = in.ReadVInt32();
+    }
+    in.ReadVInt32s(read.data() + 1003, n - 1003);
+    ASSERT_EQ(values, read);
+    int32_t past_eof;
+    EXPECT_ANY_THROW(in.ReadVInt32s(&past_eof, 1));
+  };
+
+  {
+    MMapDirectory dir("/tmp");
+    std::unique_ptr<IndexInput> in = dir.OpenInput(name, IOContext::READ);
+    ASSERT_NE(nullptr, dynamic_cast<ByteBufferIndexInput*>(in.get()));
+    check(*in);
+  }
+
+  {
+    IoUringDirectory dir("/tmp");
+    std::unique_ptr<IndexInput> in = dir.OpenInput(name, IOContext::READ);
+    // Small buffer, so values keep crossing the buffer end
+    ASSERT_NE(nullptr, dynamic_cast<BufferedIndexInput*>(in.get()));
+    check(*in);
+  }
+
+  {
+    BytesArrayReferenceIndexInput in("bulk vint32",
+                                     encoded.data(),
+                                     encoded_len);
+    check(in);
+  }
+}
+
 TEST(DATA__INPUT__TESTS, BYTES__ARRAY__REFERENCE__INDEX__INPUT) {
   std::string name("BytesArrayReferenceIndexInput");
   char buf[] = {0x1, 0x2, 0x3, 0x4, 0x5};
@@ -202,6 +575,216 @@ TEST(DATA__INPUT__TESTS, CHECK__SUM__INDEX__INPUT) {
   ASSERT_EQ(out_ptr->GetChecksum(), checksum_in.GetChecksum());
 }
 
+TEST(DATA__INPUT__TESTS, CHECK__SUM__INDEX__INPUT__CHUNKS) {
+  const std::string base("/tmp/checksum_chunks_test");
+  FileUtil::CreateDirectories(base);
+  for (const std::string& name : FileUtil::ListFiles(base)) {
+    FileUtil::Delete(base + '/' + name);
+  }
+
+  // Body spans several chunks and ends with a checksum footer
+  const uint32_t body_length = 5 * BufferedChecksumIndexInput::CHUNK_SIZE + 77;
+  std::vector<char> body(body_length);
+  for (uint32_t i = 0 ; i < body_length ; ++i) {
+    body[i] = static_cast<char>(i * 31 + 7);
+  }
+  const int64_t expected =
+  static_cast<int64_t>(Crc32Util::Update(0, body.data(), body_length));
+
+  MMapDirectory mmap_dir(base);
+  {
+    std::unique_ptr<IndexOutput> out =
+    mmap_dir.CreateOutput("checksum", IOContext::DEFAULT);
+    out->WriteBytes(body.data(), 0, body_length);
+    out->WriteInt64(expected);
+    out->Close();
+  }
+
+  PReadDirectory pread_dir(base);
+  for (Directory* dir : std::vector<Directory*>{&mmap_dir, &pread_dir}) {
+    std::unique_ptr<ChecksumIndexInput> in =
+    dir->OpenChecksumInput("checksum", IOContext::READONCE);
+    EXPECT_EQ(body[0], in->ReadByte());
+    EXPECT_EQ(body[1], in->ReadByte());
+    EXPECT_EQ(2, in->GetFilePointer());
+
+    // Small read within a chunk, then a large one bypassing the chunk
+    std::vector<char> bytes(3 * BufferedChecksumIndexInput::CHUNK_SIZE);
+    in->ReadBytes(bytes.data(), 0, 100);
+    EXPECT_EQ(0, std::memcmp(body.data() + 2, bytes.data(), 100));
+    in->ReadBytes(bytes.data(), 0, bytes.size());
+    EXPECT_EQ(0, std::memcmp(body.data() + 102, bytes.data(), bytes.size()));
+
+    // Forward seek is still checksummed
+    const uint64_t pos = body_length - 10;
+    in->Seek(pos);
+    EXPECT_EQ(pos, in->GetFilePointer());
+    in->ReadBytes(bytes.data(), 0, 10);
+    EXPECT_EQ(0, std::memcmp(body.data() + pos, bytes.data(), 10));
+
+    EXPECT_EQ(expected, in->GetChecksum());
+    EXPECT_EQ(expected, in->ReadInt64());
+    EXPECT_THROW(in->ReadByte(), EOFException);
+    in->Close();
+  }
+
+  pread_dir.Close();
+  mmap_dir.Close();
+}
+
+TEST(DATA__INPUT__TESTS, LARGE__READ__AFTER__PARTIAL__BUFFER) {
+  const std::string base("/tmp/large_read_partial_buffer_test");
+  FileUtil::CreateDirectories(base);
+  for (const std::string& name : FileUtil::ListFiles(base)) {
+    FileUtil::Delete(base + '/' + name);
+  }
+
+  const uint32_t length = 100000;
+  MMapDirectory mmap_dir(base);
+  {
+    std::unique_ptr<IndexOutput> out =
+    mmap_dir.CreateOutput("bytes", IOContext::DEFAULT);
+    for (uint32_t i = 0 ; i < length ; ++i) {
+      out->WriteByte(static_cast<char>(i % 251));
+    }
+    out->Close();
+  }
+
+  // Read past the buffer goes straight to ReadInternal, its tail must land
+  // after what was copied out of the buffer
+  PReadDirectory pread_dir(base);
+  IoUringDirectory uring_dir(base);
+  for (Directory* dir : std::vector<Directory*>{&pread_dir, &uring_dir}) {
+    std::unique_ptr<IndexInput> in = dir->OpenInput("bytes", IOContext::READ);
+    EXPECT_EQ(0, in->ReadByte());
+    EXPECT_EQ(1, in->ReadByte());
+    EXPECT_EQ(2, in->ReadByte());
+
+    const uint32_t len = 50000;
+    std::vector<char> bytes(len + 2, 'x');
+    in->ReadBytes(bytes.data(), 1, len);
+    EXPECT_EQ('x', bytes[0]);
+    EXPECT_EQ('x', bytes[len + 1]);
+    for (uint32_t i = 0 ; i < len ; ++i) {
+      ASSERT_EQ(static_cast<char>((i + 3) % 251), bytes[i + 1]);
+    }
+    EXPECT_EQ(len + 3, in->GetFilePointer());
+    EXPECT_EQ(static_cast<char>((len + 3) % 251), in->ReadByte());
+    in->Close();
+  }
+
+  uring_dir.Close();
+  pread_dir.Close();
+  mmap_dir.Close();
+}
+
+TEST(DATA__INPUT__TESTS, BULK__FIXED__WIDTH) {
+  const std::string base("/tmp/bulk_fixed_width_test");
+  FileUtil::CreateDirectories(base);
+  for (const std::string& name : FileUtil::ListFiles(base)) {
+    FileUtil::Delete(base + '/' + name);
+  }
+
+  // Odd counts leave a tail after the vector loop
+  const uint32_t n = 10007;
+  std::vector<int16_t> int16s(n);
+  std::vector<int32_t> int32s(n);
+  std::vector<int64_t> int64s(n);
+  for (uint32_t i = 0 ; i < n ; ++i) {
+    int16s[i] = static_cast<int16_t>(i * 40503U);
+    int32s[i] = static_cast<int32_t>(i * 2654435761U);
+    int64s[i] = static_cast<int64_t>(i * 0x9E3779B97F4A7C15ULL);
+  }
+
+  MMapDirectory mmap_dir(base);
+  {
+    std::unique_ptr<IndexOutput> out =
+    mmap_dir.CreateOutput("fixed", IOContext::DEFAULT);
+    out->WriteInt16s(int16s.data(), n);
+    out->WriteInt32s(int32s.data(), n);
+    out->WriteInt64s(int64s.data(), n);
+    // Same layout as one value at a time
+    for (uint32_t i = 0 ; i < n ; ++i) {
+      out->WriteInt16(int16s[i]);
+    }
+    out->Close();
+  }
+
+  PReadDirectory pread_dir(base);
+  const uint64_t int32s_pos = n * sizeof(int16_t);
+  const uint64_t int64s_pos = int32s_pos + n * sizeof(int32_t);
+  for (Directory* dir : std::vector<Directory*>{&mmap_dir, &pread_dir}) {
+    std::unique_ptr<IndexInput> in = dir->OpenInput("fixed", IOContext::READ);
+    std::vector<int16_t> read_int16s(n);
+    std::vector<int32_t> read_int32s(n);
+    std::vector<int64_t> read_int64s(n);
+    in->ReadInt16s(read_int16s.data(), n);
+    in->ReadInt32s(read_int32s.data(), n);
+    in->ReadInt64s(read_int64s.data(), n);
+    EXPECT_TRUE(int16s == read_int16s);
+    EXPECT_TRUE(int32s == read_int32s);
+    EXPECT_TRUE(int64s == read_int64s);
+    in->ReadInt16s(read_int16s.data(), n);
+    EXPECT_TRUE(int16s == read_int16s);
+
+    // Bulk reads starting with unread bytes left in the buffer
+    in->Seek(int32s_pos);
+    EXPECT_EQ(int32s[0], in->ReadInt32());
+    in->ReadInt32s(read_int32s.data(), n - 1);
+    EXPECT_TRUE(std::equal(int32s.begin() + 1,
+                           int32s.end(),
+                           read_int32s.begin()));
+    in->Seek(int64s_pos);
+    EXPECT_EQ(int64s[0], in->ReadInt64());
+    in->ReadInt64s(read_int64s.data(), n - 1);
+    EXPECT_TRUE(std::equal(int64s.begin() + 1,
+                           int64s.end(),
+                           read_int64s.begin()));
+    in->Seek(0);
+    EXPECT_EQ(int16s[0], in->ReadInt16());
+    in->ReadInt16s(read_int16s.data(), n - 1);
+    EXPECT_TRUE(std::equal(int16s.begin() + 1,
+                           int16s.end(),
+                           read_int16s.begin()));
+
+    // Single value reads agree
+    in->Seek(int32s_pos + 3 * sizeof(int32_t));
+    EXPECT_EQ(int32s[3], in->ReadInt32());
+    in->Seek(int64s_pos + 5 * sizeof(int64_t));
+    EXPECT_EQ(int64s[5], in->ReadInt64());
+    EXPECT_EQ(int64s[6], in->ReadInt64());
+
+    std::unique_ptr<RandomAccessInput> rin =
+    in->RandomAccessSlice(0, in->Length());
+    EXPECT_EQ(int16s[1], rin->ReadInt16(sizeof(int16_t)));
+    EXPECT_EQ(int32s[n - 1],
+              rin->ReadInt32(int32s_pos + (n - 1) * sizeof(int32_t)));
+    EXPECT_EQ(int64s[7], rin->ReadInt64(int64s_pos + 7 * sizeof(int64_t)));
+    EXPECT_EQ(int32s[0], rin->ReadInt32(int32s_pos));
+    std::vector<int64_t> some_int64s(100);
+    rin->ReadInt64s(int64s_pos + 50 * sizeof(int64_t), some_int64s.data(), 100);
+    EXPECT_TRUE(std::equal(some_int64s.begin(),
+                           some_int64s.end(),
+                           int64s.begin() + 50));
+
+    in->Seek(in->Length() - sizeof(int32_t));
+    EXPECT_THROW(in->ReadInt32s(read_int32s.data(), 2), EOFException);
+    in->Close();
+  }
+
+  // In memory inputs
+  std::vector<char> bytes(n * sizeof(int64_t));
+  EndianUtil::WriteInt64s(int64s.data(), n, bytes.data());
+  BytesArrayReferenceIndexInput bari("bari", bytes.data(), bytes.size());
+  std::vector<int64_t> read_int64s(n);
+  bari.ReadInt64s(read_int64s.data(), n);
+  EXPECT_TRUE(int64s == read_int64s);
+  EXPECT_EQ(int64s[0], EndianUtil::ReadInt64(bytes.data()));
+
+  pread_dir.Close();
+  mmap_dir.Close();
+}
+
 int main(int argc, char* argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -15,19 +15,84 @@
  *
  */
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
+#include <Store/BlockCache.h>
+#include <Store/CodecUtil.h>
+#include <Store/CompoundFile.h>
 #include <Store/Directory.h>
+#include <Store/FileSwitchDirectory.h>
+#include <Store/HandlePool.h>
+#include <Store/IoUring.h>
+#include <Store/Lock.h>
+#include <Store/NRTCachingDirectory.h>
+#include <Store/PageHeat.h>
+#include <Store/TrackingDirectory.h>
+#include <Util/Bytes.h>
+#include <Util/Exception.h>
 #include <Util/File.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <memory>
+#include <thread>
+#include <vector>
 
 using lucene::core::store::MMapDirectory;
+using lucene::core::store::IoUringDirectory;
+using lucene::core::store::IoUringIndexInput;
+using lucene::core::store::ChecksumIndexInput;
 using lucene::core::store::IndexInput;
 using lucene::core::store::RandomAccessInput;
 using lucene::core::store::FileIndexOutput;
 using lucene::core::store::IndexOutput;
 using lucene::core::store::IOContext;
+using lucene::core::store::AlreadyClosedException;
+using lucene::core::store::ByteBufferIndexInput;
+using lucene::core::store::MergeInfo;
+using lucene::core::store::FlushInfo;
+using lucene::core::store::Directory;
+using lucene::core::store::NRTCachingDirectory;
+using lucene::core::store::CodecUtil;
+using lucene::core::store::CompoundFileFormat;
+using lucene::core::store::CompoundFileDirectory;
+using lucene::core::store::FileSwitchDirectory;
+using lucene::core::store::FSDirectory;
+using lucene::core::store::PendingDeleter;
+using lucene::core::store::BlockCache;
+using lucene::core::store::PReadIndexInput;
+using lucene::core::store::PReadDirectory;
+using lucene::core::store::FSLockFactory;
+using lucene::core::store::TrackingDirectory;
+using lucene::core::store::TrackingIndexInput;
+using lucene::core::store::PageHeatSnapshot;
+using lucene::core::store::PageHeatSampler;
+using lucene::core::store::HandlePool;
+using lucene::core::store::HandlePoolDirectory;
+using lucene::core::store::PooledIndexInput;
+using lucene::core::store::IOStats;
+using lucene::core::util::BytesRef;
 using lucene::core::util::FileUtil;
+using lucene::core::util::IOException;
+using lucene::core::util::EOFException;
+using lucene::core::util::IllegalArgumentException;
+using lucene::core::util::NoSuchFileException;
+using lucene::core::util::UnsupportedOperationException;
+
+namespace {
+
+// Creates `base` if missing and deletes whatever a previous run left in it
+void PrepareEmptyDirectory(const std::string& base) {
+  FileUtil::CreateDirectories(base);
+  for (const std::string& name : FileUtil::ListFiles(base)) {
+    FileUtil::Delete(base + '/' + name);
+  }
+}
+
+}  // namespace
 
 TEST(DIRECTORY__TESTS, MMAP__DIRECTORY__BYTE__IO) {
   const size_t file_size = 11376;
@@ -600,6 +665,1391 @@ TEST(DIRECTORY__TESTS, DIRECTORY__ETC) {
   dir.DeleteFile(tmp_out_ptr->GetName());
 }
 
+TEST(DIRECTORY__TESTS, IO__URING__DIRECTORY__IO) {
+  const size_t elem_num = 50000;
+  const std::string base("/tmp");
+  const std::string name("io_uring_out_test");
+  FileUtil::Delete(base + '/' + name);
+  std::string str("content-");
+  const uint32_t str_len = str.length();
+  IoUringDirectory dir(base);
+  IOContext io_ctx;
+  uint64_t checksum;
+
+  // Write first
+  {
+    std::unique_ptr<IndexOutput> out_ptr = dir.CreateOutput(name, io_ctx);
+
+    for (size_t i = 0 ; i < elem_num ; ++i) {
+      out_ptr->WriteByte(static_cast<char>(i));
+      out_ptr->WriteInt32(static_cast<int32_t>(i));
+      out_ptr->WriteInt64(static_cast<int64_t>(i));
+      out_ptr->WriteVInt32(static_cast<int32_t>(i));
+      str.resize(str_len);
+      str += std::to_string(i);
+      out_ptr->WriteString(str);
+    }
+
+    checksum = out_ptr->GetChecksum();
+    out_ptr->Close();
+  }
+
+  // Read afterward
+  {
+    std::unique_ptr<IndexInput> in_ptr = dir.OpenInput(name, io_ctx);
+    ASSERT_EQ(dir.FileLength(name), in_ptr->Length());
+
+    for (size_t i = 0 ; i < elem_num ; ++i) {
+      ASSERT_EQ(static_cast<char>(i), in_ptr->ReadByte());
+      ASSERT_EQ(static_cast<int32_t>(i), in_ptr->ReadInt32());
+      ASSERT_EQ(static_cast<int64_t>(i), in_ptr->ReadInt64());
+      ASSERT_EQ(static_cast<int32_t>(i), in_ptr->ReadVInt32());
+      str.resize(str_len);
+      str += std::to_string(i);
+      ASSERT_EQ(str, in_ptr->ReadString());
+    }
+  }
+
+  // Checksum must be same with what we get from the plain read
+  {
+    std::unique_ptr<ChecksumIndexInput> in_ptr =
+    dir.OpenChecksumInput(name, io_ctx);
+    in_ptr->Seek(in_ptr->Length());
+    ASSERT_EQ(checksum, in_ptr->GetChecksum());
+  }
+
+  // Batch read, every range in flight at once
+  {
+    std::unique_ptr<IndexInput> in_ptr = dir.OpenInput(name, io_ctx);
+    IoUringIndexInput* uring_in =
+    dynamic_cast<IoUringIndexInput*>(in_ptr.get());
+    ASSERT_NE(nullptr, uring_in);
+
+    const uint32_t num_requests = 32;
+    const uint32_t stride = 997;
+    char buf[num_requests][stride];
+    IoUringIndexInput::ReadRequest requests[num_requests];
+    for (uint32_t i = 0 ; i < num_requests ; ++i) {
+      requests[i].offset = i * stride;
+      requests[i].dest = buf[i];
+      requests[i].length = stride;
+    }
+    uring_in->ReadBatch(requests, num_requests);
+
+    for (uint32_t i = 0 ; i < num_requests ; ++i) {
+      in_ptr->Seek(i * stride);
+      for (uint32_t j = 0 ; j < stride ; ++j) {
+        ASSERT_EQ(in_ptr->ReadByte(), buf[i][j]);
+      }
+    }
+  }
+
+  // Slices and clones keep their own file pointer and outlive each other
+  {
+    std::unique_ptr<IndexInput> in_ptr = dir.OpenInput(name, io_ctx);
+    std::unique_ptr<IndexInput> first = in_ptr->Slice("first", 0, 100);
+    std::unique_ptr<IndexInput> second = in_ptr->Slice("second", 13, 100);
+    ASSERT_EQ(static_cast<char>(0), first->ReadByte());
+    // Reading a slice did not move the file pointer of the input
+    ASSERT_EQ(0, in_ptr->GetFilePointer());
+    ASSERT_EQ(static_cast<char>(0), in_ptr->ReadByte());
+    in_ptr->Seek(13);
+    const char expected = in_ptr->ReadByte();
+    first->Close();
+    in_ptr->Close();
+    ASSERT_EQ(expected, second->ReadByte());
+
+    // Closed before anything was buffered
+    std::unique_ptr<IndexInput> third = second->Slice("third", 0, 10);
+    third->Close();
+    EXPECT_THROW(third->ReadByte(), AlreadyClosedException);
+
+    IoUringIndexInput* uring_second =
+    dynamic_cast<IoUringIndexInput*>(second.get());
+    ASSERT_NE(nullptr, uring_second);
+    std::unique_ptr<IoUringIndexInput> clone = uring_second->Clone();
+    ASSERT_EQ(second->GetFilePointer(), clone->GetFilePointer());
+    EXPECT_THROW(second->Slice("oob", 50, 51), IllegalArgumentException);
+  }
+
+  // Large merges are written with O_DIRECT like in FSDirectory
+  const std::string merged_name(name + "_merged");
+  FileUtil::Delete(base + '/' + merged_name);
+  dir.SetDirectIOMergeThreshold(1);
+  {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput(merged_name, IOContext(MergeInfo(1, 1 << 20, false, 1)));
+    out->WriteInt64(7);
+    out->Close();
+  }
+  EXPECT_EQ(8, dir.GetDirectWrittenBytes());
+  EXPECT_EQ(8, dir.FileLength(merged_name));
+  dir.DeleteFile(merged_name);
+
+  dir.DeleteFile(name);
+}
+
+TEST(DIRECTORY__TESTS, MMAP__DIRECTORY__MAP__POLICY) {
+  const std::string base("/tmp");
+  const std::string name("mmap_policy_test.tim");
+  FileUtil::Delete(base + '/' + name);
+  MMapDirectory dir(base);
+
+  // Term dictionary is random by default, merge turns it to sequential
+  IOContext merge_ctx(MergeInfo(10, 1024, false, 1));
+  ASSERT_TRUE(MMapDirectory::ReadAdvice::RANDOM ==
+              dir.GetMapPolicy(name, IOContext::READ).advice);
+  ASSERT_TRUE(MMapDirectory::ReadAdvice::SEQUENTIAL ==
+              dir.GetMapPolicy(name, merge_ctx).advice);
+  ASSERT_TRUE(MMapDirectory::ReadAdvice::SEQUENTIAL ==
+              dir.GetMapPolicy(name, IOContext::READONCE).advice);
+  ASSERT_TRUE(MMapDirectory::ReadAdvice::NORMAL ==
+              dir.GetMapPolicy("_0.fdt", IOContext::READ).advice);
+
+  dir.SetExtensionPolicy("tim",
+    MMapDirectory::MapPolicy(MMapDirectory::ReadAdvice::RANDOM, true, true));
+  ASSERT_TRUE(dir.GetMapPolicy(name, merge_ctx).populate);
+  ASSERT_TRUE(dir.GetMapPolicy(name, merge_ctx).huge_page);
+
+  const int n = 100000;
+  {
+    std::unique_ptr<IndexOutput> out_ptr = dir.CreateOutput(name,
+                                                            IOContext::DEFAULT);
+    for (int i = 0 ; i < n ; ++i) {
+      out_ptr->WriteInt32(i);
+    }
+    out_ptr->Close();
+  }
+
+  // Populated and huge page advised mapping still reads the same
+  std::unique_ptr<IndexInput> in_ptr = dir.OpenInput(name, IOContext::READ);
+  for (int i = 0 ; i < n ; ++i) {
+    ASSERT_EQ(i, in_ptr->ReadInt32());
+  }
+  in_ptr->Close();
+
+  dir.RemoveExtensionPolicy("tim");
+  ASSERT_TRUE(MMapDirectory::ReadAdvice::NORMAL ==
+              dir.GetMapPolicy(name, IOContext::READ).advice);
+
+  // Policies may change while other threads look them up
+  {
+    std::thread writer([&dir](){
+      const MMapDirectory::MapPolicy policy(
+        MMapDirectory::ReadAdvice::RANDOM, false, false);
+      for (int i = 0 ; i < 10000 ; ++i) {
+        dir.SetExtensionPolicy("tim" + std::to_string(i % 16), policy);
+        dir.RemoveExtensionPolicy("tim" + std::to_string((i + 8) % 16));
+      }
+    });
+    for (int i = 0 ; i < 10000 ; ++i) {
+      dir.GetMapPolicy(name, IOContext::READ);
+    }
+    writer.join();
+  }
+  dir.DeleteFile(name);
+}
+
+TEST(DIRECTORY__TESTS, MMAP__DIRECTORY__CLONE__AFTER__CLOSE) {
+  const std::string base("/tmp");
+  const std::string name("mmap_clone_test");
+  FileUtil::Delete(base + '/' + name);
+  MMapDirectory dir(base);
+  const int n = 1 << 20;
+
+  {
+    std::unique_ptr<IndexOutput> out_ptr = dir.CreateOutput(name,
+                                                            IOContext::DEFAULT);
+    for (int i = 0 ; i < n ; ++i) {
+      out_ptr->WriteByte(static_cast<char>(i));
+    }
+    out_ptr->Close();
+  }
+
+  std::unique_ptr<IndexInput> in_ptr = dir.OpenInput(name, IOContext::READ);
+  ByteBufferIndexInput* bb_in = dynamic_cast<ByteBufferIndexInput*>(
+                                in_ptr.get());
+  ASSERT_NE(nullptr, bb_in);
+  std::unique_ptr<IndexInput> slice = in_ptr->Slice("slice", 100, 1000);
+
+  // Readers keep going on their own clones while the original is closed
+  std::atomic<int> failures(0);
+  std::vector<std::thread> readers;
+  for (int t = 0 ; t < 4 ; ++t) {
+    std::shared_ptr<ByteBufferIndexInput> clone(bb_in->Clone());
+    readers.emplace_back([clone, n, &failures](){
+      for (int round = 0 ; round < 4 ; ++round) {
+        clone->Seek(0);
+        for (int i = 0 ; i < n ; ++i) {
+          if (clone->ReadByte() != static_cast<char>(i)) {
+            failures++;
+          }
+        }
+      }
+    });
+  }
+
+  in_ptr->Close();
+  ASSERT_FALSE(bb_in->IsValid());
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(0, failures.load());
+
+  // Mapping is still there for the slice, but no more slicing is allowed
+  slice->Seek(10);
+  ASSERT_EQ(static_cast<char>(110), slice->ReadByte());
+  ASSERT_THROW(slice->Slice("again", 0, 10), AlreadyClosedException);
+
+  dir.DeleteFile(name);
+}
+
+TEST(DIRECTORY__TESTS, NRT__CACHING__DIRECTORY) {
+  const std::string base("/tmp/nrt_caching_test");
+  PrepareEmptyDirectory(base);
+
+  std::shared_ptr<MMapDirectory> fs_dir = std::make_shared<MMapDirectory>(base);
+  NRTCachingDirectory dir(fs_dir, 1.0, 4.0);
+  const IOContext flush_ctx(FlushInfo(100, 20000));
+  const IOContext big_merge_ctx(MergeInfo(1000, 10 * 1024 * 1024, false, 1));
+
+  auto write_file = [&dir](const std::string& name,
+                           const IOContext& ctx,
+                           const uint32_t size) {
+    std::unique_ptr<IndexOutput> out = dir.CreateOutput(name, ctx);
+    for (uint32_t i = 0 ; i < size ; ++i) {
+      out->WriteByte(static_cast<char>(i * 7));
+    }
+    out->WriteString(name);
+    out->Close();
+  };
+
+  auto check_file = [](Directory& d,
+                       const std::string& name,
+                       const uint32_t size) {
+    std::unique_ptr<IndexInput> in = d.OpenInput(name, IOContext::READ);
+    for (uint32_t i = 0 ; i < size ; ++i) {
+      ASSERT_EQ(static_cast<char>(i * 7), in->ReadByte());
+    }
+    ASSERT_EQ(name, in->ReadString());
+  };
+
+  // Small flushed file stays in memory, spans several RAM blocks
+  write_file("_0.cfs", flush_ctx, 20000);
+  EXPECT_FALSE(FileUtil::Exists(base + "/_0.cfs"));
+  EXPECT_EQ(std::vector<std::string>{"_0.cfs"}, dir.ListCachedFiles());
+  EXPECT_LT(0, dir.CacheRamBytesUsed());
+  EXPECT_EQ(20000 + 7, dir.FileLength("_0.cfs"));
+  check_file(dir, "_0.cfs", 20000);
+
+  // Slices over the cached file
+  {
+    std::unique_ptr<IndexInput> in = dir.OpenInput("_0.cfs", IOContext::READ);
+    std::unique_ptr<IndexInput> slice = in->Slice("slice", 8190, 10);
+    for (uint32_t i = 8190 ; i < 8200 ; ++i) {
+      ASSERT_EQ(static_cast<char>(i * 7), slice->ReadByte());
+    }
+  }
+
+  // Large merges and commit points go straight to the delegate
+  write_file("_1.cfs", big_merge_ctx, 1000);
+  write_file("segments_1", flush_ctx, 10);
+  EXPECT_TRUE(FileUtil::Exists(base + "/_1.cfs"));
+  EXPECT_TRUE(FileUtil::Exists(base + "/segments_1"));
+  EXPECT_EQ(std::vector<std::string>{"_0.cfs"}, dir.ListCachedFiles());
+
+  const std::vector<std::string> expected_all{"_0.cfs", "_1.cfs", "segments_1"};
+  EXPECT_EQ(expected_all, dir.ListAll());
+
+  // Sync writes the cached file to the delegate
+  dir.Sync({"_0.cfs"});
+  EXPECT_TRUE(dir.ListCachedFiles().empty());
+  EXPECT_TRUE(FileUtil::Exists(base + "/_0.cfs"));
+  check_file(*fs_dir, "_0.cfs", 20000);
+
+  // Close never loses an unsynced file
+  write_file("_2.cfs", flush_ctx, 100);
+  dir.Rename("_2.cfs", "_3.cfs");
+  EXPECT_EQ(std::vector<std::string>{"_3.cfs"}, dir.ListCachedFiles());
+  dir.DeleteFile("_1.cfs");
+  EXPECT_FALSE(fs_dir->CheckPendingDeletions());
+  EXPECT_FALSE(FileUtil::Exists(base + "/_1.cfs"));
+  dir.Close();
+  EXPECT_TRUE(FileUtil::Exists(base + "/_3.cfs"));
+  EXPECT_FALSE(FileUtil::Exists(base + "/_2.cfs"));
+}
+
+TEST(DIRECTORY__TESTS, MMAP__DIRECTORY__BYTES__REF__VIEW) {
+  const std::string base("/tmp");
+  const std::string name("mmap_bytes_ref_view");
+  FileUtil::Delete(base + '/' + name);
+
+  MMapDirectory dir(base);
+  {
+    std::unique_ptr<IndexOutput> out = dir.CreateOutput(name, IOContext());
+    out->WriteString("hello");
+    out->WriteString("mmap");
+    out->Close();
+  }
+
+  std::unique_ptr<IndexInput> in = dir.OpenInput(name, IOContext::READ);
+  ASSERT_NE(nullptr, dynamic_cast<ByteBufferIndexInput*>(in.get()));
+
+  ASSERT_EQ(5, in->ReadVInt32());
+  BytesRef hello = in->ReadBytesRef(5);
+  EXPECT_TRUE(hello.IsView());
+  EXPECT_TRUE(BytesRef("hello") == hello);
+  EXPECT_EQ("hello", hello.UTF8ToString());
+  EXPECT_EQ(6, in->GetFilePointer());
+
+  // Moving keeps it a view, copying makes an owning copy
+  BytesRef moved(std::move(hello));
+  EXPECT_TRUE(moved.IsView());
+  BytesRef copied(moved);
+  EXPECT_FALSE(copied.IsView());
+  EXPECT_TRUE(moved == copied);
+
+  ASSERT_EQ(4, in->ReadVInt32());
+  EXPECT_TRUE(BytesRef("mmap") == in->ReadBytesRef(4));
+  EXPECT_ANY_THROW(in->ReadBytesRef(1));
+
+  // Slices share the mapping
+  std::unique_ptr<IndexInput> slice = in->Slice("slice", 1, 5);
+  BytesRef from_slice = slice->ReadBytesRef(5);
+  EXPECT_TRUE(from_slice.IsView());
+  EXPECT_TRUE(BytesRef("hello") == from_slice);
+
+  // Inputs without memory behind them hand out a copy
+  IoUringDirectory uring_dir(base);
+  std::unique_ptr<IndexInput> uring_in =
+  uring_dir.OpenInput(name, IOContext::READ);
+  uring_in->Seek(1);
+  BytesRef copy = uring_in->ReadBytesRef(5);
+  EXPECT_FALSE(copy.IsView());
+  EXPECT_TRUE(BytesRef("hello") == copy);
+}
+
+TEST(DIRECTORY__TESTS, PREFETCH) {
+  const std::string base("/tmp");
+  const std::string name("prefetch_test");
+  const std::string path = base + '/' + name;
+  const uint32_t file_size = 1024 * 1024 + 123;
+  FileUtil::Delete(path);
+
+  MMapDirectory mmap_dir(base);
+  {
+    std::unique_ptr<IndexOutput> out = mmap_dir.CreateOutput(name, IOContext());
+    for (uint32_t i = 0 ; i < file_size ; ++i) {
+      out->WriteByte(static_cast<char>(i));
+    }
+    out->Close();
+  }
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  const long page_size = sysconf(_SC_PAGESIZE);
+  const size_t num_pages = (file_size + page_size - 1) / page_size;
+  void* probe = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  ASSERT_NE(MAP_FAILED, probe);
+  std::vector<unsigned char> residency(num_pages);
+
+  auto evict = [fd, file_size]() {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, file_size, POSIX_FADV_DONTNEED);
+  };
+
+  // Pages of given range become resident without reading them
+  auto wait_resident = [&](const size_t first_page, const size_t last_page) {
+    for (int attempt = 0 ; attempt < 200 ; ++attempt) {
+      mincore(probe, file_size, residency.data());
+      bool all = true;
+      for (size_t p = first_page ; p <= last_page ; ++p) {
+        all = all && (residency[p] & 1);
+      }
+      if (all) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+  };
+
+  {
+    std::unique_ptr<IndexInput> in = mmap_dir.OpenInput(name, IOContext());
+    // Out of range hints are ignored
+    in->Prefetch(file_size, 100);
+    in->Prefetch(0, 0);
+
+    evict();
+    in->Prefetch(300000, 200000);
+    EXPECT_TRUE(wait_resident(300000 / page_size, 500000 / page_size));
+    EXPECT_EQ(0, in->GetFilePointer());
+
+    // Slice offsets are relative to the slice
+    evict();
+    std::unique_ptr<IndexInput> slice = in->Slice("slice", 700000, 100000);
+    slice->Prefetch(10000, 1000000);
+    EXPECT_TRUE(wait_resident(710000 / page_size, 799999 / page_size));
+    slice->Seek(10000);
+    EXPECT_EQ(static_cast<char>(710000), slice->ReadByte());
+  }
+
+  {
+    IoUringDirectory uring_dir(base);
+    std::unique_ptr<IndexInput> in = uring_dir.OpenInput(name, IOContext());
+    evict();
+    in->Prefetch(100000, 300000);
+    EXPECT_TRUE(wait_resident(100000 / page_size, 399999 / page_size));
+
+    // Buffered slice forwards to the file with its own offset
+    evict();
+    std::unique_ptr<IndexInput> slice = in->Slice("slice", 500000, 100000);
+    slice->Prefetch(0, 100000);
+    EXPECT_TRUE(wait_resident(500000 / page_size, 599999 / page_size));
+    EXPECT_EQ(static_cast<char>(500000), slice->ReadByte());
+  }
+
+  munmap(probe, file_size);
+  close(fd);
+}
+
+TEST(DIRECTORY__TESTS, COMPOUND__FILE__DIRECTORY) {
+  const std::string base("/tmp/compound_file_test");
+  PrepareEmptyDirectory(base);
+
+  MMapDirectory dir(base);
+  const std::vector<std::string> files{"_0.tim", "_0_Lucene50_0.doc",
+                                       "_0.fnm", "_0.si"};
+  const std::vector<uint32_t> sizes{3, 10000, 0, 77};
+  for (size_t i = 0 ; i < files.size() ; ++i) {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput(files[i], IOContext::DEFAULT);
+    for (uint32_t j = 0 ; j < sizes[i] ; ++j) {
+      out->WriteByte(static_cast<char>(i + j));
+    }
+    out->Close();
+  }
+
+  EXPECT_THROW(CompoundFileFormat::Write(dir, "_0", {"_1.tim"},
+                                         IOContext::DEFAULT),
+               IllegalArgumentException);
+  EXPECT_FALSE(FileUtil::Exists(base + "/_0.cfs"));
+
+  CompoundFileFormat::Write(dir, "_0", files, IOContext::DEFAULT);
+
+  CompoundFileDirectory cfs(dir, "_0", IOContext::READ);
+  std::vector<std::string> listed = cfs.ListAll();
+  std::vector<std::string> expected(files);
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(expected, listed);
+  cfs.CheckIntegrity();
+
+  for (size_t i = 0 ; i < files.size() ; ++i) {
+    EXPECT_EQ(sizes[i], cfs.FileLength(files[i]));
+    std::unique_ptr<IndexInput> in = cfs.OpenInput(files[i], IOContext::READ);
+    EXPECT_EQ(sizes[i], in->Length());
+    for (uint32_t j = 0 ; j < sizes[i] ; ++j) {
+      ASSERT_EQ(static_cast<char>(i + j), in->ReadByte());
+    }
+  }
+
+  EXPECT_THROW(cfs.OpenInput("_0.nvd", IOContext::READ), NoSuchFileException);
+  EXPECT_THROW(cfs.CreateOutput("_0.nvd", IOContext::DEFAULT),
+               UnsupportedOperationException);
+  EXPECT_THROW(cfs.DeleteFile("_0.si"), UnsupportedOperationException);
+
+  // Flipping a byte in the data is caught by integrity check
+  {
+    std::unique_ptr<IndexInput> in = dir.OpenInput("_0.cfs", IOContext::READ);
+    const uint64_t length = in->Length();
+    std::unique_ptr<char[]> bytes = std::make_unique<char[]>(length);
+    in->ReadBytes(bytes.get(), 0, length);
+    in->Close();
+    dir.DeleteFile("_0.cfs");
+    bytes[length / 2] ^= 0x1;
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput("_0.cfs", IOContext::DEFAULT);
+    out->WriteBytes(bytes.get(), 0, length);
+    out->Close();
+  }
+
+  CompoundFileDirectory corrupted(dir, "_0", IOContext::READ);
+  EXPECT_THROW(corrupted.CheckIntegrity(), IOException);
+
+  cfs.Close();
+  EXPECT_THROW(cfs.ListAll(), AlreadyClosedException);
+}
+
+TEST(DIRECTORY__TESTS, FILE__SWITCH__DIRECTORY) {
+  const std::string fast_base("/tmp/file_switch_test_fast");
+  const std::string slow_base("/tmp/file_switch_test_slow");
+  PrepareEmptyDirectory(fast_base);
+  PrepareEmptyDirectory(slow_base);
+
+  std::shared_ptr<MMapDirectory> fast =
+  std::make_shared<MMapDirectory>(fast_base);
+  std::shared_ptr<MMapDirectory> slow =
+  std::make_shared<MMapDirectory>(slow_base);
+  FileSwitchDirectory dir(slow, {{"tim", fast}, {"dvd", fast}});
+
+  auto write_file = [&dir](const std::string& name) {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput(name, IOContext::DEFAULT);
+    out->WriteString(name);
+    out->Close();
+  };
+
+  write_file("_0.tim");
+  write_file("_0_Lucene70_0.dvd");
+  write_file("_0.fdt");
+  EXPECT_TRUE(FileUtil::Exists(fast_base + "/_0.tim"));
+  EXPECT_TRUE(FileUtil::Exists(fast_base + "/_0_Lucene70_0.dvd"));
+  EXPECT_TRUE(FileUtil::Exists(slow_base + "/_0.fdt"));
+  EXPECT_FALSE(FileUtil::Exists(slow_base + "/_0.tim"));
+  EXPECT_TRUE(fast == dir.GetDirectory("_1.tim"));
+  EXPECT_TRUE(slow == dir.GetDirectory("segments_1"));
+
+  const std::vector<std::string> expected{"_0.fdt",
+                                          "_0.tim",
+                                          "_0_Lucene70_0.dvd"};
+  EXPECT_EQ(expected, dir.ListAll());
+  dir.Sync(expected);
+
+  for (const std::string& name : expected) {
+    EXPECT_EQ(name.size() + 1, dir.FileLength(name));
+    std::unique_ptr<IndexInput> in = dir.OpenInput(name, IOContext::READ);
+    EXPECT_EQ(name, in->ReadString());
+  }
+
+  // Temp file follows its suffix, so it can become its final name
+  {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateTempOutput("_1", "tim", IOContext::DEFAULT);
+    const std::string tmp_name = out->GetName();
+    out->WriteString("_1.tim");
+    out->Close();
+    EXPECT_TRUE(FileUtil::Exists(fast_base + '/' + tmp_name));
+    EXPECT_TRUE(fast == dir.GetDirectory(tmp_name));
+    dir.Rename(tmp_name, "_1.tim");
+    EXPECT_TRUE(FileUtil::Exists(fast_base + "/_1.tim"));
+    EXPECT_THROW(dir.Rename("_1.tim", "_1.fdt"), IOException);
+  }
+
+  dir.DeleteFile("_0.tim");
+  dir.DeleteFile("_0.fdt");
+  EXPECT_FALSE(fast->CheckPendingDeletions());
+  EXPECT_FALSE(slow->CheckPendingDeletions());
+  EXPECT_FALSE(FileUtil::Exists(fast_base + "/_0.tim"));
+  EXPECT_FALSE(FileUtil::Exists(slow_base + "/_0.fdt"));
+  const std::vector<std::string> left{"_0_Lucene70_0.dvd", "_1.tim"};
+  EXPECT_EQ(left, dir.ListAll());
+
+  // Both routes can share one path without listing a file twice
+  std::shared_ptr<Directory> same = std::make_shared<MMapDirectory>(fast_base);
+  FileSwitchDirectory shared_dir(same, {{"tim", fast}});
+  EXPECT_EQ(left, shared_dir.ListAll());
+
+  dir.Close();
+}
+
+TEST(DIRECTORY__TESTS, GROUP__SYNC) {
+  const std::string base("/tmp/group_sync_test");
+  PrepareEmptyDirectory(base);
+
+  MMapDirectory dir(base);
+  dir.SetSyncThreads(4);
+  ASSERT_EQ(4, dir.GetFsyncPool()->GetNumThreads());
+
+  const uint32_t num_threads = 8;
+  const uint32_t files_per_thread = 8;
+  std::vector<std::vector<std::string>> names(num_threads);
+  for (uint32_t t = 0 ; t < num_threads ; ++t) {
+    for (uint32_t i = 0 ; i < files_per_thread ; ++i) {
+      const std::string name("_" + std::to_string(t) + '.' +
+                             std::to_string(i));
+      std::unique_ptr<IndexOutput> out =
+      dir.CreateOutput(name, IOContext::DEFAULT);
+      out->WriteString(name);
+      out->Close();
+      names[t].push_back(name);
+    }
+  }
+
+  // Every thread also syncs one shared file, it is flushed once per group
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0 ; t < num_threads ; ++t) {
+    names[t].push_back("_0.0");
+    threads.emplace_back([&dir, &names, t](){
+      dir.Sync(names[t]);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  dir.SyncMetaData();
+
+  FSDirectory::SyncStats stats = dir.GetSyncStats();
+  EXPECT_EQ(num_threads, stats.sync_calls);
+  EXPECT_LE(1, stats.group_syncs);
+  EXPECT_GE(num_threads, stats.group_syncs);
+  // "_0.0" is among the first thread's own files
+  EXPECT_EQ(num_threads * files_per_thread + stats.group_syncs - 1,
+            stats.synced_files);
+  EXPECT_EQ(1, stats.metadata_syncs);
+  EXPECT_LT(0, stats.total_sync_nanos);
+  EXPECT_LE(stats.max_sync_nanos, stats.total_sync_nanos);
+
+  // Failure reaches the caller, and the directory keeps working after it
+  EXPECT_THROW(dir.Sync({"_0.0", "no_such_file"}), IOException);
+  dir.Sync({"_0.0"});
+
+  // Big enough group is flushed by one syncfs
+  dir.SetSyncFsThreshold(4);
+  dir.Sync(names[0]);
+  EXPECT_EQ(1, dir.GetSyncStats().syncfs_calls);
+
+  // Serial path
+  dir.SetSyncThreads(0);
+  EXPECT_FALSE(dir.GetFsyncPool());
+  dir.SetSyncFsThreshold(0);
+  dir.Sync(names[1]);
+  EXPECT_EQ(num_threads + 4, dir.GetSyncStats().sync_calls);
+}
+
+TEST(DIRECTORY__TESTS, BACKGROUND__PENDING__DELETES) {
+  const std::string base("/tmp/pending_delete_test");
+  // Left over inside a directory by a failed run, it must go first
+  FileUtil::Delete(base + "/_busy/file");
+  PrepareEmptyDirectory(base);
+
+  MMapDirectory dir(base);
+  auto write_file = [&dir](const std::string& name) {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput(name, IOContext::DEFAULT);
+    out->WriteString(name);
+    out->Close();
+  };
+
+  auto wait_for_deleter = [&dir](const std::string& name) {
+    for (int i = 0 ; i < 1000 && FileUtil::Exists(dir.GetDirectory() + '/' +
+                                                  name) ; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  };
+
+  // Deleted by the background thread, hidden from the caller right away
+  const uint32_t num_threads = 4;
+  const uint32_t files_per_thread = 16;
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0 ; t < num_threads ; ++t) {
+    threads.emplace_back([&dir, &write_file, t](){
+      for (uint32_t i = 0 ; i < files_per_thread ; ++i) {
+        const std::string name("_" + std::to_string(t) + '.' +
+                               std::to_string(i));
+        write_file(name);
+        dir.DeleteFile(name);
+        EXPECT_THROW(dir.OpenInput(name, IOContext::READ),
+                     NoSuchFileException);
+        EXPECT_THROW(dir.DeleteFile(name), NoSuchFileException);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_TRUE(dir.ListAll().empty());
+  EXPECT_THROW(dir.DeleteFile("no_such_file"), NoSuchFileException);
+  for (uint32_t t = 0 ; t < num_threads ; ++t) {
+    wait_for_deleter('_' + std::to_string(t) + '.' +
+                     std::to_string(files_per_thread - 1));
+  }
+  EXPECT_FALSE(dir.CheckPendingDeletions());
+  EXPECT_TRUE(FileUtil::ListFiles(base).empty());
+
+  // Name can be written again right after it was deleted
+  write_file("_0.si");
+  dir.DeleteFile("_0.si");
+  write_file("_0.si");
+  EXPECT_EQ(std::vector<std::string>{"_0.si"}, dir.ListAll());
+
+  // Sweeping pending deletes never takes down a name written again
+  const uint32_t num_rounds = 200;
+  write_file("_1.si");
+  for (uint32_t round = 0 ; round < num_rounds ; ++round) {
+    dir.DeleteFile("_1.si");
+    std::thread sweeper([&dir](){ dir.CheckPendingDeletions(); });
+    write_file("_1.si");
+    sweeper.join();
+    ASSERT_TRUE(FileUtil::Exists(base + "/_1.si"));
+  }
+  dir.DeleteFile("_1.si");
+  wait_for_deleter("_1.si");
+
+  // Failed unlink is retried with backoff until it works
+  FileUtil::CreateDirectories(base + "/_busy");
+  {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput("_busy/file", IOContext::DEFAULT);
+    out->Close();
+  }
+  dir.DeleteFile("_busy");
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(std::vector<std::string>{"_busy"}, dir.ListPendingDeletes());
+  EXPECT_LE(2, dir.GetPendingDeleteStats().failed_attempts);
+  EXPECT_TRUE(dir.CheckPendingDeletions());
+  FileUtil::Delete(base + "/_busy/file");
+  wait_for_deleter("_busy");
+  EXPECT_FALSE(dir.CheckPendingDeletions());
+  EXPECT_FALSE(FileUtil::Exists(base + "/_busy"));
+
+  const PendingDeleter::Stats stats = dir.GetPendingDeleteStats();
+  const uint64_t num_deletes = num_threads * files_per_thread + num_rounds + 3;
+  EXPECT_EQ(num_deletes, stats.queued);
+  EXPECT_EQ(num_deletes, stats.deleted + stats.claimed);
+  EXPECT_LE(stats.max_delete_nanos, stats.total_delete_nanos);
+}
+
+TEST(DIRECTORY__TESTS, PREAD__BLOCK__CACHE) {
+  const std::string base("/tmp/block_cache_test");
+  PrepareEmptyDirectory(base);
+
+  // Not a multiple of the block size, last block is a short one
+  const uint32_t file_size = 200 * 1000 + 17;
+  MMapDirectory dir(base);
+  {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput("data", IOContext::DEFAULT);
+    for (uint32_t i = 0 ; i < file_size ; ++i) {
+      out->WriteByte(static_cast<char>(i * 31));
+    }
+    out->Close();
+  }
+
+  // 64KB cache over a 200KB file
+  std::shared_ptr<BlockCache> cache =
+  std::make_shared<BlockCache>(64 * 1024, 4096, 4);
+  const uint64_t file_id = cache->NewFileId();
+
+  auto open_input = [&base, file_size, file_id](
+                    const std::shared_ptr<BlockCache>& cache,
+                    const IOContext& ctx) {
+    const int fd = open((base + "/data").c_str(), O_RDONLY);
+    return std::make_unique<PReadIndexInput>(
+           "data",
+           std::make_shared<PReadIndexInput::FileHandle>(fd),
+           file_size,
+           cache,
+           file_id,
+           ctx);
+  };
+  ASSERT_EQ(4096, cache->GetBlockSize());
+
+  std::unique_ptr<PReadIndexInput> in = open_input(cache, IOContext::READ);
+  EXPECT_TRUE(in->IsCached());
+  for (uint32_t i = 0 ; i < file_size ; ++i) {
+    ASSERT_EQ(static_cast<char>(i * 31), in->ReadByte());
+  }
+  EXPECT_THROW(in->ReadByte(), EOFException);
+
+  BlockCache::Stats stats = cache->GetStats();
+  EXPECT_EQ((file_size + 4095) / 4096, stats.misses);
+  EXPECT_LT(0, stats.evictions);
+  EXPECT_GE(64 * 1024, stats.cached_bytes);
+
+  // Hot block is served from the cache even by another input
+  std::unique_ptr<PReadIndexInput> other = open_input(cache, IOContext::READ);
+  char bytes[100];
+  other->Seek(file_size - 100);
+  other->ReadBytes(bytes, 0, 100);
+  for (uint32_t i = 0 ; i < 100 ; ++i) {
+    ASSERT_EQ(static_cast<char>((file_size - 100 + i) * 31), bytes[i]);
+  }
+  EXPECT_EQ(stats.hits + 1, cache->GetStats().hits);
+  EXPECT_EQ(stats.misses, cache->GetStats().misses);
+
+  // Merges bypass the cache
+  const IOContext merge_ctx(MergeInfo(1000, 1024 * 1024, false, 1));
+  std::unique_ptr<PReadIndexInput> merge_in = open_input(cache, merge_ctx);
+  EXPECT_FALSE(merge_in->IsCached());
+  merge_in->Seek(5000);
+  EXPECT_EQ(static_cast<char>(5000 * 31), merge_in->ReadByte());
+  EXPECT_EQ(1, cache->GetStats().bypasses);
+
+  // Many readers on one cache
+  std::vector<std::thread> threads;
+  std::atomic<uint32_t> errors(0);
+  for (uint32_t t = 0 ; t < 4 ; ++t) {
+    threads.emplace_back([&open_input, &cache, &errors, file_size, t](){
+      std::unique_ptr<PReadIndexInput> reader =
+      open_input(cache, IOContext::READ);
+      uint32_t pos = t * 7919;
+      for (uint32_t i = 0 ; i < 2000 ; ++i) {
+        pos = (pos * 1103515245 + 12345) % (file_size - 8);
+        reader->Seek(pos);
+        if (reader->ReadByte() != static_cast<char>(pos * 31)) {
+          errors++;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0, errors.load());
+
+  in->Close();
+  in->Seek(0);
+  EXPECT_THROW(in->ReadByte(), AlreadyClosedException);
+}
+
+TEST(DIRECTORY__TESTS, PREAD__DIRECTORY) {
+  const std::string base("/tmp/pread_directory_test");
+  PrepareEmptyDirectory(base);
+
+  std::shared_ptr<BlockCache> cache =
+  std::make_shared<BlockCache>(1024 * 1024, 4096, 4);
+  PReadDirectory dir(base, FSLockFactory::GetDefault(), cache);
+  const uint32_t num_ints = 100000;
+  auto write_file = [&dir, num_ints](const std::string& name,
+                                     const int32_t seed) {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput(name, IOContext::DEFAULT);
+    for (uint32_t i = 0 ; i < num_ints ; ++i) {
+      out->WriteInt32(static_cast<int32_t>(i) * seed);
+    }
+    out->Close();
+  };
+
+  write_file("_0.doc", 3);
+  std::unique_ptr<IndexInput> in = dir.OpenInput("_0.doc", IOContext::READ);
+  ASSERT_EQ(num_ints * 4, in->Length());
+  PReadIndexInput* pread_in = dynamic_cast<PReadIndexInput*>(in.get());
+  ASSERT_NE(nullptr, pread_in);
+  EXPECT_TRUE(pread_in->IsCached());
+
+  // Clone keeps its own file pointer
+  in->Seek(400);
+  std::unique_ptr<PReadIndexInput> clone = pread_in->Clone();
+  EXPECT_EQ(400, clone->GetFilePointer());
+  EXPECT_EQ(100 * 3, clone->ReadInt32());
+  EXPECT_EQ(400, in->GetFilePointer());
+  EXPECT_EQ(100 * 3, in->ReadInt32());
+
+  // Slice of a slice
+  std::unique_ptr<IndexInput> slice = in->Slice("slice", 4000, 8000);
+  EXPECT_EQ(8000, slice->Length());
+  EXPECT_EQ(1000 * 3, slice->ReadInt32());
+  std::unique_ptr<IndexInput> sub_slice = slice->Slice("sub", 4, 8);
+  EXPECT_EQ(1001 * 3, sub_slice->ReadInt32());
+  EXPECT_EQ(1002 * 3, sub_slice->ReadInt32());
+  EXPECT_THROW(sub_slice->ReadInt32(), EOFException);
+  EXPECT_THROW(slice->Slice("out", 4000, 4004), IllegalArgumentException);
+
+  // Clones are read by many threads without any lock
+  std::vector<std::thread> threads;
+  std::atomic<uint32_t> errors(0);
+  for (uint32_t t = 0 ; t < 4 ; ++t) {
+    std::shared_ptr<PReadIndexInput> reader(pread_in->Clone());
+    threads.emplace_back([reader, &errors, num_ints, t](){
+      uint32_t idx = t;
+      for (uint32_t i = 0 ; i < 5000 ; ++i) {
+        idx = (idx * 1103515245 + 12345) % num_ints;
+        reader->Seek(idx * 4);
+        if (reader->ReadInt32() != static_cast<int32_t>(idx) * 3) {
+          errors++;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0, errors.load());
+
+  // Opens of a same file share blocks, new content never sees old ones
+  std::unique_ptr<IndexInput> again = dir.OpenInput("_0.doc", IOContext::READ);
+  EXPECT_EQ(pread_in->GetFileId(),
+            dynamic_cast<PReadIndexInput*>(again.get())->GetFileId());
+  const uint64_t hits = cache->GetStats().hits;
+  EXPECT_EQ(0, again->ReadInt32());
+  EXPECT_LT(hits, cache->GetStats().hits);
+
+  dir.DeleteFile("_0.doc");
+  EXPECT_FALSE(dir.CheckPendingDeletions());
+  write_file("_0.doc", 7);
+  std::unique_ptr<IndexInput> fresh = dir.OpenInput("_0.doc", IOContext::READ);
+  EXPECT_NE(pread_in->GetFileId(),
+            dynamic_cast<PReadIndexInput*>(fresh.get())->GetFileId());
+  fresh->Seek(400);
+  EXPECT_EQ(100 * 7, fresh->ReadInt32());
+
+  // Old input still reads the unlinked file through its descriptor
+  in->Seek(800);
+  EXPECT_EQ(200 * 3, in->ReadInt32());
+
+  // Without a cache
+  PReadDirectory plain_dir(base);
+  std::unique_ptr<IndexInput> plain =
+  plain_dir.OpenInput("_0.doc", IOContext::READ);
+  EXPECT_FALSE(dynamic_cast<PReadIndexInput*>(plain.get())->IsCached());
+  plain->Seek(4 * (num_ints - 1));
+  EXPECT_EQ(static_cast<int32_t>(num_ints - 1) * 7, plain->ReadInt32());
+  EXPECT_THROW(plain_dir.OpenInput("_1.doc", IOContext::READ),
+               NoSuchFileException);
+}
+
+TEST(DIRECTORY__TESTS, TRACKING__DIRECTORY) {
+  const std::string base("/tmp/tracking_directory_test");
+  PrepareEmptyDirectory(base);
+
+  TrackingDirectory dir(std::make_shared<MMapDirectory>(base));
+  const uint32_t num_ints = 5000;
+  {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput("_0.tim", IOContext::DEFAULT);
+    for (uint32_t i = 0 ; i < num_ints ; ++i) {
+      out->WriteInt32(static_cast<int32_t>(i));
+    }
+    out->Close();
+
+    char bytes[100];
+    std::fill(bytes, bytes + sizeof(bytes), 'a');
+    out = dir.CreateOutput("_0.fdt", IOContext::DEFAULT);
+    out->WriteByte('b');
+    out->WriteBytes(bytes, 0, sizeof(bytes));
+    out->Close();
+  }
+
+  IOStats tim = dir.GetStats("tim");
+  EXPECT_EQ(1, tim.opens);
+  EXPECT_EQ(num_ints * 4, tim.bytes_written);
+  EXPECT_EQ(0, tim.bytes_read);
+  IOStats fdt = dir.GetStats("fdt");
+  EXPECT_EQ(101, fdt.bytes_written);
+  EXPECT_EQ(2, fdt.write_ops);
+  uint64_t timed_writes = 0;
+  for (uint32_t i = 0 ; i < IOStats::NUM_LATENCY_BUCKETS ; ++i) {
+    timed_writes += fdt.write_latency[i];
+  }
+  EXPECT_EQ(1, timed_writes);
+
+  {
+    std::unique_ptr<IndexInput> in = dir.OpenInput("_0.tim", IOContext::READ);
+    for (uint32_t i = 0 ; i < num_ints ; ++i) {
+      EXPECT_EQ(i, in->ReadInt32());
+    }
+    in->Seek(40);
+    EXPECT_EQ(10, in->ReadInt32());
+
+    // Slices count into the file they were taken from
+    std::unique_ptr<IndexInput> slice = in->Slice("slice", 400, 400);
+    EXPECT_EQ(100, slice->ReadInt32());
+    slice->Close();
+
+    // Bulk reads are one operation of all the bytes they consumed
+    int32_t ints[10];
+    in->Seek(0);
+    in->ReadInt32s(ints, 10);
+    EXPECT_EQ(9, ints[9]);
+    in->Seek(0);
+    in->ReadVInt32s(ints, 8);
+    EXPECT_EQ(1, ints[7]);
+    in->SkipBytes(3);
+    EXPECT_EQ(2, in->ReadVInt32());
+
+    // Positional reads stay positional through the wrapper
+    std::unique_ptr<RandomAccessInput> ra = in->RandomAccessSlice(400, 400);
+    EXPECT_NE(nullptr, dynamic_cast<TrackingIndexInput*>(ra.get()));
+    EXPECT_EQ(101, ra->ReadInt32(4));
+    ra.reset();
+    in->Close();
+
+    in = dir.OpenInput("_0.fdt", IOContext(MergeInfo(1, 101, false, 1)));
+    char bytes[101];
+    in->ReadBytes(bytes, 0, sizeof(bytes));
+    EXPECT_EQ('b', bytes[0]);
+    EXPECT_EQ('a', bytes[100]);
+    in->Seek(0);
+    EXPECT_EQ(std::string(98, 'a'), in->ReadString());
+  }
+
+  std::vector<TrackingDirectory::Entry> entries = dir.GetStats();
+  ASSERT_EQ(4, entries.size());
+  // Ordered by extension, then context
+  EXPECT_EQ("fdt", entries[0].extension);
+  EXPECT_TRUE(IOContext::Context::MERGE == entries[0].context);
+  EXPECT_EQ(1, entries[0].stats.opens);
+  EXPECT_EQ(101 + 99, entries[0].stats.bytes_read);
+  EXPECT_EQ(2, entries[0].stats.read_ops);
+  uint64_t timed_reads = 0;
+  for (uint32_t i = 0 ; i < IOStats::NUM_LATENCY_BUCKETS ; ++i) {
+    timed_reads += entries[0].stats.read_latency[i];
+  }
+  EXPECT_EQ(1, timed_reads);
+
+  EXPECT_EQ("tim", entries[2].extension);
+  EXPECT_TRUE(IOContext::Context::READ == entries[2].context);
+  EXPECT_EQ(1, entries[2].stats.opens);
+  EXPECT_EQ((num_ints + 12) * 4 + 8 + 8, entries[2].stats.bytes_read);
+  EXPECT_EQ(num_ints + 7, entries[2].stats.read_ops);
+  EXPECT_EQ(3, entries[2].stats.seeks);
+  EXPECT_EQ(0, entries[2].stats.bytes_written);
+
+  tim = dir.GetStats("tim");
+  EXPECT_EQ(2, tim.opens);
+  EXPECT_EQ(num_ints * 4, tim.bytes_written);
+  EXPECT_EQ((num_ints + 12) * 4 + 8 + 8, tim.bytes_read);
+
+  EXPECT_EQ(0, IOStats::LatencyBucket(0));
+  EXPECT_EQ(10, IOStats::LatencyBucket(1024));
+  EXPECT_EQ(IOStats::NUM_LATENCY_BUCKETS - 1,
+            IOStats::LatencyBucket(UINT64_MAX));
+
+  dir.ResetStats();
+  EXPECT_TRUE(dir.GetStats().empty());
+  dir.Close();
+}
+
+TEST(DIRECTORY__TESTS, PARALLEL__CHECKSUM) {
+  const std::string base("/tmp/parallel_checksum_test");
+  PrepareEmptyDirectory(base);
+
+  MMapDirectory dir(base);
+  const uint64_t length = 3 * Directory::MIN_CHECKSUM_RANGE + 12345;
+  {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput("_0.fdt", IOContext::DEFAULT);
+    std::vector<char> bytes(length);
+    uint32_t seed = 12345;
+    for (char& b : bytes) {
+      seed = seed * 1103515245 + 12345;
+      b = static_cast<char>(seed >> 16);
+    }
+    out->WriteBytes(bytes.data(), 0, bytes.size());
+    out->Close();
+  }
+
+  auto sequential_checksum = [&dir](const uint64_t len) {
+    std::unique_ptr<ChecksumIndexInput> in =
+    dir.OpenChecksumInput("_0.fdt", IOContext::READONCE);
+    std::vector<char> bytes(len);
+    in->ReadBytes(bytes.data(), 0, len);
+    return in->GetChecksum();
+  };
+
+  const int64_t expected = sequential_checksum(length);
+  EXPECT_EQ(expected,
+            dir.ComputeChecksum("_0.fdt", length, IOContext::READONCE, 1));
+  EXPECT_EQ(expected,
+            dir.ComputeChecksum("_0.fdt", length, IOContext::READONCE, 3));
+  EXPECT_EQ(expected,
+            dir.ComputeChecksum("_0.fdt", length, IOContext::READONCE, 16));
+  EXPECT_EQ(expected,
+            dir.ComputeChecksum("_0.fdt", length, IOContext::READONCE));
+
+  const uint64_t partial = length - sizeof(int64_t);
+  EXPECT_EQ(sequential_checksum(partial),
+            dir.ComputeChecksum("_0.fdt", partial, IOContext::READONCE, 4));
+  EXPECT_EQ(0, dir.ComputeChecksum("_0.fdt", 0, IOContext::READONCE, 4));
+  EXPECT_THROW(dir.ComputeChecksum("_0.fdt", length + 1, IOContext::READONCE),
+               EOFException);
+
+  // Ranges must not share a file pointer whatever the directory
+  IoUringDirectory uring_dir(base);
+  EXPECT_EQ(expected,
+            uring_dir.ComputeChecksum("_0.fdt", length, IOContext::READONCE, 3));
+  uring_dir.Close();
+  dir.Close();
+}
+
+TEST(DIRECTORY__TESTS, KERNEL__COPY__FROM) {
+  const std::string src_base("/tmp/kernel_copy_src_test");
+  const std::string dest_base("/tmp/kernel_copy_dest_test");
+  PrepareEmptyDirectory(src_base);
+  PrepareEmptyDirectory(dest_base);
+
+  MMapDirectory src_dir(src_base);
+  PReadDirectory dest_dir(dest_base);
+  const size_t length = 3 * 1024 * 1024 + 17;
+  {
+    std::unique_ptr<IndexOutput> out =
+    src_dir.CreateOutput("_0.fdt", IOContext::DEFAULT);
+    for (size_t i = 0 ; i < length ; ++i) {
+      out->WriteByte(static_cast<char>(i * 31));
+    }
+    out->Close();
+  }
+
+  auto check_copy = [length](Directory& dir, const std::string& name) {
+    std::unique_ptr<IndexInput> in = dir.OpenInput(name, IOContext::READ);
+    ASSERT_EQ(length, in->Length());
+    for (size_t i = 0 ; i < length ; ++i) {
+      ASSERT_EQ(static_cast<char>(i * 31), in->ReadByte());
+    }
+  };
+
+  // Kernel copy between two FSDirectories
+  dest_dir.CopyFrom(src_dir, "_0.fdt", "_1.fdt", IOContext::DEFAULT);
+  check_copy(dest_dir, "_1.fdt");
+
+  // Same directory
+  src_dir.CopyFrom(src_dir, "_0.fdt", "_2.fdt", IOContext::DEFAULT);
+  check_copy(src_dir, "_2.fdt");
+
+  // Whatever way the kernel took, bytes must match
+  const FileUtil::CopyMethod method =
+  FileUtil::CopyFile(src_base + "/_0.fdt", dest_base + "/_3.fdt");
+  EXPECT_TRUE(method != FileUtil::CopyMethod::BUFFERED);
+  check_copy(dest_dir, "_3.fdt");
+
+  // Existing destination is never overwritten nor removed
+  EXPECT_THROW(dest_dir.CopyFrom(src_dir, "_0.fdt", "_1.fdt",
+                                 IOContext::DEFAULT),
+               IOException);
+  check_copy(dest_dir, "_1.fdt");
+
+  // Missing source leaves nothing behind
+  EXPECT_THROW(dest_dir.CopyFrom(src_dir, "_9.fdt", "_4.fdt",
+                                 IOContext::DEFAULT),
+               NoSuchFileException);
+  EXPECT_FALSE(FileUtil::Exists(dest_base + "/_4.fdt"));
+
+  // Pending deletes cannot be copied
+  src_dir.DeleteFile("_2.fdt");
+  src_dir.DeletePendingFiles();
+  EXPECT_THROW(dest_dir.CopyFrom(src_dir, "_2.fdt", "_5.fdt",
+                                 IOContext::DEFAULT),
+               NoSuchFileException);
+
+  src_dir.Close();
+  dest_dir.Close();
+}
+
+TEST(DIRECTORY__TESTS, MMAP__DIRECTORY__WARM__UP) {
+  const std::string base("/tmp/mmap_warm_up_test");
+  PrepareEmptyDirectory(base);
+
+  MMapDirectory dir(base);
+  const uint64_t length = 9 * 1024 * 1024 + 123;
+  for (const char* name : {"_0.tim", "_0.doc", "_0.fdt"}) {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput(name, IOContext::DEFAULT);
+    std::vector<char> bytes(length, name[3]);
+    out->WriteBytes(bytes.data(), 0, bytes.size());
+    out->Close();
+  }
+  dir.CreateOutput("_0.tip", IOContext::DEFAULT)->Close();
+
+  EXPECT_FALSE(dir.GetWarmUpStats().completed);
+
+  // Empty files are skipped
+  MMapDirectory::WarmUpStats stats = dir.WarmUp({"tim", "doc", "tip"}, 3);
+  EXPECT_TRUE(stats.completed);
+  EXPECT_EQ(2, stats.files);
+  EXPECT_EQ(2 * length, stats.bytes);
+  EXPECT_EQ(0, stats.locked_bytes);
+  EXPECT_TRUE(dir.GetWarmUpStats().completed);
+  EXPECT_EQ(stats.bytes, dir.GetWarmUpStats().bytes);
+
+  // Every file
+  stats = dir.WarmUp({});
+  EXPECT_EQ(3, stats.files);
+  EXPECT_EQ(3 * length, stats.bytes);
+
+  // Locking may be refused past RLIMIT_MEMLOCK, pages are still faulted in
+  stats = dir.WarmUp({"fdt"}, 2, true);
+  EXPECT_EQ(1, stats.files);
+  EXPECT_LE(stats.locked_bytes, length);
+
+  std::unique_ptr<IndexInput> in = dir.OpenInput("_0.fdt", IOContext::READ);
+  in->Seek(length - 1);
+  EXPECT_EQ('f', in->ReadByte());
+  in->Close();
+
+  dir.ReleaseWarmUp();
+  dir.Close();
+}
+
+TEST(DIRECTORY__TESTS, PAGE__HEAT__SNAPSHOT) {
+  const std::string base("/tmp/page_heat_test");
+  PrepareEmptyDirectory(base);
+
+  MMapDirectory dir(base);
+  const uint64_t length = 1024 * 1024 + 5;
+  for (const char* name : {"_0.tim", "_0.doc", "_1.tim"}) {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput(name, IOContext::DEFAULT);
+    std::vector<char> bytes(length, 'x');
+    out->WriteBytes(bytes.data(), 0, bytes.size());
+    out->Close();
+  }
+
+  // Missing snapshot replays nothing
+  PageHeatSnapshot::Stats stats = PageHeatSnapshot::Replay(dir, "heat.snap");
+  EXPECT_EQ(0, stats.files);
+
+  // Freshly written pages are in page cache
+  stats = PageHeatSnapshot::Save(dir, "heat.snap", {"tim"});
+  EXPECT_LE(stats.files, 2);
+  EXPECT_LE(stats.bytes, 2 * length + 2 * 4096);
+  EXPECT_TRUE(FileUtil::Exists(base + "/heat.snap"));
+  for (const std::string& name : dir.ListAll()) {
+    EXPECT_NE("tmp", name.substr(name.length() - 3));
+  }
+
+  PageHeatSnapshot::Stats replayed =
+  PageHeatSnapshot::Replay(dir, "heat.snap", 2);
+  EXPECT_EQ(stats.files, replayed.files);
+  EXPECT_EQ(stats.pages, replayed.pages);
+
+  // Rewritten file is skipped
+  if (stats.files == 2) {
+    dir.DeleteFile("_1.tim");
+    dir.DeletePendingFiles();
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput("_1.tim", IOContext::DEFAULT);
+    out->WriteByte('x');
+    out->Close();
+    EXPECT_EQ(1, PageHeatSnapshot::Replay(dir, "heat.snap").files);
+  }
+
+  // Corrupted snapshot is refused
+  {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput("bad.snap", IOContext::DEFAULT);
+    out->WriteInt32(CodecUtil::CODEC_MAGIC);
+    out->WriteString("SomethingElse");
+    out->Close();
+  }
+  EXPECT_THROW(PageHeatSnapshot::Replay(dir, "bad.snap"), IOException);
+
+  // Sampler keeps replacing the snapshot
+  {
+    PageHeatSampler sampler(dir, "sampled.snap", {},
+                            std::chrono::milliseconds(5));
+    while (sampler.GetSaves() < 2) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    sampler.Stop();
+    EXPECT_EQ(0, sampler.GetFailures());
+  }
+  EXPECT_TRUE(FileUtil::Exists(base + "/sampled.snap"));
+  dir.Close();
+}
+
+TEST(DIRECTORY__TESTS, HANDLE__POOL__DIRECTORY) {
+  const std::string base("/tmp/handle_pool_test");
+  PrepareEmptyDirectory(base);
+
+  std::shared_ptr<HandlePool> pool = std::make_shared<HandlePool>(2);
+  HandlePoolDirectory dir(std::make_shared<MMapDirectory>(base), pool);
+  const uint32_t length = 10000;
+  const std::vector<std::string> names{"_0.doc", "_1.doc", "_2.doc"};
+  for (uint32_t i = 0 ; i < names.size() ; ++i) {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput(names[i], IOContext::DEFAULT);
+    for (uint32_t j = 0 ; j < length ; ++j) {
+      out->WriteByte(static_cast<char>(i + j));
+    }
+    out->Close();
+  }
+
+  std::vector<std::unique_ptr<IndexInput>> ins;
+  for (const std::string& name : names) {
+    ins.push_back(dir.OpenInput(name, IOContext::READ));
+  }
+
+  // Third open pushed the first file out
+  HandlePool::Stats stats = pool->GetStats();
+  EXPECT_EQ(2, stats.open_handles);
+  EXPECT_EQ(3, stats.opens);
+  EXPECT_EQ(1, stats.evictions);
+
+  // Readers of one file go at once, even while files are evicted under them
+  {
+    std::vector<std::unique_ptr<IndexInput>> clones;
+    for (uint32_t t = 0 ; t < 4 ; ++t) {
+      clones.push_back(
+        static_cast<PooledIndexInput*>(ins[t % names.size()].get())->Clone());
+    }
+    std::atomic<uint32_t> mismatches(0);
+    std::vector<std::thread> readers;
+    for (uint32_t t = 0 ; t < clones.size() ; ++t) {
+      readers.emplace_back([&clones, &mismatches, t, length]() {
+        const uint32_t i = t % 3;
+        for (uint32_t round = 0 ; round < 20 ; ++round) {
+          clones[t]->Seek(0);
+          for (uint32_t j = 0 ; j < length ; ++j) {
+            if (clones[t]->ReadByte() != static_cast<char>(i + j)) {
+              mismatches++;
+            }
+          }
+        }
+      });
+    }
+    for (uint32_t round = 0 ; round < 20 ; ++round) {
+      pool->EvictIdle(std::chrono::nanoseconds(0));
+    }
+    for (std::thread& reader : readers) {
+      reader.join();
+    }
+    EXPECT_EQ(0, mismatches.load());
+    EXPECT_GE(2, pool->GetStats().open_handles);
+  }
+
+  // Reading the evicted file reopens it and evicts the next one
+  for (uint32_t i = 0 ; i < names.size() ; ++i) {
+    EXPECT_EQ(length, ins[i]->Length());
+    for (uint32_t j = 0 ; j < length ; ++j) {
+      ASSERT_EQ(static_cast<char>(i + j), ins[i]->ReadByte());
+    }
+  }
+  stats = pool->GetStats();
+  EXPECT_EQ(2, stats.open_handles);
+  EXPECT_LE(1, stats.reopens);
+
+  // Slices and clones share the handle
+  std::unique_ptr<IndexInput> slice = ins[0]->Slice("slice", 100, 50);
+  slice->Seek(10);
+  EXPECT_EQ(static_cast<char>(110), slice->ReadByte());
+  EXPECT_THROW(ins[0]->Slice("slice", length - 1, 2),
+               IllegalArgumentException);
+
+  // Idle files are closed, nothing is open anymore
+  EXPECT_EQ(2, pool->EvictIdle(std::chrono::nanoseconds(0)));
+  EXPECT_EQ(0, pool->GetStats().open_handles);
+  ins[1]->Seek(1);
+  EXPECT_EQ(static_cast<char>(2), ins[1]->ReadByte());
+  EXPECT_EQ(1, pool->GetStats().open_handles);
+  EXPECT_EQ(0, pool->EvictIdle(std::chrono::hours(1)));
+
+  pool->SetMaxOpen(1);
+  EXPECT_EQ(1, pool->GetMaxOpen());
+
+  // Closed inputs give their slot back
+  slice.reset();
+  ins.clear();
+  EXPECT_EQ(0, pool->GetStats().open_handles);
+
+  // Rewritten file is refused rather than read
+  std::unique_ptr<IndexInput> in = dir.OpenInput("_0.doc", IOContext::READ);
+  std::unique_ptr<IndexInput> other = dir.OpenInput("_1.doc", IOContext::READ);
+  FileUtil::Delete(base + "/_0.doc");
+  {
+    std::unique_ptr<IndexOutput> out =
+    dir.CreateOutput("_0.doc", IOContext::DEFAULT);
+    out->WriteByte('x');
+    out->Close();
+  }
+  EXPECT_THROW(in->ReadByte(), IOException);
+  EXPECT_EQ(static_cast<char>(1), other->ReadByte());
+
+  in->Close();
+  EXPECT_THROW(in->ReadByte(), AlreadyClosedException);
+  dir.Close();
+}
+
 /*
 // Be cautious! This takes more than one minute.
 TEST(DIRECTORY__TESTS, BULK__IO__VALIDATION) {
@@ -16,8 +16,16 @@
  */
 
 #include <Util/Bits.h>
+#include <Util/Exception.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <algorithm>
 
 using lucene::core::util::BitUtil;
+using lucene::core::util::EndianUtil;
+using lucene::core::util::IOException;
+using lucene::core::util::VIntUtil;
 
 const uint64_t BitUtil::MAGIC[7] = {
   0x5555555555555555L, 0x3333333333333333L,
@@ -29,3 +37,479 @@ const uint64_t BitUtil::MAGIC[7] = {
 const uint16_t BitUtil::SHIFT[5] = {
   1, 2, 4, 8, 16
 };
+
+/**
+ *  VIntUtil
+ */
+const uint32_t VIntUtil::MAX_VINT32_BYTES;
+
+namespace {
+
+// `len` bytes starting at `p` form one value, last one has no high bit
+inline int32_t AssembleVInt32(const uint8_t* p, const uint32_t len) {
+  if (len > VIntUtil::MAX_VINT32_BYTES ||
+      (len == VIntUtil::MAX_VINT32_BYTES && (p[4] & 0xF0) != 0)) {
+    throw IOException("Invalid vInt detected (too many bits)");
+  }
+
+  uint32_t value = (p[0] & 0x7F);
+  for (uint32_t i = 1 ; i < len ; ++i) {
+    value |= (static_cast<uint32_t>(p[i] & 0x7F) << (7 * i));
+  }
+
+  return static_cast<int32_t>(value);
+}
+
+inline char* EncodeVInt32(const int32_t v, char* dst) {
+  uint32_t u = static_cast<uint32_t>(v);
+  while (u > 0x7F) {
+    *dst++ = static_cast<char>((u & 0x7F) | 0x80);
+    u >>= 7;
+  }
+
+  *dst++ = static_cast<char>(u);
+  return dst;
+}
+
+}  // namespace
+
+#if defined(__x86_64__) || defined(__i386__)
+
+namespace {
+
+// Decodes every value whose terminator bit is set in `terminators`
+inline uint32_t DecodeByMask(const uint8_t* p,
+                             uint32_t terminators,
+                             int32_t* dst) {
+  uint32_t start = 0;
+  while (terminators != 0) {
+    const uint32_t pos = __builtin_ctz(terminators);
+    terminators &= (terminators - 1);
+    *dst++ = AssembleVInt32(p + start, pos - start + 1);
+    start = pos + 1;
+  }
+
+  return start;
+}
+
+// How to pull the one or two byte values at the head of an 8 bytes window
+// into 16 bits lanes, indexed by the continuation bits of the window
+struct ShuffleEntry {
+  uint8_t shuffle[16];
+  uint8_t count;
+  uint8_t consumed;
+};
+
+const ShuffleEntry* BuildShuffleTable() {
+  static ShuffleEntry table[256];
+  for (uint32_t mask = 0 ; mask < 256 ; ++mask) {
+    ShuffleEntry& entry = table[mask];
+    std::fill(entry.shuffle, entry.shuffle + 16, 0x80);
+    uint32_t pos = 0;
+    uint32_t k = 0;
+    while (pos < 8) {
+      if ((mask & (1U << pos)) == 0) {
+        entry.shuffle[2 * k] = pos;
+        pos += 1;
+      } else if (pos + 1 < 8 && (mask & (1U << (pos + 1))) == 0) {
+        entry.shuffle[2 * k] = pos;
+        entry.shuffle[2 * k + 1] = pos + 1;
+        pos += 2;
+      } else {
+        // Longer than two bytes, or not terminated in this window
+        break;
+      }
+      k++;
+    }
+    entry.count = k;
+    entry.consumed = pos;
+  }
+
+  return table;
+}
+
+uint32_t DecodeVInt32sSse2(const char src[],
+                           const uint32_t src_len,
+                           int32_t dst[],
+                           const uint32_t n,
+                           uint32_t* decoded) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* end = p + src_len;
+  uint32_t count = 0;
+  const __m128i zero = _mm_setzero_si128();
+
+  // At most 16 terminators per block, so `n` is never overrun
+  while ((end - p) >= 16 && (n - count) >= 16) {
+    const __m128i chunk =
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const uint32_t continuation =
+    static_cast<uint32_t>(_mm_movemask_epi8(chunk));
+
+    if (continuation == 0) {
+      // Sixteen one byte values, widen them at once
+      const __m128i lo = _mm_unpacklo_epi8(chunk, zero);
+      const __m128i hi = _mm_unpackhi_epi8(chunk, zero);
+      __m128i* out = reinterpret_cast<__m128i*>(dst + count);
+      _mm_storeu_si128(out, _mm_unpacklo_epi16(lo, zero));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+      _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+      _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+      p += 16;
+      count += 16;
+      continue;
+    }
+
+    const uint32_t terminators = (~continuation & 0xFFFF);
+    if (terminators == 0) {
+      throw IOException("Invalid vInt detected (too many bits)");
+    }
+
+    const uint32_t num_values = __builtin_popcount(terminators);
+    p += DecodeByMask(p, terminators, dst + count);
+    count += num_values;
+  }
+
+  const uint32_t consumed = static_cast<uint32_t>(
+                            p - reinterpret_cast<const uint8_t*>(src));
+  uint32_t tail_decoded = 0;
+  const uint32_t tail_consumed =
+  VIntUtil::DecodeVInt32sScalar(src + consumed,
+                                src_len - consumed,
+                                dst + count,
+                                n - count,
+                                &tail_decoded);
+  *decoded = count + tail_decoded;
+  return consumed + tail_consumed;
+}
+
+}  // namespace
+
+__attribute__((target("avx2")))
+uint32_t VIntUtil::DecodeVInt32sAvx2(const char src[],
+                                     const uint32_t src_len,
+                                     int32_t dst[],
+                                     const uint32_t n,
+                                     uint32_t* decoded) {
+  static const ShuffleEntry* const shuffle_table = BuildShuffleTable();
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* end = p + src_len;
+  uint32_t count = 0;
+
+  // At most 32 terminators per block, so `n` is never overrun
+  while ((end - p) >= 32 && (n - count) >= 32) {
+    const __m256i chunk =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const uint32_t continuation =
+    static_cast<uint32_t>(_mm256_movemask_epi8(chunk));
+
+    if (continuation == 0) {
+      // Thirty two one byte values, widen them eight at a time
+      __m256i* out = reinterpret_cast<__m256i*>(dst + count);
+      for (uint32_t i = 0 ; i < 4 ; ++i) {
+        const __m128i eight =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 8 * i));
+        _mm256_storeu_si256(out + i, _mm256_cvtepu8_epi32(eight));
+      }
+      p += 32;
+      count += 32;
+      continue;
+    }
+
+    // Mixed block, one and two byte values go eight at a time through the
+    // shuffle table. Window starts at most 24 bytes in, so at most 24
+    // values are decoded before it and the 8 lanes stored never pass `n`
+    const uint8_t* block = p;
+    uint32_t offset = 0;
+    while (offset <= 24) {
+      const ShuffleEntry& entry =
+      shuffle_table[(continuation >> offset) & 0xFF];
+      if (entry.count == 0) {
+        break;
+      }
+
+      const __m128i window =
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block + offset));
+      const __m128i lanes = _mm_shuffle_epi8(
+        window,
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry.shuffle)));
+      const __m128i values = _mm_or_si128(
+        _mm_and_si128(lanes, _mm_set1_epi16(0x7F)),
+        _mm_srli_epi16(_mm_and_si128(lanes, _mm_set1_epi16(0x7F00)), 1));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + count),
+                          _mm256_cvtepu16_epi32(values));
+      offset += entry.consumed;
+      count += entry.count;
+    }
+
+    if (offset > 24) {
+      // Rest of the block is picked up by the next one
+      p = block + offset;
+      continue;
+    }
+
+    // Longer values, every value left in the block is assembled by mask
+    const uint32_t terminators = (~continuation >> offset);
+    if (terminators == 0) {
+      if (offset == 0) {
+        throw IOException("Invalid vInt detected (too many bits)");
+      }
+      p = block + offset;
+      continue;
+    }
+
+    const uint32_t num_values = __builtin_popcount(terminators);
+    p = block + offset + DecodeByMask(block + offset, terminators, dst + count);
+    count += num_values;
+  }
+
+  const uint32_t consumed = static_cast<uint32_t>(
+                            p - reinterpret_cast<const uint8_t*>(src));
+  uint32_t tail_decoded = 0;
+  const uint32_t tail_consumed = DecodeVInt32sScalar(src + consumed,
+                                                     src_len - consumed,
+                                                     dst + count,
+                                                     n - count,
+                                                     &tail_decoded);
+  *decoded = count + tail_decoded;
+  return consumed + tail_consumed;
+}
+
+bool VIntUtil::HasAvx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+
+uint32_t VIntUtil::DecodeVInt32s(const char src[],
+                                 const uint32_t src_len,
+                                 int32_t dst[],
+                                 const uint32_t n,
+                                 uint32_t* decoded) {
+  if (HasAvx2()) {
+    return DecodeVInt32sAvx2(src, src_len, dst, n, decoded);
+  }
+
+  return DecodeVInt32sSse2(src, src_len, dst, n, decoded);
+}
+
+uint32_t VIntUtil::EncodeVInt32s(const int32_t src[],
+                                 const uint32_t n,
+                                 char dst[]) {
+  char* q = dst;
+  uint32_t i = 0;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i high_bits = _mm_set1_epi32(~0x7F);
+
+  while ((n - i) >= 16) {
+    const __m128i* in = reinterpret_cast<const __m128i*>(src + i);
+    const __m128i a = _mm_loadu_si128(in);
+    const __m128i b = _mm_loadu_si128(in + 1);
+    const __m128i c = _mm_loadu_si128(in + 2);
+    const __m128i d = _mm_loadu_si128(in + 3);
+    const __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+
+    if (_mm_movemask_epi8(
+          _mm_cmpeq_epi32(_mm_and_si128(any, high_bits), zero)) == 0xFFFF) {
+      // Every value fits in one byte, narrow sixteen of them at once
+      const __m128i bytes = _mm_packs_epi16(_mm_packs_epi32(a, b),
+                                            _mm_packs_epi32(c, d));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(q), bytes);
+      q += 16;
+    } else {
+      for (uint32_t k = 0 ; k < 16 ; ++k) {
+        q = EncodeVInt32(src[i + k], q);
+      }
+    }
+
+    i += 16;
+  }
+
+  for ( ; i < n ; ++i) {
+    q = EncodeVInt32(src[i], q);
+  }
+
+  return static_cast<uint32_t>(q - dst);
+}
+
+#else  // defined(__x86_64__) || defined(__i386__)
+
+uint32_t VIntUtil::DecodeVInt32sAvx2(const char src[],
+                                     const uint32_t src_len,
+                                     int32_t dst[],
+                                     const uint32_t n,
+                                     uint32_t* decoded) {
+  return DecodeVInt32sScalar(src, src_len, dst, n, decoded);
+}
+
+bool VIntUtil::HasAvx2() {
+  return false;
+}
+
+uint32_t VIntUtil::DecodeVInt32s(const char src[],
+                                 const uint32_t src_len,
+                                 int32_t dst[],
+                                 const uint32_t n,
+                                 uint32_t* decoded) {
+  return DecodeVInt32sScalar(src, src_len, dst, n, decoded);
+}
+
+uint32_t VIntUtil::EncodeVInt32s(const int32_t src[],
+                                 const uint32_t n,
+                                 char dst[]) {
+  return EncodeVInt32sScalar(src, n, dst);
+}
+
+#endif  // defined(__x86_64__) || defined(__i386__)
+
+uint32_t VIntUtil::DecodeVInt32sScalar(const char src[],
+                                       const uint32_t src_len,
+                                       int32_t dst[],
+                                       const uint32_t n,
+                                       uint32_t* decoded) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* end = p + src_len;
+  uint32_t count = 0;
+
+  while (count < n && p < end) {
+    // Find the terminator first, so a cut off value is left untouched
+    const uint32_t avail = static_cast<uint32_t>(
+                           std::min<ptrdiff_t>(end - p, MAX_VINT32_BYTES));
+    uint32_t len = 0;
+    while (len < avail && (p[len] & 0x80) != 0) {
+      ++len;
+    }
+
+    if (len == avail) {
+      if (avail == MAX_VINT32_BYTES) {
+        throw IOException("Invalid vInt detected (too many bits)");
+      }
+      break;
+    }
+
+    dst[count++] = AssembleVInt32(p, len + 1);
+    p += (len + 1);
+  }
+
+  *decoded = count;
+  return static_cast<uint32_t>(p - reinterpret_cast<const uint8_t*>(src));
+}
+
+uint32_t VIntUtil::EncodeVInt32sScalar(const int32_t src[],
+                                       const uint32_t n,
+                                       char dst[]) {
+  char* q = dst;
+  for (uint32_t i = 0 ; i < n ; ++i) {
+    q = EncodeVInt32(src[i], q);
+  }
+
+  return static_cast<uint32_t>(q - dst);
+}
+
+/**
+ *  EndianUtil
+ */
+namespace {
+
+inline uint16_t ByteSwap(const uint16_t v) {
+  return __builtin_bswap16(v);
+}
+
+inline uint32_t ByteSwap(const uint32_t v) {
+  return __builtin_bswap32(v);
+}
+
+inline uint64_t ByteSwap(const uint64_t v) {
+  return __builtin_bswap64(v);
+}
+
+template <typename T>
+void SwapScalar(const char src[], char dst[], const uint32_t n) {
+  for (uint32_t i = 0 ; i < n ; ++i) {
+    T v;
+    std::memcpy(&v, src + i * sizeof(T), sizeof(T));
+    v = ByteSwap(v);
+    std::memcpy(dst + i * sizeof(T), &v, sizeof(T));
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+template <typename T>
+__attribute__((target("avx2")))
+void SwapAvx2(const char src[], char dst[], const uint32_t n) {
+  // Reverses bytes within every sizeof(T) wide lane
+  alignas(32) char mask_bytes[32];
+  for (uint32_t i = 0 ; i < 32 ; ++i) {
+    mask_bytes[i] = static_cast<char>((i / sizeof(T)) * sizeof(T) +
+                                      (sizeof(T) - 1 - i % sizeof(T)));
+  }
+  const __m256i mask =
+  _mm256_load_si256(reinterpret_cast<const __m256i*>(mask_bytes));
+
+  const uint64_t num_bytes = static_cast<uint64_t>(n) * sizeof(T);
+  uint64_t i = 0;
+  for ( ; i + 32 <= num_bytes ; i += 32) {
+    const __m256i v =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_shuffle_epi8(v, mask));
+  }
+
+  SwapScalar<T>(src + i, dst + i, (num_bytes - i) / sizeof(T));
+}
+
+#endif  // defined(__x86_64__) || defined(__i386__)
+
+template <typename T>
+void Swap(const char src[], char dst[], const uint32_t n) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if defined(__x86_64__) || defined(__i386__)
+  if (n * sizeof(T) >= 32 && VIntUtil::HasAvx2()) {
+    SwapAvx2<T>(src, dst, n);
+    return;
+  }
+#endif
+  SwapScalar<T>(src, dst, n);
+#else
+  if (src != dst) {
+    std::memcpy(dst, src, static_cast<size_t>(n) * sizeof(T));
+  }
+#endif
+}
+
+}  // namespace
+
+void EndianUtil::ReadInt16s(const char src[],
+                            int16_t dst[],
+                            const uint32_t n) {
+  Swap<uint16_t>(src, reinterpret_cast<char*>(dst), n);
+}
+
+void EndianUtil::ReadInt32s(const char src[],
+                            int32_t dst[],
+                            const uint32_t n) {
+  Swap<uint32_t>(src, reinterpret_cast<char*>(dst), n);
+}
+
+void EndianUtil::ReadInt64s(const char src[],
+                            int64_t dst[],
+                            const uint32_t n) {
+  Swap<uint64_t>(src, reinterpret_cast<char*>(dst), n);
+}
+
+void EndianUtil::WriteInt16s(const int16_t src[],
+                             const uint32_t n,
+                             char dst[]) {
+  Swap<uint16_t>(reinterpret_cast<const char*>(src), dst, n);
+}
+
+void EndianUtil::WriteInt32s(const int32_t src[],
+                             const uint32_t n,
+                             char dst[]) {
+  Swap<uint32_t>(reinterpret_cast<const char*>(src), dst, n);
+}
+
+void EndianUtil::WriteInt64s(const int64_t src[],
+                             const uint32_t n,
+                             char dst[]) {
+  Swap<uint64_t>(reinterpret_cast<const char*>(src), dst, n);
+}
@@ -19,6 +19,8 @@
 #define SRC_UTIL_BITS_H_
 
 #include <stdint.h>
+#include <cstddef>
+#include <cstring>
 
 namespace lucene {
 namespace core {
@@ -155,6 +157,140 @@ class BitUtil {
   }
 };
 
+/**
+ * Bulk VInt32 codec, the same format DataInput::ReadVInt32 reads.
+ * SIMD kernels use movemask to find every terminating byte of a block at
+ * once and widen blocks of one byte values without looking at them one by
+ * one. In mixed blocks the AVX2 kernel also decodes one and two byte
+ * values eight at a time with a pshufb shuffle table; longer values, and
+ * every value of a mixed block in the SSE2 kernel, are assembled one by
+ * one. Scalar routines are the fallback and the reference.
+ */
+class VIntUtil {
+ public:
+  static const uint32_t MAX_VINT32_BYTES = 5;
+
+ private:
+  VIntUtil() = default;
+
+ public:
+  /**
+   * Decodes at most `n` values from `src_len` bytes. Stops before a value
+   * which is not complete in `src`. Returns consumed bytes, and the number
+   * of decoded values is stored in `decoded`.
+   * Throws IOException on a malformed value.
+   */
+  static uint32_t DecodeVInt32s(const char src[],
+                                const uint32_t src_len,
+                                int32_t dst[],
+                                const uint32_t n,
+                                uint32_t* decoded);
+
+  static uint32_t DecodeVInt32sScalar(const char src[],
+                                      const uint32_t src_len,
+                                      int32_t dst[],
+                                      const uint32_t n,
+                                      uint32_t* decoded);
+
+  // Only valid when HasAvx2() returns true
+  static uint32_t DecodeVInt32sAvx2(const char src[],
+                                    const uint32_t src_len,
+                                    int32_t dst[],
+                                    const uint32_t n,
+                                    uint32_t* decoded);
+
+  /**
+   * Encodes `n` values into `dst`, which must hold
+   * `n * MAX_VINT32_BYTES` bytes. Returns written bytes.
+   */
+  static uint32_t EncodeVInt32s(const int32_t src[],
+                                const uint32_t n,
+                                char dst[]);
+
+  static uint32_t EncodeVInt32sScalar(const int32_t src[],
+                                      const uint32_t n,
+                                      char dst[]);
+
+  static bool HasAvx2();
+};
+
+/**
+ * Big endian fixed width codec, the byte order DataOutput::WriteInt32 and
+ * friends write. Single values are one unaligned load or store plus a
+ * bswap. Bulk routines swap a whole register of values with one pshufb
+ * when the CPU has AVX2, `__builtin_bswap` loop otherwise.
+ * Bulk source and destination may be the same memory.
+ */
+class EndianUtil {
+ private:
+  EndianUtil() = default;
+
+ public:
+  static int16_t ReadInt16(const char src[]) noexcept {
+    uint16_t v;
+    std::memcpy(&v, src, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap16(v);
+#endif
+    return static_cast<int16_t>(v);
+  }
+
+  static int32_t ReadInt32(const char src[]) noexcept {
+    uint32_t v;
+    std::memcpy(&v, src, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return static_cast<int32_t>(v);
+  }
+
+  static int64_t ReadInt64(const char src[]) noexcept {
+    uint64_t v;
+    std::memcpy(&v, src, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return static_cast<int64_t>(v);
+  }
+
+  static void WriteInt16(const int16_t i, char dst[]) noexcept {
+    uint16_t v = static_cast<uint16_t>(i);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap16(v);
+#endif
+    std::memcpy(dst, &v, sizeof(v));
+  }
+
+  static void WriteInt32(const int32_t i, char dst[]) noexcept {
+    uint32_t v = static_cast<uint32_t>(i);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    std::memcpy(dst, &v, sizeof(v));
+  }
+
+  static void WriteInt64(const int64_t i, char dst[]) noexcept {
+    uint64_t v = static_cast<uint64_t>(i);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    std::memcpy(dst, &v, sizeof(v));
+  }
+
+  // `n` values from `n * sizeof(value)` big endian bytes
+  static void ReadInt16s(const char src[], int16_t dst[], const uint32_t n);
+
+  static void ReadInt32s(const char src[], int32_t dst[], const uint32_t n);
+
+  static void ReadInt64s(const char src[], int64_t dst[], const uint32_t n);
+
+  static void WriteInt16s(const int16_t src[], const uint32_t n, char dst[]);
+
+  static void WriteInt32s(const int32_t src[], const uint32_t n, char dst[]);
+
+  static void WriteInt64s(const int64_t src[], const uint32_t n, char dst[]);
+};
+
 }  // namespace util
 }  // namespace core
 }  // namespace lucene
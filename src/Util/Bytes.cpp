@@ -83,6 +83,22 @@ BytesRef::BytesRef(const char* new_bytes,
   assert(IsValid());
 }
 
+BytesRef::BytesRef(const char* new_bytes,
+                   const uint32_t new_offset,
+                   const uint32_t new_length,
+                   ViewTag)
+  : bytes(std::shared_ptr<char>(), const_cast<char*>(new_bytes)),
+    offset(new_offset),
+    length(new_length),
+    capacity(new_offset + new_length) {
+}
+
+BytesRef BytesRef::View(const char* new_bytes,
+                        const uint32_t new_offset,
+                        const uint32_t new_length) {
+  return BytesRef(new_bytes, new_offset, new_length, ViewTag());
+}
+
 BytesRef::BytesRef(const char* new_bytes, const uint32_t new_capacity)
   : BytesRef(new_bytes, 0, new_capacity, new_capacity) {
 }
@@ -210,7 +226,7 @@ bool BytesRef::operator>=(const BytesRef& other) const {
 }
 
 std::string BytesRef::UTF8ToString() {
-  return std::string(bytes.get(), offset, length);
+  return std::string(bytes.get() + offset, length);
 }
 
 bool BytesRef::IsValid() const {
@@ -34,6 +34,13 @@ class BytesRef {
  private:
   int32_t CompareTo(const BytesRef& other) const;
 
+  class ViewTag { };
+
+  BytesRef(const char* bytes,
+           const uint32_t offset,
+           const uint32_t length,
+           ViewTag);
+
  public:
   std::shared_ptr<char> bytes;
   uint32_t offset;
@@ -66,6 +73,21 @@ class BytesRef {
   bool operator>=(const BytesRef& other) const;
   std::string UTF8ToString();
   bool IsValid() const;
+
+  /**
+   * Non-owning reference to `bytes`. Nothing is copied and no reference
+   * count is touched, neither here nor when the view is moved or shallow
+   * copied. Caller keeps `bytes` alive and must not write through the view.
+   * Copy constructor and copy assignment still make an owning deep copy.
+   */
+  static BytesRef View(const char* bytes,
+                       const uint32_t offset,
+                       const uint32_t length);
+
+  bool IsView() const noexcept {
+    // Aliasing pointer without an owner has no control block
+    return (bytes.get() != nullptr && bytes.use_count() == 0);
+  }
 };
 
 class BytesRefBuilder {
@@ -18,13 +18,20 @@
 #ifndef SRC_UTIL_CONCURRENCY_H_
 #define SRC_UTIL_CONCURRENCY_H_
 
+#include <Util/Exception.h>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <string>
 #include <stdexcept>
 #include <typeindex>
 #include <typeinfo>
+#include <vector>
 
 namespace lucene {
 namespace core {
@@ -198,6 +205,89 @@ template <typename CLASS, typename TYPE>
 thread_local CloseableThreadLocalReference<CLASS, TYPE>
 CloseableThreadLocal<CLASS, TYPE>::reference;
 
+/**
+ * Fixed number of threads running tasks in the order they were submitted.
+ * Tasks still queued when it is destructed are run before threads join.
+ */
+class ThreadPool {
+ private:
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<std::packaged_task<void()>> tasks;
+  std::vector<std::thread> threads;
+  bool closed;
+
+ private:
+  void Run() {
+    while (true) {
+      std::packaged_task<void()> task;
+      {
+        std::unique_lock<std::mutex> guard(mutex);
+        cond.wait(guard, [this](){ return closed || !tasks.empty(); });
+        if (tasks.empty()) {
+          // Closed and drained
+          return;
+        }
+
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+
+      task();
+    }
+  }
+
+ public:
+  explicit ThreadPool(const uint32_t num_threads)
+    : mutex(),
+      cond(),
+      tasks(),
+      threads(),
+      closed(false) {
+    threads.reserve(num_threads);
+    for (uint32_t i = 0 ; i < num_threads ; ++i) {
+      threads.emplace_back(&ThreadPool::Run, this);
+    }
+  }
+
+  ThreadPool(const ThreadPool& other) = delete;
+
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      closed = true;
+    }
+    cond.notify_all();
+
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+
+  uint32_t GetNumThreads() const noexcept {
+    return threads.size();
+  }
+
+  // An exception thrown by `fn` is delivered through the returned future
+  std::future<void> Submit(std::function<void()>&& fn) {
+    std::packaged_task<void()> task(std::move(fn));
+    std::future<void> future = task.get_future();
+
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (closed) {
+        throw InvalidStateException("ThreadPool is closed");
+      }
+      tasks.push_back(std::move(task));
+    }
+    cond.notify_one();
+
+    return future;
+  }
+};
+
 }  // namespace util
 }  // namespace core
 }  // namespace lucene
@@ -16,6 +16,10 @@
  */
 
 #include <Util/Etc.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <algorithm>
 #include <cassert>
 #include <locale>
 #include <regex>
@@ -31,6 +35,7 @@
 #undef major
 #undef minor
 
+using lucene::core::util::Crc32Util;
 using lucene::core::util::Version;
 
 /**
@@ -218,3 +223,183 @@ Version Version::ParseLeniently(const std::string& version) {
     }
   }
 }
+
+/**
+ *  Crc32Util
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * Folds 64 bytes per iteration with carry-less multiplication and reduces
+ * the remainder with Barrett reduction. Refer "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction" from Intel.
+ * `len` must be at least 64 and a multiple of 16. `crc` is pre-inverted.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t Crc32FoldClmul(const unsigned char* buf,
+                               size_t len,
+                               const uint32_t crc) {
+  // Bit reflected constants of x^(4*128+32), x^(4*128-32),
+  // x^(128+32), x^(128-32), x^64 mod P(x) and the Barrett constants
+  alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00));
+  x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10));
+  x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20));
+  x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+  buf += 64;
+  len -= 64;
+
+  // Four independent folds per iteration
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00));
+    y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10));
+    y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20));
+    y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30));
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+    buf += 64;
+    len -= 64;
+  }
+
+  // Fold four lanes into one
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // Remaining 16 byte blocks
+  while (len >= 16) {
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    buf += 16;
+    len -= 16;
+  }
+
+  // 128 bits -> 64 bits
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+bool Crc32Util::HasClmul() {
+  static const bool has_clmul = (__builtin_cpu_supports("pclmul") &&
+                                 __builtin_cpu_supports("sse4.1"));
+  return has_clmul;
+}
+
+uint32_t Crc32Util::UpdateClmul(uint32_t crc,
+                                const char bytes[],
+                                size_t len) {
+  const unsigned char* buf = reinterpret_cast<const unsigned char*>(bytes);
+  if (len >= 64) {
+    const size_t folded = (len & ~static_cast<size_t>(15));
+    crc = ~Crc32FoldClmul(buf, folded, ~crc);
+    buf += folded;
+    len -= folded;
+  }
+
+  return UpdateScalar(crc, reinterpret_cast<const char*>(buf), len);
+}
+
+#else  // defined(__x86_64__) || defined(__i386__)
+
+bool Crc32Util::HasClmul() {
+  return false;
+}
+
+uint32_t Crc32Util::UpdateClmul(const uint32_t crc,
+                                const char bytes[],
+                                const size_t len) {
+  return UpdateScalar(crc, bytes, len);
+}
+
+#endif  // defined(__x86_64__) || defined(__i386__)
+
+uint32_t Crc32Util::UpdateScalar(uint32_t crc,
+                                 const char bytes[],
+                                 size_t len) {
+  const unsigned char* buf = reinterpret_cast<const unsigned char*>(bytes);
+  // zlib takes uInt length
+  const size_t max_chunk = (static_cast<size_t>(1) << 30);
+  while (len > 0) {
+    const uInt chunk = static_cast<uInt>(std::min(len, max_chunk));
+    crc = static_cast<uint32_t>(_l_crc32(crc, buf, chunk));
+    buf += chunk;
+    len -= chunk;
+  }
+
+  return crc;
+}
+
+uint32_t Crc32Util::Update(const uint32_t crc,
+                           const char bytes[],
+                           const size_t len) {
+  // Folding does not pay off on tiny inputs
+  if (len >= 64 && HasClmul()) {
+    return UpdateClmul(crc, bytes, len);
+  }
+
+  return UpdateScalar(crc, bytes, len);
+}
+
+uint32_t Crc32Util::Combine(const uint32_t crc1,
+                            const uint32_t crc2,
+                            const uint64_t len2) {
+  return static_cast<uint32_t>(
+         crc32_combine(crc1, crc2, static_cast<z_off_t>(len2)));
+}
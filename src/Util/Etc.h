@@ -19,6 +19,8 @@
 #define SRC_UTIL_ETC_H_
 
 #include <Util/ZlibCrc32.h>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 namespace lucene {
@@ -89,6 +91,40 @@ class Checksum {
   virtual void Reset() = 0;
 };
 
+class Crc32Util {
+ private:
+  Crc32Util() = default;
+
+ public:
+  /**
+   * CRC-32 (zlib/gzip polynomial) update. Uses PCLMULQDQ folding when the
+   * CPU has it, table driven zlib routine otherwise. Both are bit-for-bit
+   * identical.
+   */
+  static uint32_t Update(const uint32_t crc,
+                         const char bytes[],
+                         const size_t len);
+
+  static uint32_t UpdateScalar(const uint32_t crc,
+                               const char bytes[],
+                               const size_t len);
+
+  // Only valid when HasClmul() returns true
+  static uint32_t UpdateClmul(const uint32_t crc,
+                              const char bytes[],
+                              const size_t len);
+
+  static bool HasClmul();
+
+  /**
+   * CRC of two concatenated sequences, given CRCs of both and length of
+   * the second one. Lets ranges of a file be checksummed independently.
+   */
+  static uint32_t Combine(const uint32_t crc1,
+                          const uint32_t crc2,
+                          const uint64_t len2);
+};
+
 class Crc32: public Checksum {
  private:
   int32_t crc;
@@ -106,9 +142,7 @@ class Crc32: public Checksum {
   }
 
   void Update(const char bytes[], const uint32_t off, const uint32_t len) {
-    crc = _l_crc32(crc,
-                  reinterpret_cast<const unsigned char*>(bytes + off),
-                  len);
+    crc = Crc32Util::Update(crc, bytes + off, len);
   }
 
   int64_t GetValue() {
@@ -19,15 +19,22 @@
 #define SRC_UTIL_FILE_H_
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <linux/fs.h>
 #include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/types.h>
 #include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <Util/Exception.h>
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -36,6 +43,84 @@ namespace core {
 namespace util {
 
 class FileUtil {
+ public:
+  enum class CopyMethod {
+    CLONE, COPY_FILE_RANGE, SENDFILE, BUFFERED
+  };
+
+ private:
+  // Errors meaning `this way of copying does not work here`, try the next
+  static bool IsCopyUnsupported(const int err) {
+    return (err == EXDEV || err == EINVAL || err == ENOSYS ||
+            err == EOPNOTSUPP || err == ENOTTY || err == EPERM);
+  }
+
+  static CopyMethod CopyFd(const int in, const int out) {
+#ifdef FICLONE
+    if (ioctl(out, FICLONE, in) == 0) {
+      return CopyMethod::CLONE;
+    } else if (!IsCopyUnsupported(errno)) {
+      throw lucene::core::util::IOException(std::string(strerror(errno)));
+    }
+#endif
+
+    struct stat st;
+    if (fstat(in, &st) == -1) {
+      throw lucene::core::util::IOException(std::string(strerror(errno)));
+    }
+
+    // Every step goes on from the file offsets the previous one left
+    const size_t max_chunk = (static_cast<size_t>(1) << 30);
+    size_t left = st.st_size;
+    CopyMethod method = CopyMethod::COPY_FILE_RANGE;
+    while (left > 0 && method == CopyMethod::COPY_FILE_RANGE) {
+      const ssize_t result =
+      copy_file_range(in, nullptr, out, nullptr, std::min(left, max_chunk), 0);
+      if (result > 0) {
+        left -= result;
+      } else if (result == 0) {
+        throw lucene::core::util::EOFException("Source file shrank");
+      } else if (IsCopyUnsupported(errno)) {
+        method = CopyMethod::SENDFILE;
+      } else if (errno != EINTR) {
+        throw lucene::core::util::IOException(std::string(strerror(errno)));
+      }
+    }
+
+    while (left > 0 && method == CopyMethod::SENDFILE) {
+      const ssize_t result =
+      sendfile(out, in, nullptr, std::min(left, max_chunk));
+      if (result > 0) {
+        left -= result;
+      } else if (result == 0) {
+        throw lucene::core::util::EOFException("Source file shrank");
+      } else if (IsCopyUnsupported(errno)) {
+        method = CopyMethod::BUFFERED;
+      } else if (errno != EINTR) {
+        throw lucene::core::util::IOException(std::string(strerror(errno)));
+      }
+    }
+
+    if (left > 0) {
+      const size_t buffer_size = 65536;
+      std::unique_ptr<char[]> buffer = std::make_unique<char[]>(buffer_size);
+      while (left > 0) {
+        const ssize_t result =
+        read(in, buffer.get(), std::min(left, buffer_size));
+        if (result > 0) {
+          WriteFully(out, buffer.get(), result);
+          left -= result;
+        } else if (result == 0) {
+          throw lucene::core::util::EOFException("Source file shrank");
+        } else if (errno != EINTR) {
+          throw lucene::core::util::IOException(std::string(strerror(errno)));
+        }
+      }
+    }
+
+    return method;
+  }
+
  public:
   static bool Exists(const std::string& path) {
     return (access(path.c_str(), F_OK) == 0);
@@ -119,18 +204,28 @@ class FileUtil {
 
   static std::string ToRealPath(const std::string& path) {
     char path_buf[PATH_MAX + 1];
-    return std::string(realpath(path.c_str(), path_buf));
+    if (realpath(path.c_str(), path_buf) == nullptr) {
+      if (errno == ENOENT) {
+        throw lucene::core::util::NoSuchFileException(path);
+      }
+      throw lucene::core::util::IOException(std::string(strerror(errno)));
+    }
+
+    return std::string(path_buf);
   }
 
+  // Works for both files and directories, a missing path is an error
   static void Fsync(const std::string& path) {
-    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND);
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
     if (fd == -1) {
         throw lucene::core::util::IOException(std::string(strerror(errno)));
     }
 
     const int result = fsync(fd);
     if (result == -1) {
-        throw lucene::core::util::IOException(std::string(strerror(errno)));
+        const int err = errno;
+        close(fd);
+        throw lucene::core::util::IOException(std::string(strerror(err)));
     }
 
     const int close_result = close(fd);
@@ -139,6 +234,21 @@ class FileUtil {
     }
   }
 
+  // Flushes the whole filesystem containing `path` with one syscall
+  static void SyncFs(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw lucene::core::util::IOException(std::string(strerror(errno)));
+    }
+
+    const int result = syncfs(fd);
+    const int err = errno;
+    close(fd);
+    if (result == -1) {
+        throw lucene::core::util::IOException(std::string(strerror(err)));
+    }
+  }
+
   static uint64_t Size(const std::string& path) {
     const int fd = open(path.c_str(), O_RDONLY);
     if (fd == -1) {
@@ -156,6 +266,107 @@ class FileUtil {
     return size;
   }
 
+  static void WriteFully(const int fd, const char* data, size_t length) {
+    while (length > 0) {
+      const ssize_t result = write(fd, data, length);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw lucene::core::util::IOException(std::string(strerror(errno)));
+      }
+
+      data += result;
+      length -= result;
+    }
+  }
+
+  static void PWriteFully(const int fd,
+                          const char* data,
+                          size_t length,
+                          uint64_t offset) {
+    while (length > 0) {
+      const ssize_t result = pwrite(fd, data, length, offset);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw lucene::core::util::IOException(std::string(strerror(errno)));
+      }
+
+      data += result;
+      length -= result;
+      offset += result;
+    }
+  }
+
+  static void PReadFully(const int fd,
+                         char* data,
+                         size_t length,
+                         uint64_t offset) {
+    while (length > 0) {
+      const ssize_t result = pread(fd, data, length, offset);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw lucene::core::util::IOException(std::string(strerror(errno)));
+      } else if (result == 0) {
+        throw lucene::core::util::EOFException("Read past EOF");
+      }
+
+      data += result;
+      length -= result;
+      offset += result;
+    }
+  }
+
+  /**
+   * Copies `source` into `dest`, which must not exist yet. Cheapest way
+   * first: reflink (FICLONE) shares extents on XFS and btrfs, then
+   * copy_file_range and sendfile copy within the kernel, and a read/write
+   * loop is the last resort. Returns the way that finished the copy.
+   * `dest` is removed on failure.
+   */
+  static CopyMethod CopyFile(const std::string& source,
+                             const std::string& dest) {
+    const int in = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in == -1) {
+      if (errno == ENOENT) {
+        throw lucene::core::util::NoSuchFileException(source);
+      }
+      throw lucene::core::util::IOException(std::string(strerror(errno)));
+    }
+
+    const int out = open(dest.c_str(),
+                         O_CREAT | O_WRONLY | O_EXCL | O_CLOEXEC,
+                         S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+    if (out == -1) {
+      const int err = errno;
+      close(in);
+      throw lucene::core::util::IOException(std::string(strerror(err)));
+    }
+
+    CopyMethod method;
+    try {
+      method = CopyFd(in, out);
+    } catch(...) {
+      close(in);
+      close(out);
+      unlink(dest.c_str());
+      throw;
+    }
+
+    close(in);
+    if (close(out) == -1) {
+      const int err = errno;
+      unlink(dest.c_str());
+      throw lucene::core::util::IOException(std::string(strerror(err)));
+    }
+
+    return method;
+  }
+
   static void Move(const std::string& source, const std::string& dest) {
     const int result =
     rename(source.c_str(), dest.c_str());
@@ -17,10 +17,14 @@
 
 #include <Util/Etc.h>
 #include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
 #include <string>
 
 using lucene::core::util::Version;
 using lucene::core::util::Crc32;
+using lucene::core::util::Crc32Util;
 
 TEST(ETC__TESTS, VERSION__TESTS) {
   {
@@ -124,6 +128,57 @@ TEST(ETC__TESTS, CRC32__TESTS1) {
   EXPECT_EQ(2865713097, crc32.GetValue());
 }
 
+TEST(ETC__TESTS, CRC32__CLMUL__TESTS) {
+  // Folding kernel must be bit-for-bit same with zlib for every length
+  // and alignment, including the scalar tail
+  const uint32_t buf_size = 4096 + 64;
+  char buf[buf_size];
+  for (uint32_t i = 0 ; i < buf_size ; ++i) {
+    buf[i] = static_cast<char>(i * 31 + (i >> 3));
+  }
+
+  for (uint32_t len = 0 ; len <= 4096 ; len += (len < 300 ? 1 : 37)) {
+    for (uint32_t off = 0 ; off < 16 ; off += 3) {
+      const uint32_t seed = len * 2654435761U;
+      if (Crc32Util::HasClmul()) {
+        ASSERT_EQ(Crc32Util::UpdateScalar(seed, buf + off, len),
+                  Crc32Util::UpdateClmul(seed, buf + off, len));
+      }
+      ASSERT_EQ(Crc32Util::UpdateScalar(seed, buf + off, len),
+                Crc32Util::Update(seed, buf + off, len));
+    }
+  }
+}
+
+TEST(ETC__TESTS, CRC32__BENCHMARK) {
+  const size_t buf_size = 1 << 20;
+  const int rounds = 64;
+  std::unique_ptr<char[]> buf(new char[buf_size]);
+  for (size_t i = 0 ; i < buf_size ; ++i) {
+    buf[i] = static_cast<char>(i * 7);
+  }
+
+  using CrcFn = uint32_t (*)(const uint32_t, const char[], const size_t);
+  auto measure = [&](CrcFn fn, const char* label) {
+    uint32_t crc = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0 ; i < rounds ; ++i) {
+      crc = fn(crc, buf.get(), buf_size);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "  " << label << ": "
+              << (buf_size * rounds / (1024.0 * 1024.0)) / secs
+              << " MB/s" << std::endl;
+    return crc;
+  };
+
+  const uint32_t scalar = measure(&Crc32Util::UpdateScalar, "zlib table");
+  if (Crc32Util::HasClmul()) {
+    EXPECT_EQ(scalar, measure(&Crc32Util::UpdateClmul, "pclmulqdq"));
+  }
+}
+
 int main(int argc, char* argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();